@@ -4,6 +4,7 @@
 #define SWIG_PYTHON_2_UNICODE
 %}
 
+%include <stdint.i>
 %include <std_shared_ptr.i>
 %include <std_string.i>
 
@@ -12,6 +13,7 @@
 %{
     // make SWIG wrap following headers
     #include "libdnf/utils/sqlite3/Sqlite3.hpp"
+    #include "libdnf/utils/Instrumentation.hpp"
     #include "libdnf/utils/logger.hpp"
     #include "libdnf/log.hpp"
     #include "libdnf/utils/utils.hpp"
@@ -38,6 +40,9 @@ typedef long pid_t;
 
 %include "libdnf/log.hpp"
 
+%ignore libdnf::ScopedTimer;
+%include "libdnf/utils/Instrumentation.hpp"
+
 typedef int mode_t;
 
 namespace libdnf { namespace filesystem {
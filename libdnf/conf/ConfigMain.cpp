@@ -290,6 +290,8 @@ class ConfigMain::Impl {
     OptionString user_agent{getUserAgent()};
     OptionBool countme{false};
     OptionBool protect_running_kernel{true};
+    // 0 selects the number of CPUs, at most 8
+    OptionNumber<std::uint32_t> query_threads{0};
 
     // Repo main config
 
@@ -452,6 +454,7 @@ ConfigMain::Impl::Impl(Config & owner)
     owner.optBinds().add("user_agent", user_agent);
     owner.optBinds().add("countme", countme);
     owner.optBinds().add("protect_running_kernel", protect_running_kernel);
+    owner.optBinds().add("query_threads", query_threads);
 
     // Repo main config
 
@@ -594,6 +597,7 @@ OptionBool & ConfigMain::module_obsoletes() { return pImpl->module_obsoletes; }
 OptionString & ConfigMain::user_agent() { return pImpl->user_agent; }
 OptionBool & ConfigMain::countme() { return pImpl->countme; }
 OptionBool & ConfigMain::protect_running_kernel() {return pImpl->protect_running_kernel; }
+OptionNumber<std::uint32_t> & ConfigMain::query_threads() { return pImpl->query_threads; }
 
 // Repo main config
 OptionNumber<std::uint32_t> & ConfigMain::retries() { return pImpl->retries; }
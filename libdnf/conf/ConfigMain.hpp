@@ -130,6 +130,7 @@ public:
     OptionString & user_agent();
     OptionBool & countme();
     OptionBool & protect_running_kernel();
+    OptionNumber<std::uint32_t> & query_threads();
 
     // Repo main config
     OptionNumber<std::uint32_t> & retries();
@@ -79,6 +79,7 @@
 #include "goal/Goal.hpp"
 #include "plugin/plugin-private.hpp"
 #include "utils/GLibLogger.hpp"
+#include "utils/Instrumentation.hpp"
 #include "utils/os-release.hpp"
 
 
@@ -156,12 +157,14 @@ typedef struct
     gchar            *http_proxy;
     gchar            *user_agent;
     gchar            *arch;
+    gchar            *instrumentation_report;
     guint            cache_age;     /*seconds*/
     gboolean         cacheOnly{false};
     gboolean         check_disk_space;
     gboolean         check_transaction;
     gboolean         only_trusted;
     gboolean         enable_filelists;
+    gboolean         verify_metadata;
     gboolean         enrollment_valid;
     gboolean         write_history;
     DnfLock         *lock;
@@ -239,6 +242,18 @@ dnf_context_finalize(GObject *object)
     g_free(priv->http_proxy);
     g_free(priv->user_agent);
     g_free(priv->arch);
+    if (priv->instrumentation_report != NULL) {
+        try {
+            libdnf::Instrumentation::writeReport(priv->instrumentation_report);
+        } catch (const libdnf::Error & ex) {
+            g_warning("%s", ex.what());
+        }
+        g_free(priv->instrumentation_report);
+        /* the collected data went into this report, don't keep paying
+         * for the probes or leak them into the next context's report */
+        libdnf::Instrumentation::setEnabled(false);
+        libdnf::Instrumentation::reset();
+    }
     g_strfreev(priv->native_arches);
     g_object_unref(priv->lock);
     g_object_unref(priv->state);
@@ -798,6 +813,8 @@ dnf_context_ensure_transaction(DnfContext *context)
         priv->transaction = dnf_transaction_new(context);
         priv->transaction_thread = g_thread_self();
         dnf_transaction_set_repos(priv->transaction, priv->repos);
+        /* verify the packages while the rest is still downloading */
+        dnf_transaction_set_flags(priv->transaction, DNF_TRANSACTION_FLAG_PIPELINE);
         return;
     }
 
@@ -1072,6 +1089,21 @@ dnf_context_get_enable_filelists (DnfContext     *context)
     return priv->enable_filelists;
 }
 
+/**
+ * dnf_context_get_verify_metadata:
+ * @context: a #DnfContext instance.
+ *
+ * Returns: %TRUE if the checksums of cached metadata are verified on every check
+ *
+ * Since: 0.64.0
+ */
+gboolean
+dnf_context_get_verify_metadata(DnfContext *context)
+{
+    DnfContextPrivate *priv = GET_PRIVATE(context);
+    return priv->verify_metadata;
+}
+
 /**
  * dnf_context_get_cache_age:
  * @context: a #DnfContext instance.
@@ -1553,6 +1585,24 @@ dnf_context_set_enable_filelists (DnfContext     *context,
     priv->enable_filelists = enable_filelists;
 }
 
+/**
+ * dnf_context_set_verify_metadata:
+ * @context: a #DnfContext instance.
+ * @verify_metadata: %TRUE to verify the checksums of cached metadata on every check
+ *
+ * By default the checksums of cached metadata are verified only if the files
+ * changed on disk since they were last verified. This forces a full
+ * verification every time the repos are checked.
+ *
+ * Since: 0.64.0
+ **/
+void
+dnf_context_set_verify_metadata(DnfContext *context, gboolean verify_metadata)
+{
+    DnfContextPrivate *priv = GET_PRIVATE(context);
+    priv->verify_metadata = verify_metadata;
+}
+
 /**
  * dnf_context_set_only_trusted:
  * @context: a #DnfContext instance.
@@ -1721,6 +1771,28 @@ dnf_context_set_user_agent (DnfContext  *context,
     priv->user_agent = g_strdup (user_agent);
 }
 
+/**
+ * dnf_context_set_instrumentation_report:
+ * @context: Context
+ * @filename: (nullable): where to write the JSON report, or %NULL to disable
+ *
+ * Enables collection of timers and counters of the libdnf hot paths
+ * (sack setup, repo loading, queries, depsolving, downloads and the rpm
+ * transaction). The report is written to @filename when @context is
+ * destroyed, which also stops the collection again.
+ *
+ * Since: 0.64.0
+ **/
+void
+dnf_context_set_instrumentation_report (DnfContext  *context,
+                                        const gchar *filename)
+{
+    DnfContextPrivate *priv = GET_PRIVATE(context);
+    g_free (priv->instrumentation_report);
+    priv->instrumentation_report = g_strdup (filename);
+    libdnf::Instrumentation::setEnabled(filename != NULL);
+}
+
 /**
  * dnf_context_rpmdb_changed_cb:
  **/
@@ -1784,6 +1856,7 @@ dnf_context_setup_sack_with_flags(DnfContext               *context,
                                   DnfContextSetupSackFlags  flags,
                                   GError                  **error) try
 {
+    libdnf::ScopedTimer timer("context.setup_sack");
     DnfContextPrivate *priv = GET_PRIVATE(context);
     gboolean ret;
     g_autofree gchar *solv_dir_real = nullptr;
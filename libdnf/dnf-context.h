@@ -144,6 +144,7 @@ guint            dnf_context_get_cache_age              (DnfContext     *context
 guint            dnf_context_get_installonly_limit      (DnfContext     *context);
 const gchar     *dnf_context_get_http_proxy             (DnfContext     *context);
 gboolean         dnf_context_get_enable_filelists       (DnfContext     *context);
+gboolean         dnf_context_get_verify_metadata        (DnfContext     *context);
 GPtrArray       *dnf_context_get_repos                  (DnfContext     *context);
 #ifndef __GI_SCANNER__
 DnfRepoLoader   *dnf_context_get_repo_loader            (DnfContext     *context);
@@ -197,6 +198,8 @@ void             dnf_context_set_keep_cache             (DnfContext     *context
                                                          gboolean        keep_cache);
 void             dnf_context_set_enable_filelists       (DnfContext     *context,
                                                          gboolean        enable_filelists);
+void             dnf_context_set_verify_metadata        (DnfContext     *context,
+                                                         gboolean        verify_metadata);
 void             dnf_context_set_only_trusted           (DnfContext     *context,
                                                          gboolean        only_trusted);
 void             dnf_context_set_zchunk                 (DnfContext     *context,
@@ -213,6 +216,8 @@ void             dnf_context_set_http_proxy             (DnfContext     *context
                                                          const gchar    *proxyurl);
 void             dnf_context_set_user_agent             (DnfContext     *context,
                                                          const gchar    *user_agent);
+void             dnf_context_set_instrumentation_report (DnfContext     *context,
+                                                         const gchar    *filename);
 
 /* object methods */
 gboolean         dnf_context_setup                      (DnfContext     *context,
@@ -43,7 +43,10 @@
 #include "catch-error.hpp"
 #include "dnf-context.hpp"
 #include "dnf-package.h"
+#include "dnf-repo.hpp"
+#include "dnf-sack-private.hpp"
 #include "dnf-types.h"
+#include "hy-package-private.hpp"
 #include "dnf-utils.h"
 #include "hy-util.h"
 #include "repo/solvable/Dependency.hpp"
@@ -819,6 +822,30 @@ dnf_package_array_download(GPtrArray *packages,
                 const gchar *directory,
                 DnfState *state,
                 GError **error) try
+{
+    return dnf_package_array_download_full(packages, directory, NULL, NULL, state, error);
+} CATCH_TO_GERROR(FALSE)
+
+/**
+ * dnf_package_array_download_full:
+ * @packages: an array of packages.
+ * @directory: destination directory, or %NULL for the cachedir.
+ * @downloaded_cb: (nullable): called for each package once its file is complete.
+ * @user_data: data for @downloaded_cb.
+ * @state: the #DnfState.
+ * @error: a #GError or %NULL..
+ *
+ * Downloads an array of packages, see dnf_repo_download_packages_full().
+ *
+ * Returns: %TRUE for success
+ */
+gboolean
+dnf_package_array_download_full(GPtrArray *packages,
+                                const gchar *directory,
+                                DnfRepoPackageDownloadedFunc downloaded_cb,
+                                gpointer user_data,
+                                DnfState *state,
+                                GError **error) try
 {
     DnfState *state_local;
     GHashTableIter hiter;
@@ -859,7 +886,8 @@ dnf_package_array_download(GPtrArray *packages,
         GPtrArray *repo_packages = (GPtrArray*)value;
 
         state_local = dnf_state_get_child(state);
-        if (!dnf_repo_download_packages(repo, repo_packages, directory, state_local, error))
+        if (!dnf_repo_download_packages_full(repo, repo_packages, directory,
+                                             downloaded_cb, user_data, state_local, error))
             return FALSE;
 
         /* done */
@@ -884,11 +912,26 @@ dnf_package_array_get_download_size(GPtrArray *packages)
 {
     guint i;
     guint64 download_size = 0;
+    DnfSack *sack = NULL;
+    const std::vector<uint64_t> *sizes = NULL;
 
     for (i = 0; i < packages->len; i++) {
         DnfPackage *pkg = (DnfPackage*)g_ptr_array_index(packages, i);
 
-        download_size += dnf_package_get_downloadsize(pkg);
+        /* arrays covering much of the sack read the sizes of all its packages at once */
+        DnfSack *pkg_sack = dnf_package_get_sack(pkg);
+        if (pkg_sack != sack) {
+            auto column = libdnf::AttributeCache::Column::DOWNLOADSIZE;
+            auto cache = dnf_sack_get_attribute_cache(pkg_sack);
+            sack = pkg_sack;
+            sizes = NULL;
+            if (cache->useColumn(column, packages->len))
+                sizes = &cache->column(column);
+        }
+        if (sizes)
+            download_size += (*sizes)[dnf_package_get_id(pkg)];
+        else
+            download_size += dnf_package_get_downloadsize(pkg);
     }
 
     return download_size;
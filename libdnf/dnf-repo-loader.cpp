@@ -32,6 +32,7 @@
  */
 
 #include <strings.h>
+#include <sys/stat.h>
 
 #include <gio/gunixmounts.h>
 #include <librepo/util.h>
@@ -39,7 +40,7 @@
 
 #include "catch-error.hpp"
 #include "dnf-package.h"
-#include "dnf-repo-loader.h"
+#include "dnf-repo-loader-private.hpp"
 #include "dnf-utils.h"
 
 typedef struct
@@ -49,8 +50,20 @@ typedef struct
     GPtrArray       *repos;
     GVolumeMonitor  *volume_monitor;
     gboolean         loaded;
+    GHashTable      *keyfiles;   /* filename : DnfRepoLoaderKeyFile */
+    guint            generation;
 } DnfRepoLoaderPrivate;
 
+/* a parsed .repo file, reused by the next refresh while the file is unchanged
+ * and no repo of an earlier refresh still uses it */
+typedef struct
+{
+    GKeyFile        *keyfile;
+    struct stat      st;
+    guint            generation;
+    GPtrArray       *users;     /* of GWeakRef to the DnfRepos given keyfile */
+} DnfRepoLoaderKeyFile;
+
 enum {
     SIGNAL_CHANGED,
     SIGNAL_LAST
@@ -76,14 +89,18 @@ dnf_repo_loader_finalize(GObject *object)
     g_ptr_array_unref(priv->monitor_repos);
     g_object_unref(priv->volume_monitor);
     g_ptr_array_unref(priv->repos);
+    g_hash_table_unref(priv->keyfiles);
 
     G_OBJECT_CLASS(dnf_repo_loader_parent_class)->finalize(object);
 }
 
 /**
  * dnf_repo_loader_invalidate:
+ * @self: a #DnfRepoLoader instance.
+ *
+ * Makes the next dnf_repo_loader_get_repos() load the repos again.
  */
-static void
+void
 dnf_repo_loader_invalidate(DnfRepoLoader *self)
 {
     DnfRepoLoaderPrivate *priv = GET_PRIVATE(self);
@@ -104,6 +121,27 @@ dnf_repo_loader_mount_changed_cb(GVolumeMonitor *vm, GMount *mount, DnfRepoLoade
     dnf_repo_loader_invalidate(self);
 }
 
+/**
+ * dnf_repo_loader_keyfile_free:
+ **/
+static void
+dnf_repo_loader_keyfile_free(DnfRepoLoaderKeyFile *cached)
+{
+    g_key_file_unref(cached->keyfile);
+    g_ptr_array_unref(cached->users);
+    g_free(cached);
+}
+
+/**
+ * dnf_repo_loader_keyfile_user_free:
+ **/
+static void
+dnf_repo_loader_keyfile_user_free(GWeakRef *user)
+{
+    g_weak_ref_clear(user);
+    g_free(user);
+}
+
 /**
  * dnf_repo_loader_init:
  **/
@@ -114,6 +152,8 @@ dnf_repo_loader_init(DnfRepoLoader *self)
     priv->monitor_repos = g_ptr_array_new_with_free_func((GDestroyNotify) g_object_unref);
     priv->repos = g_ptr_array_new_with_free_func((GDestroyNotify) g_object_unref);
     priv->volume_monitor = g_volume_monitor_get();
+    priv->keyfiles = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                           (GDestroyNotify) dnf_repo_loader_keyfile_free);
     g_signal_connect(priv->volume_monitor, "mount-added",
                      G_CALLBACK(dnf_repo_loader_mount_changed_cb), self);
     g_signal_connect(priv->volume_monitor, "mount-removed",
@@ -328,6 +368,123 @@ dnf_repo_loader_load_multiline_key_file(const gchar *filename, GError **error)
     return file;
 }
 
+/**
+ * dnf_repo_loader_keyfile_is_current:
+ **/
+static gboolean
+dnf_repo_loader_keyfile_is_current(const DnfRepoLoaderKeyFile *cached, const struct stat *st)
+{
+    return cached->st.st_dev == st->st_dev &&
+           cached->st.st_ino == st->st_ino &&
+           cached->st.st_size == st->st_size &&
+           cached->st.st_mtim.tv_sec == st->st_mtim.tv_sec &&
+           cached->st.st_mtim.tv_nsec == st->st_mtim.tv_nsec &&
+           cached->st.st_ctim.tv_sec == st->st_ctim.tv_sec &&
+           cached->st.st_ctim.tv_nsec == st->st_ctim.tv_nsec;
+}
+
+/**
+ * dnf_repo_loader_keyfile_in_use:
+ *
+ * Returns %TRUE if a repo given the keyfile is still alive. Such a repo
+ * can modify the keyfile with dnf_repo_set_data(), which must not leak
+ * into the repos of a later refresh.
+ **/
+static gboolean
+dnf_repo_loader_keyfile_in_use(DnfRepoLoaderKeyFile *cached)
+{
+    for (guint i = cached->users->len; i > 0; i--) {
+        auto user = static_cast<GWeakRef *>(g_ptr_array_index(cached->users, i - 1));
+        auto repo = g_weak_ref_get(user);
+        if (repo != NULL) {
+            g_object_unref(repo);
+            return TRUE;
+        }
+        g_ptr_array_remove_index_fast(cached->users, i - 1);
+    }
+    return FALSE;
+}
+
+/**
+ * dnf_repo_loader_keyfile_add_user:
+ **/
+static void
+dnf_repo_loader_keyfile_add_user(DnfRepoLoader *self,
+                                 const gchar *filename,
+                                 GKeyFile *keyfile,
+                                 DnfRepo *repo)
+{
+    DnfRepoLoaderPrivate *priv = GET_PRIVATE(self);
+    auto cached = static_cast<DnfRepoLoaderKeyFile *>(g_hash_table_lookup(priv->keyfiles, filename));
+    if (cached == NULL || cached->keyfile != keyfile)
+        return;
+    auto user = g_new0(GWeakRef, 1);
+    g_weak_ref_init(user, repo);
+    g_ptr_array_add(cached->users, user);
+}
+
+/**
+ * dnf_repo_loader_get_keyfile:
+ *
+ * Returns the parsed file, reusing the keyfile of the previous refresh if
+ * the file has not changed since and its repos are gone.
+ **/
+static GKeyFile *
+dnf_repo_loader_get_keyfile(DnfRepoLoader *self, const gchar *filename, GError **error)
+{
+    DnfRepoLoaderPrivate *priv = GET_PRIVATE(self);
+    struct stat st;
+
+    /* stat before reading, a file changed meanwhile is then parsed again next time */
+    if (stat(filename, &st) != 0)
+        return dnf_repo_loader_load_multiline_key_file(filename, error);
+
+    auto cached = static_cast<DnfRepoLoaderKeyFile *>(g_hash_table_lookup(priv->keyfiles, filename));
+    if (cached != NULL && dnf_repo_loader_keyfile_is_current(cached, &st) &&
+        !dnf_repo_loader_keyfile_in_use(cached)) {
+        g_debug("using already parsed %s", filename);
+        cached->generation = priv->generation;
+        return g_key_file_ref(cached->keyfile);
+    }
+
+    auto keyfile = dnf_repo_loader_load_multiline_key_file(filename, error);
+    if (keyfile == NULL)
+        return NULL;
+    cached = g_new0(DnfRepoLoaderKeyFile, 1);
+    cached->keyfile = g_key_file_ref(keyfile);
+    cached->st = st;
+    cached->users = g_ptr_array_new_with_free_func((GDestroyNotify) dnf_repo_loader_keyfile_user_free);
+    cached->generation = priv->generation;
+    g_hash_table_insert(priv->keyfiles, g_strdup(filename), cached);
+    return keyfile;
+}
+
+/**
+ * dnf_repo_loader_keyfile_is_stale:
+ **/
+static gboolean
+dnf_repo_loader_keyfile_is_stale(gpointer key, gpointer value, gpointer user_data)
+{
+    auto cached = static_cast<DnfRepoLoaderKeyFile *>(value);
+    return cached->generation != GPOINTER_TO_UINT(user_data);
+}
+
+/**
+ * dnf_repo_loader_forget_keyfile:
+ * @self: a #DnfRepoLoader instance.
+ * @filename: a .repo file
+ *
+ * Makes the next refresh parse the file again. To be called when the
+ * keyfile of the file is modified in memory, the modification must not
+ * survive the refresh unless it is written to the file.
+ **/
+void
+dnf_repo_loader_forget_keyfile(DnfRepoLoader *self, const gchar *filename)
+{
+    DnfRepoLoaderPrivate *priv = GET_PRIVATE(self);
+    g_hash_table_remove(priv->keyfiles, filename);
+}
+
 /**
  * dnf_repo_loader_repo_parse_id:
  **/
@@ -346,6 +503,7 @@ dnf_repo_loader_repo_parse_id(DnfRepoLoader *self,
     dnf_repo_set_keyfile(repo, keyfile);
     dnf_repo_set_filename(repo, filename);
     dnf_repo_set_id(repo, id);
+    dnf_repo_loader_keyfile_add_user(self, filename, keyfile, repo);
 
     /* set up the repo ready for use */
     if (!dnf_repo_setup(repo, error))
@@ -370,7 +528,7 @@ dnf_repo_loader_repo_parse(DnfRepoLoader *self,
     g_autoptr(GKeyFile) keyfile = NULL;
 
     /* load non-standard keyfile */
-    keyfile = dnf_repo_loader_load_multiline_key_file(filename, error);
+    keyfile = dnf_repo_loader_get_keyfile(self, filename, error);
     if (keyfile == NULL) {
         g_prefix_error(error, "Failed to load %s: ", filename);
         return FALSE;
@@ -403,6 +561,7 @@ dnf_repo_loader_refresh(DnfRepoLoader *self, GError **error)
     /* no longer loaded */
     dnf_repo_loader_invalidate(self);
     g_ptr_array_set_size(priv->repos, 0);
+    priv->generation++;
 
     /* re-populate redhat.repo */
     if (!dnf_context_setup_enrollments(priv->context, error))
@@ -437,6 +596,10 @@ dnf_repo_loader_refresh(DnfRepoLoader *self, GError **error)
         }
     }
 
+    /* drop the files that are gone */
+    g_hash_table_foreach_remove(priv->keyfiles, dnf_repo_loader_keyfile_is_stale,
+                                GUINT_TO_POINTER(priv->generation));
+
     /* add any DVD repos */
     if (!dnf_repo_loader_get_repos_removable(self, error))
         return FALSE;
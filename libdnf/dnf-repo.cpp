@@ -41,6 +41,8 @@
 
 #include <strings.h>
 #include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <fnmatch.h>
 #include <glib/gstdio.h>
 #include "hy-util.h"
@@ -51,10 +53,12 @@
 #include "catch-error.hpp"
 #include "dnf-keyring.h"
 #include "dnf-package.h"
+#include "dnf-repo-loader-private.hpp"
 #include "dnf-repo.hpp"
 #include "dnf-types.h"
 #include "dnf-utils.h"
 #include "utils/File.hpp"
+#include "utils/Instrumentation.hpp"
 #include "utils/url-encode.hpp"
 #include "utils/utils.hpp"
 
@@ -1360,6 +1364,143 @@ dnf_repo_set_timestamp_modified(DnfRepo *repo, GError **error)
     return TRUE;
 }
 
+/* records the metadata files verified by the last full checksum check */
+#define DNF_REPO_VERIFIED_CACHE         "metadata-verified"
+#define DNF_REPO_VERIFIED_CACHE_VERSION 1
+
+/**
+ * dnf_repo_verified_cache_add_file:
+ **/
+static gboolean
+dnf_repo_verified_cache_add_file(GString *str, const gchar *path)
+{
+    struct stat st;
+
+    if (path == NULL || stat(path, &st) != 0)
+        return FALSE;
+    g_string_append_printf(str,
+                           "%" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT " %" G_GINT64_FORMAT
+                           " %" G_GINT64_FORMAT ".%09li %" G_GINT64_FORMAT ".%09li %s\n",
+                           (guint64) st.st_dev, (guint64) st.st_ino, (gint64) st.st_size,
+                           (gint64) st.st_mtim.tv_sec, (long) st.st_mtim.tv_nsec,
+                           (gint64) st.st_ctim.tv_sec, (long) st.st_ctim.tv_nsec,
+                           path);
+    return TRUE;
+}
+
+/**
+ * dnf_repo_verified_cache_owned:
+ *
+ * The verification record is only trusted and written in a cache directory
+ * owned by the effective user, so nobody else can record unverified files
+ * as verified and we never write into a directory of another user.
+ **/
+static gboolean
+dnf_repo_verified_cache_owned(const gchar *location, const gchar *verified_fn)
+{
+    struct stat st;
+
+    if (stat(location, &st) != 0 || !S_ISDIR(st.st_mode) || st.st_uid != geteuid())
+        return FALSE;
+    /* a record left there by somebody else is not ours to trust */
+    if (lstat(verified_fn, &st) == 0 && (!S_ISREG(st.st_mode) || st.st_uid != geteuid()))
+        return FALSE;
+    return TRUE;
+}
+
+/**
+ * dnf_repo_verified_cache_describe:
+ *
+ * Describes the metadata files found by a local check as they are on disk
+ * now: the device, inode, size, mtime and ctime of repomd.xml and of every
+ * metadata file, prefixed by the requested metadata types.
+ *
+ * Returns: a new string, or %NULL if a file cannot be stat'ed
+ **/
+static gchar *
+dnf_repo_verified_cache_describe(const std::vector<const char *> &download_list,
+                                 LrYumRepo *yum_repo)
+{
+    GString *str = g_string_new(NULL);
+
+    g_string_append_printf(str, "%i", DNF_REPO_VERIFIED_CACHE_VERSION);
+    for (auto item : download_list) {
+        if (item)
+            g_string_append_printf(str, " %s", item);
+    }
+    g_string_append_c(str, '\n');
+    if (!dnf_repo_verified_cache_add_file(str, yum_repo->repomd)) {
+        g_string_free(str, TRUE);
+        return NULL;
+    }
+    for (auto *elem = yum_repo->paths; elem; elem = g_slist_next(elem)) {
+        auto yumrepopath = static_cast<LrYumRepoPath *>(elem->data);
+        if (yumrepopath == NULL)
+            continue;
+        if (!dnf_repo_verified_cache_add_file(str, yumrepopath->path)) {
+            g_string_free(str, TRUE);
+            return NULL;
+        }
+    }
+    return g_string_free(str, FALSE);
+}
+
+/**
+ * dnf_repo_check_perform:
+ *
+ * Loads the metadata from the repo location, optionally verifying the
+ * checksums of all the files against repomd.xml.
+ **/
+static gboolean
+dnf_repo_check_perform(DnfRepo *repo,
+                       const std::vector<const char *> &download_list,
+                       gboolean checksum,
+                       LrYumRepo **yum_repo,
+                       GError **error)
+{
+    DnfRepoPrivate *priv = GET_PRIVATE(repo);
+    const gchar *urls[] = { "", NULL };
+    g_autoptr(GError) error_local = NULL;
+
+    urls[0] = priv->location;
+    if (!lr_handle_setopt(priv->repo_handle, error, LRO_URLS, urls))
+        return FALSE;
+    if (!lr_handle_setopt(priv->repo_handle, error, LRO_DESTDIR, priv->location))
+        return FALSE;
+    if (!lr_handle_setopt(priv->repo_handle, error, LRO_LOCAL, 1L))
+        return FALSE;
+    if (!lr_handle_setopt(priv->repo_handle, error, LRO_CHECKSUM, checksum ? 1L : 0L))
+        return FALSE;
+    if (!lr_handle_setopt(priv->repo_handle, error, LRO_YUMDLIST, download_list.data()))
+        return FALSE;
+    if (!lr_handle_setopt(priv->repo_handle, error, LRO_MIRRORLISTURL, NULL))
+        return FALSE;
+    if (!lr_handle_setopt(priv->repo_handle, error, LRO_METALINKURL, NULL))
+        return FALSE;
+    if (!lr_handle_setopt(priv->repo_handle, error, LRO_GNUPGHOMEDIR, priv->keyring))
+        return FALSE;
+    lr_result_clear(priv->repo_result);
+    if (!lr_handle_perform(priv->repo_handle, priv->repo_result, &error_local)) {
+        g_set_error(error,
+                    DNF_ERROR,
+                    DNF_ERROR_REPO_NOT_AVAILABLE,
+                    "repodata %s was not complete: %s",
+                    priv->repo->getId().c_str(), error_local->message);
+        return FALSE;
+    }
+
+    /* get the metadata file locations */
+    if (!lr_result_getinfo(priv->repo_result, &error_local, LRR_YUM_REPO, yum_repo)) {
+        g_set_error(error,
+                    DNF_ERROR,
+                    DNF_ERROR_INTERNAL_ERROR,
+                    "failed to get yum-repo: %s",
+                    error_local->message);
+        return FALSE;
+    }
+    return TRUE;
+}
+
 static gboolean
 dnf_repo_check_internal(DnfRepo *repo,
                         guint permissible_cache_age,
@@ -1382,7 +1523,8 @@ dnf_repo_check_internal(DnfRepo *repo,
     download_list.push_back(NULL);
     gboolean ret;
     LrYumRepo *yum_repo;
-    const gchar *urls[] = { "", NULL };
+    gboolean use_verified_cache;
+    g_autofree gchar *verified_fn = NULL;
     gint64 age_of_data; /* in seconds */
     g_autoptr(GError) error_local = NULL;
     guint metadata_expire;
@@ -1412,43 +1554,34 @@ dnf_repo_check_internal(DnfRepo *repo,
         return FALSE;
     }
 
-    /* Yum metadata */
+    /* Yum metadata; the checksums of the files in our own cache are only
+     * verified if they changed since the last verification */
     dnf_state_action_start(state, DNF_STATE_ACTION_LOADING_CACHE, NULL);
-    urls[0] = priv->location;
-    if (!lr_handle_setopt(priv->repo_handle, error, LRO_URLS, urls))
-        return FALSE;
-    if (!lr_handle_setopt(priv->repo_handle, error, LRO_DESTDIR, priv->location))
-        return FALSE;
-    if (!lr_handle_setopt(priv->repo_handle, error, LRO_LOCAL, 1L))
-        return FALSE;
-    if (!lr_handle_setopt(priv->repo_handle, error, LRO_CHECKSUM, 1L))
-        return FALSE;
-    if (!lr_handle_setopt(priv->repo_handle, error, LRO_YUMDLIST, download_list.data()))
-        return FALSE;
-    if (!lr_handle_setopt(priv->repo_handle, error, LRO_MIRRORLISTURL, NULL))
-        return FALSE;
-    if (!lr_handle_setopt(priv->repo_handle, error, LRO_METALINKURL, NULL))
-        return FALSE;
-    if (!lr_handle_setopt(priv->repo_handle, error, LRO_GNUPGHOMEDIR, priv->keyring))
-        return FALSE;
-    lr_result_clear(priv->repo_result);
-    if (!lr_handle_perform(priv->repo_handle, priv->repo_result, &error_local)) {
-        g_set_error(error,
-                    DNF_ERROR,
-                    DNF_ERROR_REPO_NOT_AVAILABLE,
-                    "repodata %s was not complete: %s",
-                    priv->repo->getId().c_str(), error_local->message);
-        return FALSE;
-    }
-
-    /* get the metadata file locations */
-    if (!lr_result_getinfo(priv->repo_result, &error_local, LRR_YUM_REPO, &yum_repo)) {
-        g_set_error(error,
-                    DNF_ERROR,
-                    DNF_ERROR_INTERNAL_ERROR,
-                    "failed to get yum-repo: %s",
-                    error_local->message);
+    verified_fn = g_build_filename(priv->location, DNF_REPO_VERIFIED_CACHE, NULL);
+    use_verified_cache = priv->kind == DNF_REPO_KIND_REMOTE &&
+                         !dnf_context_get_verify_metadata(priv->context) &&
+                         dnf_repo_verified_cache_owned(priv->location, verified_fn);
+    if (!dnf_repo_check_perform(repo, download_list, !use_verified_cache, &yum_repo, error))
         return FALSE;
+    if (use_verified_cache) {
+        g_autofree gchar *verified = NULL;
+        g_autofree gchar *described = NULL;
+
+        /* describe the files before hashing them, so a file changed
+         * during the verification is not recorded as verified */
+        described = dnf_repo_verified_cache_describe(download_list, yum_repo);
+        if (described == NULL ||
+            !g_file_get_contents(verified_fn, &verified, NULL, NULL) ||
+            g_strcmp0(verified, described) != 0) {
+            g_debug("verifying checksums of %s metadata", priv->repo->getId().c_str());
+            if (!dnf_repo_check_perform(repo, download_list, TRUE, &yum_repo, error))
+                return FALSE;
+            if (described != NULL &&
+                !g_file_set_contents(verified_fn, described, -1, &error_local)) {
+                g_debug("failed to write %s: %s", verified_fn, error_local->message);
+                g_clear_error(&error_local);
+            }
+        }
     }
 
     /* get timestamp */
@@ -1500,6 +1633,14 @@ dnf_repo_check_internal(DnfRepo *repo,
             newRepoImpl->metadataPaths[yumrepopath->type] = yumrepopath->path;
         }
     }
+    LrYumRepoMd *yum_repomd = NULL;
+    if (lr_result_getinfo(priv->repo_result, NULL, LRR_YUM_REPOMD, &yum_repomd)) {
+        for (auto *elem = yum_repomd->records; elem; elem = g_slist_next(elem)) {
+            auto rec = static_cast<LrYumRepoMdRecord *>(elem->data);
+            if (rec && rec->checksum)
+                newRepoImpl->metadataChecksums[rec->type] = rec->checksum;
+        }
+    }
     /* ensure we reset the values from the keyfile */
     if (!dnf_repo_set_keyfile_data(repo, TRUE, error))
         return FALSE;
@@ -1691,23 +1832,18 @@ repo_mirrorlist_failure_cb(void *user_data,
 }
 
 /**
- * dnf_repo_update:
- * @repo: a #DnfRepo instance.
- * @flags: #DnfRepoUpdateFlags, e.g. %DNF_REPO_UPDATE_FLAG_FORCE
- * @state: a #DnfState instance.
- * @error: a #%GError or %NULL.
- *
- * Updates the repo.
- *
- * Returns: %TRUE for success, %FALSE otherwise
- *
- * Since: 0.1.0
+ * dnf_repo_update_internal:
+ * @worker: %TRUE when called by dnf_repo_update_locked() from a worker
+ *          thread, which leaves the steps touching the keyfile, the logger
+ *          and the context to dnf_repo_update_prepare() and
+ *          dnf_repo_update_finish() on the caller thread
  **/
-gboolean
-dnf_repo_update(DnfRepo *repo,
-                DnfRepoUpdateFlags flags,
-                DnfState *state,
-                GError **error) try
+static gboolean
+dnf_repo_update_internal(DnfRepo *repo,
+                         DnfRepoUpdateFlags flags,
+                         gboolean worker,
+                         DnfState *state,
+                         GError **error)
 {
     DnfRepoPrivate *priv = GET_PRIVATE(repo);
     DnfState *state_local;
@@ -1748,20 +1884,19 @@ dnf_repo_update(DnfRepo *repo,
         return FALSE;
     }
 
-    /* ensure we set the values from the keyfile */
-    if (!dnf_repo_set_keyfile_data(repo, TRUE, error))
+    /* ensure we set the values from the keyfile, with countme support */
+    if (!worker && !dnf_repo_update_prepare(repo, error))
         return FALSE;
 
-    /* countme support */
-    libdnf::repoGetImpl(priv->repo)->addCountmeFlag(priv->repo_handle);
-
     /* take lock */
-    ret = dnf_state_take_lock(state,
-                              DNF_LOCK_TYPE_METADATA,
-                              DNF_LOCK_MODE_PROCESS,
-                              error);
-    if (!ret)
-        goto out;
+    if (!worker) {
+        ret = dnf_state_take_lock(state,
+                                  DNF_LOCK_TYPE_METADATA,
+                                  DNF_LOCK_MODE_PROCESS,
+                                  error);
+        if (!ret)
+            goto out;
+    }
 
     /* set state */
     ret = dnf_state_set_steps(state, error,
@@ -1949,8 +2084,8 @@ dnf_repo_update(DnfRepo *repo,
         goto out;
 
     /* signal that the vendor platform data is not resyned */
-    dnf_context_invalidate_full(priv->context, "updated repo cache",
-                                DNF_CONTEXT_INVALIDATE_FLAG_ENROLLMENT);
+    if (!worker)
+        dnf_repo_update_finish(repo);
 
     /* done */
     ret = dnf_state_done(state, error);
@@ -1973,6 +2108,91 @@ out:
     if (!lr_handle_setopt(priv->repo_handle, NULL, LRO_PROGRESSDATA, 0xdeadbeef))
             g_debug("Failed to set LRO_PROGRESSDATA to 0xdeadbeef");
     return ret;
+}
+
+/**
+ * dnf_repo_update:
+ * @repo: a #DnfRepo instance.
+ * @flags: #DnfRepoUpdateFlags, e.g. %DNF_REPO_UPDATE_FLAG_FORCE
+ * @state: a #DnfState instance.
+ * @error: a #%GError or %NULL.
+ *
+ * Updates the repo.
+ *
+ * Returns: %TRUE for success, %FALSE otherwise
+ *
+ * Since: 0.1.0
+ **/
+gboolean
+dnf_repo_update(DnfRepo *repo,
+                DnfRepoUpdateFlags flags,
+                DnfState *state,
+                GError **error) try
+{
+    return dnf_repo_update_internal(repo, flags, FALSE, state, error);
+} CATCH_TO_GERROR(FALSE)
+
+/**
+ * dnf_repo_update_prepare:
+ * @repo: a #DnfRepo instance.
+ * @error: a #%GError or %NULL.
+ *
+ * Sets the values from the keyfile and the countme flag on the handle
+ * before dnf_repo_update_locked() downloads the metadata. Must be called
+ * on the thread that owns the repo loader and the context.
+ *
+ * Returns: %TRUE for success, %FALSE otherwise
+ **/
+gboolean
+dnf_repo_update_prepare(DnfRepo *repo, GError **error) try
+{
+    DnfRepoPrivate *priv = GET_PRIVATE(repo);
+
+    /* media and local repos are never downloaded */
+    if (priv->kind != DNF_REPO_KIND_REMOTE)
+        return TRUE;
+    if (!dnf_repo_set_keyfile_data(repo, TRUE, error))
+        return FALSE;
+    libdnf::repoGetImpl(priv->repo)->addCountmeFlag(priv->repo_handle);
+    return TRUE;
+} CATCH_TO_GERROR(FALSE)
+
+/**
+ * dnf_repo_update_finish:
+ * @repo: a #DnfRepo instance.
+ *
+ * Invalidates the context after dnf_repo_update_locked() succeeded, on the
+ * thread that owns the context.
+ **/
+void
+dnf_repo_update_finish(DnfRepo *repo)
+{
+    DnfRepoPrivate *priv = GET_PRIVATE(repo);
+    dnf_context_invalidate_full(priv->context, "updated repo cache",
+                                DNF_CONTEXT_INVALIDATE_FLAG_ENROLLMENT);
+}
+
+/**
+ * dnf_repo_update_locked:
+ * @repo: a #DnfRepo instance.
+ * @flags: #DnfRepoUpdateFlags, e.g. %DNF_REPO_UPDATE_FLAG_FORCE
+ * @state: a #DnfState instance.
+ * @error: a #%GError or %NULL.
+ *
+ * Updates the repo like dnf_repo_update() for a caller that already holds
+ * the metadata lock, e.g. to update several repos from worker threads. The
+ * caller calls dnf_repo_update_prepare() before and, on success,
+ * dnf_repo_update_finish() after on its own thread.
+ *
+ * Returns: %TRUE for success, %FALSE otherwise
+ **/
+gboolean
+dnf_repo_update_locked(DnfRepo *repo,
+                       DnfRepoUpdateFlags flags,
+                       DnfState *state,
+                       GError **error) try
+{
+    return dnf_repo_update_internal(repo, flags, TRUE, state, error);
 } CATCH_TO_GERROR(FALSE)
 
 /**
@@ -1996,6 +2216,12 @@ dnf_repo_set_data(DnfRepo *repo,
 {
     DnfRepoPrivate *priv = GET_PRIVATE(repo);
     g_key_file_set_string(priv->keyfile, priv->repo->getId().c_str(), parameter, value);
+    /* the keyfile is shared with the loader, do not let it hand out the change again */
+    if (priv->context != NULL && priv->filename != NULL) {
+        auto loader = dnf_context_get_repo_loader(priv->context);
+        if (loader != NULL)
+            dnf_repo_loader_forget_keyfile(loader, priv->filename);
+    }
     return TRUE;
 } CATCH_TO_GERROR(FALSE)
 
@@ -2053,6 +2279,9 @@ typedef struct
     gchar *last_mirror_failure_message;
     guint64 downloaded;
     guint64 download_size;
+    DnfRepoPackageDownloadedFunc downloaded_cb;
+    gpointer downloaded_data;
+    GError *downloaded_error;
 } GlobalDownloadData;
 
 typedef struct
@@ -2109,10 +2338,22 @@ package_download_end_cb(void *user_data,
                         const char *msg)
 {
     auto data = static_cast<PackageDownloadData *>(user_data);
+    auto global_data = data->global_download_data;
+    int ret = LR_CB_OK;
+
+    /* hand the finished file over while the rest is still downloading */
+    if (global_data->downloaded_cb != NULL &&
+        global_data->downloaded_error == NULL &&
+        (status == LR_TRANSFER_SUCCESSFUL || status == LR_TRANSFER_ALREADYEXISTS)) {
+        if (!global_data->downloaded_cb(data->pkg,
+                                        global_data->downloaded_data,
+                                        &global_data->downloaded_error))
+            ret = LR_CB_ERROR;
+    }
 
     g_slice_free(PackageDownloadData, data);
 
-    return LR_CB_OK;
+    return ret;
 }
 
 static int
@@ -2202,6 +2443,35 @@ dnf_repo_download_packages(DnfRepo *repo,
                            DnfState *state,
                            GError **error) try
 {
+    return dnf_repo_download_packages_full(repo, packages, directory, NULL, NULL, state, error);
+} CATCH_TO_GERROR(FALSE)
+
+/**
+ * dnf_repo_download_packages_full:
+ * @repo: a #DnfRepo instance.
+ * @packages: (element-type DnfPackage): an array of packages, must be from this repo
+ * @directory: the destination directory.
+ * @downloaded_cb: (nullable): called for each package once its file is complete
+ * @user_data: data for @downloaded_cb
+ * @state: a #DnfState.
+ * @error: a #GError or %NULL.
+ *
+ * Like dnf_repo_download_packages(), but lets the caller start working on
+ * each package as soon as it is downloaded. An error from @downloaded_cb
+ * stops the download and is returned.
+ *
+ * Returns: %TRUE for success, %FALSE otherwise
+ **/
+gboolean
+dnf_repo_download_packages_full(DnfRepo *repo,
+                                GPtrArray *packages,
+                                const gchar *directory,
+                                DnfRepoPackageDownloadedFunc downloaded_cb,
+                                gpointer user_data,
+                                DnfState *state,
+                                GError **error) try
+{
+    libdnf::ScopedTimer timer("repo.download_packages");
     DnfRepoPrivate *priv = GET_PRIVATE(repo);
     gboolean ret = FALSE;
     guint i;
@@ -2235,6 +2505,10 @@ dnf_repo_download_packages(DnfRepo *repo,
     }
 
     global_data.download_size = dnf_package_array_get_download_size(packages);
+    libdnf::Instrumentation::count("download.packages", packages->len);
+    libdnf::Instrumentation::observe("download.bytes", global_data.download_size);
+    global_data.downloaded_cb = downloaded_cb;
+    global_data.downloaded_data = user_data;
     for (i = 0; i < packages->len; i++) {
         auto pkg = static_cast<DnfPackage *>(packages->pdata[i]);
         PackageDownloadData *data;
@@ -2280,6 +2554,13 @@ dnf_repo_download_packages(DnfRepo *repo,
     }
 
     ret = lr_download_packages(package_targets, LR_PACKAGEDOWNLOAD_FAILFAST, &error_local);
+    if (global_data.downloaded_error != NULL) {
+        /* the callback failure is the real reason librepo stopped */
+        g_propagate_error(error, global_data.downloaded_error);
+        global_data.downloaded_error = NULL;
+        ret = FALSE;
+        goto out;
+    }
     if (!ret) {
         if (g_error_matches(error_local,
                             LR_PACKAGE_DOWNLOADER_ERROR,
@@ -2305,6 +2586,7 @@ out:
             g_debug("Failed to set LRO_PROGRESSDATA to 0xdeadbeef");
     g_free(global_data.last_mirror_failure_message);
     g_free(global_data.last_mirror_url);
+    g_clear_error(&global_data.downloaded_error);
     g_slist_free_full(package_targets, (GDestroyNotify)lr_packagetarget_free);
     return ret;
 } CATCH_TO_GERROR(FALSE)
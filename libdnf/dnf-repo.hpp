@@ -33,5 +33,31 @@ inline DnfRepoEnabled & operator|=(DnfRepoEnabled & a, DnfRepoEnabled b)
     return a = a | b;
 }
 
+/**
+ * DnfRepoPackageDownloadedFunc:
+ * @pkg: the package whose file has just been downloaded
+ * @user_data: user data passed to dnf_repo_download_packages_full()
+ * @error: a #GError or %NULL
+ *
+ * Called as soon as each package file is complete, while the other
+ * downloads are still running. Returning %FALSE aborts the download.
+ */
+typedef gboolean (*DnfRepoPackageDownloadedFunc)(DnfPackage *pkg, gpointer user_data, GError **error);
+
+gboolean dnf_repo_download_packages_full(DnfRepo *repo,
+                                         GPtrArray *packages,
+                                         const gchar *directory,
+                                         DnfRepoPackageDownloadedFunc downloaded_cb,
+                                         gpointer user_data,
+                                         DnfState *state,
+                                         GError **error);
+
+gboolean dnf_repo_update_prepare(DnfRepo *repo,
+                                 GError **error);
+gboolean dnf_repo_update_locked(DnfRepo *repo,
+                                DnfRepoUpdateFlags flags,
+                                DnfState *state,
+                                GError **error);
+void dnf_repo_update_finish(DnfRepo *repo);
 
 #endif /* __DNF_REPO_HPP */
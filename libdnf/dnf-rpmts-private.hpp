@@ -23,6 +23,18 @@
 
 #include "dnf-rpmts.h"
 
+#include <rpm/header.h>
+
+Header           dnf_rpmts_read_package_header  (rpmts           ts,
+                                                 const gchar    *filename,
+                                                 gboolean        allow_untrusted,
+                                                 GError         **error);
+gboolean         dnf_rpmts_add_install_header   (rpmts           ts,
+                                                 Header          hdr,
+                                                 const gchar    *filename,
+                                                 gboolean        is_update,
+                                                 DnfPackage     *pkg,
+                                                 GError         **error);
 
 gboolean         dnf_rpmts_add_install_filename2(rpmts           ts,
                                                  const gchar    *filename,
@@ -30,5 +42,12 @@ gboolean         dnf_rpmts_add_install_filename2(rpmts           ts,
                                                  gboolean        is_update,
                                                  DnfPackage     *pkg,
                                                  GError         **error);
+GHashTable      *dnf_rpmts_find_packages        (rpmts           ts,
+                                                 GPtrArray      *pkgs,
+                                                 GError         **error);
+gboolean         dnf_rpmts_add_remove_pkg2      (rpmts           ts,
+                                                 DnfPackage     *pkg,
+                                                 GHashTable     *headers,
+                                                 GError         **error);
 
 #endif /* __DNF_RPMTS_PRIVATE_HPP */
@@ -31,6 +31,9 @@
  */
 
 
+#include <algorithm>
+#include <vector>
+
 #include <glib.h>
 #include <rpm/rpmlib.h>
 #include <rpm/rpmlog.h>
@@ -88,17 +91,27 @@ test_fail_safe(Header * hdr, DnfPackage * pkg, GError **error)
     return ret;
 }
 
-gboolean
-dnf_rpmts_add_install_filename2(rpmts ts,
-                                const gchar *filename,
-                                gboolean allow_untrusted,
-                                gboolean is_update,
-                                DnfPackage * pkg,
-                                GError **error) try
+/**
+ * dnf_rpmts_read_package_header:
+ * @ts: a #rpmts instance.
+ * @filename: the package.
+ * @allow_untrusted: is we can add untrusted packages.
+ * @error: a #GError or %NULL..
+ *
+ * Reads and verifies the header of a package file so it can be added to
+ * the transaction later with dnf_rpmts_add_install_header().
+ *
+ * Returns: the #Header, or %NULL on error
+ **/
+Header
+dnf_rpmts_read_package_header(rpmts ts,
+                              const gchar *filename,
+                              gboolean allow_untrusted,
+                              GError **error) try
 {
     gboolean ret = TRUE;
     gint res;
-    Header hdr;
+    Header hdr = NULL;
     FD_t fd;
 
     /* open this */
@@ -176,26 +189,56 @@ dnf_rpmts_add_install_filename2(rpmts ts,
             goto out;
         }
     }
+out:
+    Fclose(fd);
+    if (!ret && hdr != NULL)
+        hdr = headerFree(hdr);
+    return hdr;
+} CATCH_TO_GERROR(NULL)
+
+gboolean
+dnf_rpmts_add_install_header(rpmts ts,
+                             Header hdr,
+                             const gchar *filename,
+                             gboolean is_update,
+                             DnfPackage * pkg,
+                             GError **error) try
+{
+    gint res;
+
     if (pkg) {
-        if (!test_fail_safe(&hdr, pkg, error)) {
-            ret = FALSE;
-            goto out;
-        }
+        if (!test_fail_safe(&hdr, pkg, error))
+            return FALSE;
     }
 
     /* add to the transaction */
     res = rpmtsAddInstallElement(ts, hdr, (fnpyKey) filename, is_update, NULL);
     if (res != 0) {
-        ret = FALSE;
         g_set_error(error,
                     DNF_ERROR,
                     DNF_ERROR_INTERNAL_ERROR,
                     _("failed to add install element: %1$s [%2$i]"),
                     filename, res);
-        goto out;
+        return FALSE;
     }
-out:
-    Fclose(fd);
+    return TRUE;
+} CATCH_TO_GERROR(FALSE)
+
+gboolean
+dnf_rpmts_add_install_filename2(rpmts ts,
+                                const gchar *filename,
+                                gboolean allow_untrusted,
+                                gboolean is_update,
+                                DnfPackage * pkg,
+                                GError **error) try
+{
+    gboolean ret;
+    Header hdr;
+
+    hdr = dnf_rpmts_read_package_header(ts, filename, allow_untrusted, error);
+    if (hdr == NULL)
+        return FALSE;
+    ret = dnf_rpmts_add_install_header(ts, hdr, filename, is_update, pkg, error);
     headerFree(hdr);
     return ret;
 } CATCH_TO_GERROR(FALSE)
@@ -367,43 +410,117 @@ out:
 }
 
 /**
- * dnf_rpmts_add_remove_pkg:
+ * dnf_rpmts_find_packages:
  * @ts: a #rpmts instance.
- * @pkg: a #DnfPackage *instance.
+ * @pkgs: (element-type DnfPackage): installed packages to look up.
  * @error: a #GError or %NULL..
  *
- * Adds to the transaction a package to be removed.
- *
- * Returns: %TRUE for success, %FALSE otherwise
+ * Looks up the rpmdb headers of all @pkgs using a single iterator over
+ * their rpmdbids, visited in offset order. This avoids opening a new
+ * rpmdb iterator per package for large erase and upgrade transactions.
  *
- * Since: 0.1.0
+ * Returns: (transfer full): a #GHashTable mapping rpmdbid to #Header, or
+ * %NULL on error
  **/
-gboolean
-dnf_rpmts_add_remove_pkg(rpmts ts, DnfPackage *pkg, GError **error) try
+GHashTable *
+dnf_rpmts_find_packages(rpmts ts, GPtrArray *pkgs, GError **error) try
 {
-    gboolean ret = TRUE;
-    gint retval;
+    g_autoptr(GHashTable) headers = NULL;
     Header hdr;
+    rpmdbMatchIterator iter;
+    std::vector<unsigned int> offsets;
+    g_autoptr(GString) rpm_error = NULL;
 
-    hdr = dnf_rpmts_find_package(ts, pkg, error);
-    if (hdr == NULL) {
-        ret = FALSE;
-        goto out;
+    headers = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
+                                    (GDestroyNotify) headerFree);
+    offsets.reserve(pkgs->len);
+    for (guint i = 0; i < pkgs->len; i++) {
+        auto pkg = static_cast< DnfPackage * >(g_ptr_array_index(pkgs, i));
+        guint64 rpmdbid = dnf_package_get_rpmdbid(pkg);
+        if (rpmdbid != 0)
+            offsets.push_back(static_cast<unsigned int>(rpmdbid));
+    }
+    if (offsets.empty())
+        return static_cast<GHashTable *>(g_steal_pointer(&headers));
+
+    /* visit the records in database order */
+    std::sort(offsets.begin(), offsets.end());
+    offsets.erase(std::unique(offsets.begin(), offsets.end()), offsets.end());
+
+    rpmlogSetCallback(dnf_rpmts_log_handler_cb, &rpm_error);
+    iter = rpmtsInitIterator(ts, RPMDBI_PACKAGES, NULL, 0);
+    if (iter == NULL) {
+        rpmlogSetCallback(NULL, NULL);
+        g_set_error_literal(error,
+                            DNF_ERROR,
+                            DNF_ERROR_UNFINISHED_TRANSACTION,
+                            rpm_error != NULL ? rpm_error->str
+                                              : _("Fatal error, run database recovery"));
+        return NULL;
     }
+    rpmdbAppendIterator(iter, offsets.data(), offsets.size());
+    while ((hdr = rpmdbNextIterator(iter)) != NULL) {
+        unsigned int offset = rpmdbGetIteratorOffset(iter);
+        g_hash_table_insert(headers, GUINT_TO_POINTER(offset), headerLink(hdr));
+    }
+    rpmdbFreeIterator(iter);
+    rpmlogSetCallback(NULL, NULL);
+    return static_cast<GHashTable *>(g_steal_pointer(&headers));
+} CATCH_TO_GERROR(NULL)
+
+static gboolean
+dnf_rpmts_add_erase_header(rpmts ts, DnfPackage *pkg, Header hdr, GError **error)
+{
+    gint retval;
 
     /* remove it */
     retval = rpmtsAddEraseElement(ts, hdr, -1);
     if (retval != 0) {
-        ret = FALSE;
         g_set_error(error,
                     DNF_ERROR,
                     DNF_ERROR_INTERNAL_ERROR,
                     _("could not add erase element %1$s(%2$i)"),
                     dnf_package_get_name(pkg), retval);
-        goto out;
+        return FALSE;
     }
-out:
-    if (hdr != NULL)
-        headerFree(hdr);
+    return TRUE;
+}
+
+gboolean
+dnf_rpmts_add_remove_pkg2(rpmts ts, DnfPackage *pkg, GHashTable *headers, GError **error) try
+{
+    gpointer hdr = NULL;
+    guint64 rpmdbid = dnf_package_get_rpmdbid(pkg);
+
+    /* fall back to a single lookup for anything missing from the batch */
+    if (headers == NULL || rpmdbid == 0 ||
+        !g_hash_table_lookup_extended(headers, GUINT_TO_POINTER(rpmdbid), NULL, &hdr))
+        return dnf_rpmts_add_remove_pkg(ts, pkg, error);
+    return dnf_rpmts_add_erase_header(ts, pkg, static_cast<Header>(hdr), error);
+} CATCH_TO_GERROR(FALSE)
+
+/**
+ * dnf_rpmts_add_remove_pkg:
+ * @ts: a #rpmts instance.
+ * @pkg: a #DnfPackage *instance.
+ * @error: a #GError or %NULL..
+ *
+ * Adds to the transaction a package to be removed.
+ *
+ * Returns: %TRUE for success, %FALSE otherwise
+ *
+ * Since: 0.1.0
+ **/
+gboolean
+dnf_rpmts_add_remove_pkg(rpmts ts, DnfPackage *pkg, GError **error) try
+{
+    gboolean ret;
+    Header hdr;
+
+    hdr = dnf_rpmts_find_package(ts, pkg, error);
+    if (hdr == NULL)
+        return FALSE;
+    ret = dnf_rpmts_add_erase_header(ts, pkg, hdr, error);
+    headerFree(hdr);
     return ret;
 } CATCH_TO_GERROR(FALSE)
@@ -27,6 +27,10 @@
 
 #include "dnf-sack.h"
 #include "hy-query.h"
+#include "sack/attributecache.hpp"
+#include "sack/fileindex.hpp"
+#include "sack/namearchindex.hpp"
+#include "sack/obsoletesindex.hpp"
 #include "sack/packageset.hpp"
 #include "sack/query.hpp"
 #include "module/ModulePackage.hpp"
@@ -62,6 +66,10 @@ libdnf::PackageSet *dnf_sack_get_pkg_solvables(DnfSack *sack);
 libdnf::ModulePackageContainer * dnf_sack_set_module_container(
     DnfSack *sack, libdnf::ModulePackageContainer * newConteiner);
 libdnf::ModulePackageContainer * dnf_sack_get_module_container(DnfSack *sack);
+libdnf::FileIndex * dnf_sack_get_file_index(DnfSack *sack);
+libdnf::AttributeCache * dnf_sack_get_attribute_cache(DnfSack *sack);
+libdnf::NameArchIndex * dnf_sack_get_name_arch_index(DnfSack *sack);
+libdnf::ObsoletesIndex * dnf_sack_get_obsoletes_index(DnfSack *sack);
 void         dnf_sack_make_provides_ready   (DnfSack    *sack);
 Id           dnf_sack_running_kernel        (DnfSack    *sack);
 void         dnf_sack_recompute_considered_map  (DnfSack * sack, Map ** considered, libdnf::Query::ExcludeFlags flags);
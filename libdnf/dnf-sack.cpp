@@ -34,12 +34,16 @@
 
 #include <algorithm>
 #include <assert.h>
+#include <atomic>
+#include <condition_variable>
 #include <errno.h>
 #include <functional>
 #include <unistd.h>
 #include <iostream>
 #include <list>
+#include <mutex>
 #include <set>
+#include <thread>
 
 extern "C" {
 #include <solv/evr.h>
@@ -64,6 +68,7 @@ extern "C" {
 #include "dnf-context.hpp"
 #include "dnf-types.h"
 #include "dnf-package.h"
+#include "dnf-repo.hpp"
 #include "hy-iutil-private.hpp"
 #include "hy-query.h"
 #include "hy-repo-private.hpp"
@@ -82,6 +87,7 @@ extern "C" {
 #include "repo/solvable/DependencyContainer.hpp"
 #include "utils/crypto/sha1.hpp"
 #include "utils/File.hpp"
+#include "utils/Instrumentation.hpp"
 #include "utils/utils.hpp"
 #include "log.hpp"
 #include "tinyformat/tinyformat.hpp"
@@ -113,11 +119,34 @@ typedef struct
     dnf_sack_running_kernel_fn_t  running_kernel_fn;
     guint                installonly_limit;
     libdnf::ModulePackageContainer * moduleContainer;
+    libdnf::FileIndex   *file_index;
+    libdnf::AttributeCache *attribute_cache;
+    libdnf::NameArchIndex *name_arch_index;
+    libdnf::ObsoletesIndex *obsoletes_index;
 } DnfSackPrivate;
 
 G_DEFINE_TYPE_WITH_PRIVATE(DnfSack, dnf_sack, G_TYPE_OBJECT)
 #define GET_PRIVATE(o) (static_cast<DnfSackPrivate *>(dnf_sack_get_instance_private (o)))
 
+/**
+ * dnf_sack_pool_changed:
+ *
+ * Called whenever solvables or repodata were added to or removed from the
+ * pool. The provides have to be recomputed and the indexes built from the
+ * whole pool are dropped, they are rebuilt on their next use.
+ **/
+static void
+dnf_sack_pool_changed(DnfSackPrivate *priv)
+{
+    priv->provides_ready = FALSE;
+    delete priv->file_index;
+    priv->file_index = nullptr;
+    delete priv->attribute_cache;
+    priv->attribute_cache = nullptr;
+    delete priv->name_arch_index;
+    priv->name_arch_index = nullptr;
+}
+
 
 /**
  * dnf_sack_finalize:
@@ -152,6 +181,10 @@ dnf_sack_finalize(GObject *object)
     if (priv->moduleContainer) {
         delete priv->moduleContainer;
     }
+    delete priv->file_index;
+    delete priv->attribute_cache;
+    delete priv->name_arch_index;
+    delete priv->obsoletes_index;
 
     G_OBJECT_CLASS(dnf_sack_parent_class)->finalize(object);
 }
@@ -361,6 +394,72 @@ dnf_sack_recompute_considered(DnfSack *sack)
     priv->considered_uptodate = TRUE;
 }
 
+/* An ext cache only depends on the primary, which gives the solvables it extends, and on its
+ * own metadata file. Keying it on the repomd.xml checksums of these two files rather than on
+ * the whole repomd.xml keeps it valid when only other metadata of the repo changed. The
+ * extension is stored by solvable position, it cannot be reused for a changed primary. The
+ * updateinfo adds solvables of its own and is keyed on its own checksum only. Falls back to
+ * the repomd.xml checksum when repomd.xml does not list them. */
+static void
+ext_cache_checksum(HyRepo hrepo, _hy_repo_repodata which_repodata, unsigned char out[CHKSUM_BYTES])
+{
+    auto repoImpl = libdnf::repoGetImpl(hrepo);
+    const char *md_type = NULL;
+    switch (which_repodata) {
+    case _HY_REPODATA_FILENAMES:
+        md_type = MD_TYPE_FILELISTS;
+        break;
+    case _HY_REPODATA_OTHER:
+        md_type = MD_TYPE_OTHER;
+        break;
+    case _HY_REPODATA_PRESTO:
+        md_type = MD_TYPE_PRESTODELTA;
+        break;
+    case _HY_REPODATA_UPDATEINFO:
+        md_type = MD_TYPE_UPDATEINFO;
+        break;
+    default:
+        break;
+    }
+    auto & checksums = repoImpl->metadataChecksums;
+    auto primary = checksums.find(MD_TYPE_PRIMARY);
+    auto ext = md_type ? checksums.find(md_type) : checksums.end();
+    if (ext != checksums.end() && which_repodata == _HY_REPODATA_UPDATEINFO) {
+        const char *strv[] = {"ext", md_type, ext->second.c_str(), NULL};
+        checksum_strv(out, strv);
+        return;
+    }
+    if (primary == checksums.end() || ext == checksums.end()) {
+        memcpy(out, repoImpl->checksum, CHKSUM_BYTES);
+        return;
+    }
+    const char *strv[] = {"ext", md_type, primary->second.c_str(), ext->second.c_str(), NULL};
+    checksum_strv(out, strv);
+}
+
+/* Opens metadata of the given type. The zchunk variant is preferred when zchunk is enabled,
+ * libsolv built without zchunk support cannot read it, the plain variant is used then if the
+ * repo has one. fn is set to the path of the opened file or of the last one tried. */
+static FILE *
+open_repo_metadata(HyRepo hrepo, const char *type, std::string & fn)
+{
+    fn = hrepo->getMetadataPath(type);
+    if (fn.empty())
+        return NULL;
+    FILE *fp = solv_xfopen_pipelined(fn.c_str());
+    if (fp || !g_str_has_suffix(fn.c_str(), ".zck"))
+        return fp;
+
+    auto & paths = libdnf::repoGetImpl(hrepo)->metadataPaths;
+    auto it = paths.find(type);
+    if (it == paths.end() || it->second == fn)
+        return NULL;
+    g_debug("%s: cannot read zchunk metadata %s, using %s",
+            __func__, fn.c_str(), it->second.c_str());
+    fn = it->second;
+    return solv_xfopen_pipelined(fn.c_str());
+}
+
 static gboolean
 load_ext(DnfSack *sack, HyRepo hrepo, _hy_repo_repodata which_repodata,
          const char *suffix, const char * which_filename,
@@ -374,10 +473,11 @@ load_ext(DnfSack *sack, HyRepo hrepo, _hy_repo_repodata which_repodata,
     FILE *fp;
     gboolean done = FALSE;
 
+    unsigned char cs_ext[CHKSUM_BYTES];
+    ext_cache_checksum(hrepo, which_repodata, cs_ext);
     char *fn_cache =  dnf_sack_give_cache_fn(sack, name, suffix);
-    fp = fopen(fn_cache, "r");
-    assert(libdnf::repoGetImpl(hrepo)->checksum);
-    if (can_use_repomd_cache(fp, libdnf::repoGetImpl(hrepo)->checksum)) {
+    fp = solv_cache_fopen(fn_cache);
+    if (can_use_repomd_cache(fp, cs_ext)) {
         int flags = 0;
         /* the updateinfo is not a real extension */
         if (which_repodata != _HY_REPODATA_UPDATEINFO)
@@ -388,6 +488,7 @@ load_ext(DnfSack *sack, HyRepo hrepo, _hy_repo_repodata which_repodata,
         done = TRUE;
         g_debug("%s: using cache file: %s", __func__, fn_cache);
         ret = repo_add_solv(repo, fp, flags);
+        solv_cache_loaded(fp);
         if (ret) {
             g_set_error_literal (error,
                                  DNF_ERROR,
@@ -405,7 +506,8 @@ load_ext(DnfSack *sack, HyRepo hrepo, _hy_repo_repodata which_repodata,
     if (done)
         return TRUE;
 
-    auto fn = hrepo->getMetadataPath(which_filename);
+    std::string fn;
+    fp = open_repo_metadata(hrepo, which_filename, fn);
     /* nothing set */
     if (fn.empty()) {
         g_set_error (error,
@@ -416,7 +518,6 @@ load_ext(DnfSack *sack, HyRepo hrepo, _hy_repo_repodata which_repodata,
         return FALSE;
     }
 
-    fp = solv_xfopen(fn.c_str(), "r");
     if (fp == NULL) {
         g_set_error (error,
                      DNF_ERROR,
@@ -428,13 +529,23 @@ load_ext(DnfSack *sack, HyRepo hrepo, _hy_repo_repodata which_repodata,
 
     int previous_last = repo->nrepodata - 1;
     ret = cb(repo, fp);
-    fclose(fp);
+    if (fclose(fp) != 0) {
+        /* the metadata were truncated by a decompression error, drop what was read */
+        if (ret == 0 && repo->nrepodata - 1 > previous_last)
+            repodata_free(repo_id2repodata(repo, repo->nrepodata - 1));
+        dnf_sack_pool_changed(priv);
+        g_set_error (error,
+                     DNF_ERROR,
+                     DNF_ERROR_FILE_INVALID,
+                     _("failed to read: %s"), fn.c_str());
+        return FALSE;
+    }
     if (ret == 0) {
         repo_update_state(hrepo, which_repodata, _HY_LOADED_FETCH);
         assert(previous_last == repo->nrepodata - 2); (void)previous_last;
         repo_set_repodata(hrepo, which_repodata, repo->nrepodata - 1);
     }
-    priv->provides_ready = 0;
+    dnf_sack_pool_changed(priv);
     return TRUE;
 }
 
@@ -528,10 +639,12 @@ write_main(DnfSack *sack, HyRepo hrepo, int switchtosolv, GError **error)
     }
     if (switchtosolv && repo_is_one_piece(repo)) {
         /* switch over to written solv file activate paging */
-        FILE *fp = fopen(tmp_fn_templ, "r");
+        FILE *fp = solv_cache_fopen(tmp_fn_templ);
         if (fp) {
             repo_empty(repo, 1);
+            dnf_sack_pool_changed(GET_PRIVATE(sack));
             rc = repo_add_solv(repo, fp, 0);
+            solv_cache_loaded(fp);
             fclose(fp);
             if (rc) {
                 /* this is pretty fatal */
@@ -591,6 +704,8 @@ write_ext(DnfSack *sack, HyRepo hrepo, _hy_repo_repodata which_repodata,
     Repo *repo = repoImpl->libsolvRepo;
     int ret = 0;
     const char *name = repo->name;
+    unsigned char cs_ext[CHKSUM_BYTES];
+    ext_cache_checksum(hrepo, which_repodata, cs_ext);
 
     Id repodata = repo_get_repodata(hrepo, which_repodata);
     assert(repodata);
@@ -615,7 +730,7 @@ write_ext(DnfSack *sack, HyRepo hrepo, _hy_repo_repodata which_repodata,
             ret |= repodata_write(data, fp);
         else
             ret |= write_ext_updateinfo(hrepo, data, fp);
-        ret |= checksum_write(repoImpl->checksum, fp);
+        ret |= checksum_write(cs_ext, fp);
         ret |= fclose(fp);
         if (ret) {
             success = FALSE;
@@ -630,7 +745,7 @@ write_ext(DnfSack *sack, HyRepo hrepo, _hy_repo_repodata which_repodata,
 
     if (repo_is_one_piece(repo) && which_repodata != _HY_REPODATA_UPDATEINFO) {
         /* switch over to written solv file activate paging */
-        FILE *fp = fopen(tmp_fn_templ, "r");
+        FILE *fp = solv_cache_fopen(tmp_fn_templ);
         if (fp) {
             int flags = REPO_USE_LOADING | REPO_EXTEND_SOLVABLES;
             /* do not pollute the main pool with directory component ids */
@@ -639,6 +754,7 @@ write_ext(DnfSack *sack, HyRepo hrepo, _hy_repo_repodata which_repodata,
             repodata_extend_block(data, repo->start, repo->end - repo->start);
             data->state = REPODATA_LOADING;
             repo_add_solv(repo, fp, flags);
+            solv_cache_loaded(fp);
             data->state = REPODATA_AVAILABLE;
             fclose(fp);
         }
@@ -672,7 +788,7 @@ load_yum_repo(DnfSack *sack, HyRepo hrepo, GError **error)
 
     FILE *fp_primary = NULL;
     FILE *fp_repomd = NULL;
-    FILE *fp_cache = fopen(fn_cache, "r");
+    FILE *fp_cache = solv_cache_fopen(fn_cache);
     if (!fn_repomd) {
         g_set_error (error,
                      DNF_ERROR,
@@ -696,7 +812,9 @@ load_yum_repo(DnfSack *sack, HyRepo hrepo, GError **error)
     if (can_use_repomd_cache(fp_cache, repoImpl->checksum)) {
         const char *chksum = pool_checksum_str(pool, repoImpl->checksum);
         g_debug("using cached %s (0x%s)", name, chksum);
-        if (repo_add_solv(repo, fp_cache, 0)) {
+        int rc = repo_add_solv(repo, fp_cache, 0);
+        solv_cache_loaded(fp_cache);
+        if (rc) {
             g_set_error (error,
                          DNF_ERROR,
                          DNF_ERROR_INTERNAL_ERROR,
@@ -706,10 +824,10 @@ load_yum_repo(DnfSack *sack, HyRepo hrepo, GError **error)
         }
         repoImpl->state_main = _HY_LOADED_CACHE;
     } else {
-        auto primary = hrepo->getMetadataPath(MD_TYPE_PRIMARY);
+        std::string primary;
+        fp_primary = open_repo_metadata(hrepo, MD_TYPE_PRIMARY, primary);
         if (primary.empty()) {
-            // It could happen when repomd file has no "primary" data or they are in unsupported
-            // format like zchunk
+            // It could happen when repomd file has no "primary" data
             g_set_error (error,
                          DNF_ERROR,
                          DNF_ERROR_INTERNAL_ERROR,
@@ -717,8 +835,15 @@ load_yum_repo(DnfSack *sack, HyRepo hrepo, GError **error)
             retval = FALSE;
             goto out;
         }
-        fp_primary = solv_xfopen(primary.c_str(), "r");
-        assert(fp_primary);
+        if (fp_primary == NULL) {
+            // e.g. only zchunk metadata and libsolv built without zchunk support
+            g_set_error (error,
+                         DNF_ERROR,
+                         DNF_ERROR_FILE_INVALID,
+                         _("failed to open: %s"), primary.c_str());
+            retval = FALSE;
+            goto out;
+        }
 
         g_debug("fetching %s", name);
         if (repo_add_repomdxml(repo, fp_repomd, 0) || \
@@ -730,6 +855,17 @@ load_yum_repo(DnfSack *sack, HyRepo hrepo, GError **error)
             retval = FALSE;
             goto out;
         }
+        /* a decompression error shows only when closing the file */
+        int read_error = fclose(fp_primary);
+        fp_primary = NULL;
+        if (read_error) {
+            g_set_error (error,
+                         DNF_ERROR,
+                         DNF_ERROR_FILE_INVALID,
+                         _("failed to read: %s"), primary.c_str());
+            retval = FALSE;
+            goto out;
+        }
         repoImpl->state_main = _HY_LOADED_FETCH;
     }
 out:
@@ -743,9 +879,11 @@ out:
 
     if (retval) {
         libdnf::repoGetImpl(hrepo)->attachLibsolvRepo(repo);
-        priv->provides_ready = 0;
-    } else
+        dnf_sack_pool_changed(priv);
+    } else {
         repo_free(repo, 1);
+        dnf_sack_pool_changed(priv);
+    }
     return retval;
 }
 
@@ -1184,7 +1322,7 @@ dnf_sack_add_cmdline_package_flags(DnfSack *sack, const char *fn, const int flag
     DnfSackPrivate *priv = GET_PRIVATE(sack);
     Repo *repo = dnf_sack_setup_cmdline_repo(sack);
     Id p;
-    priv->provides_ready = 0;    /* triggers internalizing later */
+    dnf_sack_pool_changed(priv);    /* triggers internalizing later */
     p = repo_add_rpm(repo, fn, flags);
     if (p == 0) {
         g_warning ("failed to read RPM: %s, skipping",
@@ -1245,6 +1383,19 @@ dnf_sack_count(DnfSack *sack)
     return cnt;
 }
 
+/* Sets or clears the bits of the packages of pkgset. The set is only read,
+ * it may be the result shared by several queries. */
+static void
+map_update_from_pkgset(Map *map, const DnfPackageSet *pkgset, gboolean set)
+{
+    for (Id id = pkgset->next(-1); id != -1 && id < (map->size << 3); id = pkgset->next(id)) {
+        if (set)
+            MAPSET(map, id);
+        else
+            MAPCLR(map, id);
+    }
+}
+
 static void
 dnf_sack_add_excludes_or_includes(DnfSack *sack, Map **dest, const DnfPackageSet *pkgset)
 {
@@ -1256,8 +1407,7 @@ dnf_sack_add_excludes_or_includes(DnfSack *sack, Map **dest, const DnfPackageSet
         *dest = destmap;
     }
 
-    auto pkgmap = pkgset->getMap();
-    map_or(destmap, pkgmap);
+    map_update_from_pkgset(destmap, pkgset, TRUE);
     DnfSackPrivate *priv = GET_PRIVATE(sack);
     priv->considered_uptodate = FALSE;
 }
@@ -1315,8 +1465,7 @@ dnf_sack_remove_excludes_or_includes(DnfSack *sack, Map *from, const DnfPackageS
 {
     if (from == NULL)
         return;
-    auto pkgmap = pkgset->getMap();
-    map_subtract(from, pkgmap);
+    map_update_from_pkgset(from, pkgset, FALSE);
     DnfSackPrivate *priv = GET_PRIVATE(sack);
     priv->considered_uptodate = FALSE;
 }
@@ -1378,8 +1527,8 @@ dnf_sack_set_excludes_or_includes(DnfSack *sack, Map **dest, const DnfPackageSet
     *dest = free_map_fully(*dest);
     if (pkgset) {
         *dest = static_cast<Map *>(g_malloc0(sizeof(Map)));
-        auto pkgmap = pkgset->getMap();
-        map_init_clone(*dest, pkgmap);
+        map_init(*dest, dnf_sack_get_pool(sack)->nsolvables);
+        map_update_from_pkgset(*dest, pkgset, TRUE);
     }
     DnfSackPrivate *priv = GET_PRIVATE(sack);
     priv->considered_uptodate = FALSE;
@@ -1394,8 +1543,8 @@ dnf_sack_set_module_includes(DnfSack *sack, const DnfPackageSet *pset)
     DnfSackPrivate *priv = GET_PRIVATE(sack);
     free_map_fully(priv->module_includes);
     priv->module_includes = static_cast<Map *>(g_malloc0(sizeof(Map)));
-    auto pkgmap = pset->getMap();
-    map_init_clone(priv->module_includes, pkgmap);
+    map_init(priv->module_includes, priv->pool->nsolvables);
+    map_update_from_pkgset(priv->module_includes, pset, TRUE);
 }
 
 /**
@@ -1607,7 +1756,7 @@ void
 dnf_sack_set_provides_not_ready(DnfSack *sack)
 {
     DnfSackPrivate *priv = GET_PRIVATE(sack);
-    priv->provides_ready = FALSE;
+    dnf_sack_pool_changed(priv);
 }
 
 /**
@@ -1676,7 +1825,7 @@ dnf_sack_repo_enabled(DnfSack *sack, const char *reponame, int enabled)
         priv->repo_excludes = excl;
     }
     repo->disabled = !enabled;
-    priv->provides_ready = 0;
+    dnf_sack_pool_changed(priv);
 
     Id p;
     Solvable *s;
@@ -1706,6 +1855,7 @@ dnf_sack_repo_enabled(DnfSack *sack, const char *reponame, int enabled)
 gboolean
 dnf_sack_load_system_repo(DnfSack *sack, HyRepo a_hrepo, int flags, GError **error) try
 {
+    libdnf::ScopedTimer timer("sack.load_system_repo");
     DnfSackPrivate *priv = GET_PRIVATE(sack);
     Pool *pool = dnf_sack_get_pool(sack);
     gboolean ret = TRUE;
@@ -1731,6 +1881,7 @@ dnf_sack_load_system_repo(DnfSack *sack, HyRepo a_hrepo, int flags, GError **err
         repoImpl->state_main = _HY_LOADED_FETCH;
     } else {
         repo_free(repo, 1);
+        dnf_sack_pool_changed(priv);
         ret = FALSE;
         g_set_error (error,
                      DNF_ERROR,
@@ -1741,7 +1892,7 @@ dnf_sack_load_system_repo(DnfSack *sack, HyRepo a_hrepo, int flags, GError **err
 
     libdnf::repoGetImpl(hrepo)->attachLibsolvRepo(repo);
     pool_set_installed(pool, repo);
-    priv->provides_ready = 0;
+    dnf_sack_pool_changed(priv);
 
     repoImpl->main_nsolvables = repo->nsolvables;
     repoImpl->main_nrepodata = repo->nrepodata;
@@ -1770,6 +1921,7 @@ dnf_sack_load_system_repo(DnfSack *sack, HyRepo a_hrepo, int flags, GError **err
 gboolean
 dnf_sack_load_repo(DnfSack *sack, HyRepo repo, int flags, GError **error) try
 {
+    libdnf::ScopedTimer timer("sack.load_repo");
     DnfSackPrivate *priv = GET_PRIVATE(sack);
     auto repoImpl = libdnf::repoGetImpl(repo);
     GError *error_local = NULL;
@@ -1968,6 +2120,7 @@ dnf_sack_make_provides_ready(DnfSack *sack)
 
     if (priv->provides_ready)
         return;
+    libdnf::ScopedTimer timer("sack.make_provides_ready");
     repo_internalize_all_trigger(priv->pool);
     Queue addedfileprovides;
     Queue addedfileprovides_inst;
@@ -1980,6 +2133,8 @@ dnf_sack_make_provides_ready(DnfSack *sack)
     queue_free(&addedfileprovides);
     queue_free(&addedfileprovides_inst);
     pool_createwhatprovides(priv->pool);
+    delete priv->obsoletes_index;
+    priv->obsoletes_index = nullptr;
     priv->provides_ready = 1;
 }
 
@@ -2057,6 +2212,94 @@ dnf_sack_get_module_container(DnfSack *sack)
     return priv->moduleContainer;
 }
 
+/**
+ * dnf_sack_get_file_index: (skip)
+ * @sack: a #DnfSack instance.
+ *
+ * Gets the index of the file lists of all packages in the sack. The index is
+ * built on the first use and rebuilt when repositories were added since.
+ *
+ * Returns: The file index, owned by the sack
+ *
+ * Since: 0.64.0
+ */
+libdnf::FileIndex *
+dnf_sack_get_file_index(DnfSack *sack)
+{
+    DnfSackPrivate *priv = GET_PRIVATE(sack);
+    if (!priv->file_index) {
+        repo_internalize_all_trigger(priv->pool);
+        priv->file_index = new libdnf::FileIndex(priv->pool);
+    }
+    return priv->file_index;
+}
+
+/**
+ * dnf_sack_get_attribute_cache: (skip)
+ * @sack: a #DnfSack instance.
+ *
+ * Gets the cache of numeric attributes like sizes and times of all packages
+ * in the sack. The cache is dropped when repositories were added since.
+ *
+ * Returns: The attribute cache, owned by the sack
+ *
+ * Since: 0.64.0
+ */
+libdnf::AttributeCache *
+dnf_sack_get_attribute_cache(DnfSack *sack)
+{
+    DnfSackPrivate *priv = GET_PRIVATE(sack);
+    if (!priv->attribute_cache) {
+        priv->attribute_cache = new libdnf::AttributeCache(priv->pool);
+    }
+    return priv->attribute_cache;
+}
+
+/**
+ * dnf_sack_get_name_arch_index: (skip)
+ * @sack: a #DnfSack instance.
+ *
+ * Gets the order of all packages in the sack by name, arch and evr. The index
+ * is built on the first use and rebuilt when repositories were added since.
+ *
+ * Returns: The name and arch index, owned by the sack
+ *
+ * Since: 0.64.0
+ */
+libdnf::NameArchIndex *
+dnf_sack_get_name_arch_index(DnfSack *sack)
+{
+    DnfSackPrivate *priv = GET_PRIVATE(sack);
+    if (!priv->name_arch_index) {
+        priv->name_arch_index = new libdnf::NameArchIndex(priv->pool);
+    }
+    return priv->name_arch_index;
+}
+
+/**
+ * dnf_sack_get_obsoletes_index: (skip)
+ * @sack: a #DnfSack instance.
+ *
+ * Gets the index of packages obsoleting each package in the sack. The index
+ * is built on the first use after the provides of the sack were made ready.
+ *
+ * Returns: The obsoletes index, owned by the sack
+ *
+ * Since: 0.64.0
+ */
+libdnf::ObsoletesIndex *
+dnf_sack_get_obsoletes_index(DnfSack *sack)
+{
+    DnfSackPrivate *priv = GET_PRIVATE(sack);
+    dnf_sack_make_provides_ready(sack);
+    bool obsprovides = pool_get_flag(priv->pool, POOL_FLAG_OBSOLETEUSESPROVIDES);
+    if (!priv->obsoletes_index || priv->obsoletes_index->getObsoleteUsesProvides() != obsprovides) {
+        delete priv->obsoletes_index;
+        priv->obsoletes_index = new libdnf::ObsoletesIndex(priv->pool, obsprovides);
+    }
+    return priv->obsoletes_index;
+}
+
 /**********************************************************************/
 
 static void
@@ -2084,42 +2327,39 @@ process_excludes(DnfSack *sack, GPtrArray *enabled_repos)
         repoQuery.addFilter(HY_PKG_REPONAME, HY_EQ, repo->getId().c_str());
         repoQuery.apply();
 
-        for (const auto & name : repo->getConfig()->includepkgs().getValue()) {
-            libdnf::Query query(repoQuery);
-            auto ret = query.filterSubject(name.c_str(), nullptr, false, true, false, false);
-            if (ret.first) {
-                repoIncludes += *query.runSet();
+        auto & includes = repo->getConfig()->includepkgs().getValue();
+        for (auto & match : repoQuery.filterSubjects(includes, nullptr, false, true, false, false)) {
+            if (match.found) {
+                repoIncludes += *match.query.runSet();
                 includesExist = true;
                 repo->setUseIncludes(true);
             }
         }
 
-        for (const auto & name : repo->getConfig()->excludepkgs().getValue()) {
-            libdnf::Query query(repoQuery);
-            auto ret = query.filterSubject(name.c_str(), nullptr, false, true, false, false);
-            if (ret.first) {
-                repoExcludes += *query.runSet();
+        auto & excludes = repo->getConfig()->excludepkgs().getValue();
+        for (auto & match : repoQuery.filterSubjects(excludes, nullptr, false, true, false, false)) {
+            if (match.found) {
+                repoExcludes += *match.query.runSet();
             }
         }
     }
 
     if (std::find(disabled.begin(), disabled.end(), "main") == disabled.end()) {
         bool useGlobalIncludes = false;
-        for (const auto & name : mainConf.includepkgs().getValue()) {
-            libdnf::Query query(sack);
-            auto ret = query.filterSubject(name.c_str(), nullptr, false, true, false, false);
-            if (ret.first) {
-                repoIncludes += *query.runSet();
+        libdnf::Query query(sack);
+        auto & includes = mainConf.includepkgs().getValue();
+        for (auto & match : query.filterSubjects(includes, nullptr, false, true, false, false)) {
+            if (match.found) {
+                repoIncludes += *match.query.runSet();
                 includesExist = true;
                 useGlobalIncludes = true;
             }
         }
 
-        for (const auto & name : mainConf.excludepkgs().getValue()) {
-            libdnf::Query query(sack);
-            auto ret = query.filterSubject(name.c_str(), nullptr, false, true, false, false);
-            if (ret.first) {
-                repoExcludes += *query.runSet();
+        auto & excludes = mainConf.excludepkgs().getValue();
+        for (auto & match : query.filterSubjects(excludes, nullptr, false, true, false, false)) {
+            if (match.found) {
+                repoExcludes += *match.query.runSet();
             }
         }
         
@@ -2134,6 +2374,72 @@ process_excludes(DnfSack *sack, GPtrArray *enabled_repos)
     dnf_sack_add_excludes(sack, &repoExcludes);
 }
 
+/**
+ * dnf_sack_load_checked_repo:
+ * @error_update: (transfer full): why the repo could not be updated, or %NULL
+ *
+ * Loads a repo after dnf_repo_check() and, if that failed, dnf_repo_update()
+ * have finished, skipping repos that are not required and not available.
+ */
+static gboolean
+dnf_sack_load_checked_repo(DnfSack *sack,
+                           DnfRepo *repo,
+                           GError *error_update,
+                           DnfSackAddFlags flags,
+                           DnfState *state,
+                           GError **error)
+{
+    int flags_hy = DNF_SACK_LOAD_FLAG_BUILD_CACHE;
+
+    if (error_update != NULL) {
+        if (!dnf_repo_get_required(repo) &&
+            (g_error_matches(error_update,
+                             DNF_ERROR,
+                             DNF_ERROR_CANNOT_FETCH_SOURCE) ||
+             g_error_matches(error_update,
+                             DNF_ERROR,
+                             DNF_ERROR_REPO_NOT_AVAILABLE))) {
+            g_warning("Skipping refresh of %s: %s",
+                      dnf_repo_get_id(repo),
+                      error_update->message);
+            g_error_free(error_update);
+            return dnf_state_finished(state, error);
+        }
+        g_propagate_error(error, error_update);
+        return FALSE;
+    }
+
+    /* checking disabled the repo */
+    if (dnf_repo_get_enabled(repo) == DNF_REPO_ENABLED_NONE) {
+        g_debug("Skipping %s as repo no longer enabled",
+                dnf_repo_get_id(repo));
+        return dnf_state_finished(state, error);
+    }
+
+    /* done */
+    if (!dnf_state_done(state, error))
+        return FALSE;
+
+    /* only load what's required */
+    if ((flags & DNF_SACK_ADD_FLAG_FILELISTS) > 0)
+        flags_hy |= DNF_SACK_LOAD_FLAG_USE_FILELISTS;
+    if ((flags & DNF_SACK_ADD_FLAG_OTHER) > 0)
+        flags_hy |= DNF_SACK_LOAD_FLAG_USE_OTHER;
+    if ((flags & DNF_SACK_ADD_FLAG_UPDATEINFO) > 0)
+        flags_hy |= DNF_SACK_LOAD_FLAG_USE_UPDATEINFO;
+    if ((flags & DNF_SACK_ADD_FLAG_TEXT_INDEX) > 0)
+        flags_hy |= DNF_SACK_LOAD_FLAG_USE_TEXT_INDEX;
+
+    /* load solv */
+    g_debug("Loading repo %s", dnf_repo_get_id(repo));
+    dnf_state_action_start(state, DNF_STATE_ACTION_LOADING_CACHE, NULL);
+    if (!dnf_sack_load_repo(sack, dnf_repo_get_repo(repo), flags_hy, error))
+        return FALSE;
+
+    /* done */
+    return dnf_state_done(state, error);
+}
+
 /**
  * dnf_sack_add_repo:
  */
@@ -2148,7 +2454,6 @@ dnf_sack_add_repo(DnfSack *sack,
     gboolean ret = TRUE;
     GError *error_local = NULL;
     DnfState *state_local;
-    int flags_hy = DNF_SACK_LOAD_FLAG_BUILD_CACHE;
 
     /* set state */
     ret = dnf_state_set_steps(state, error,
@@ -2169,57 +2474,24 @@ dnf_sack_add_repo(DnfSack *sack,
                 error_local->message);
         g_clear_error(&error_local);
         dnf_state_reset(state_local);
-        ret = dnf_repo_update(repo,
-                              DNF_REPO_UPDATE_FLAG_FORCE,
-                              state_local,
-                              &error_local);
-        if (!ret) {
-            if (!dnf_repo_get_required(repo) &&
-                (g_error_matches(error_local,
-                                 DNF_ERROR,
-                                 DNF_ERROR_CANNOT_FETCH_SOURCE) ||
-                 g_error_matches(error_local,
-                                 DNF_ERROR,
-                                 DNF_ERROR_REPO_NOT_AVAILABLE))) {
-                g_warning("Skipping refresh of %s: %s",
-                          dnf_repo_get_id(repo),
-                          error_local->message);
-                g_error_free(error_local);
-                return dnf_state_finished(state, error);
-            }
-            g_propagate_error(error, error_local);
-            return FALSE;
-        }
+        dnf_repo_update(repo,
+                        DNF_REPO_UPDATE_FLAG_FORCE,
+                        state_local,
+                        &error_local);
     }
+    return dnf_sack_load_checked_repo(sack, repo, error_local, flags, state, error);
+} CATCH_TO_GERROR(FALSE)
 
-    /* checking disabled the repo */
-    if (dnf_repo_get_enabled(repo) == DNF_REPO_ENABLED_NONE) {
-        g_debug("Skipping %s as repo no longer enabled",
-                dnf_repo_get_id(repo));
-        return dnf_state_finished(state, error);
-    }
-
-    /* done */
-    if (!dnf_state_done(state, error))
-        return FALSE;
-
-    /* only load what's required */
-    if ((flags & DNF_SACK_ADD_FLAG_FILELISTS) > 0)
-        flags_hy |= DNF_SACK_LOAD_FLAG_USE_FILELISTS;
-    if ((flags & DNF_SACK_ADD_FLAG_OTHER) > 0)
-        flags_hy |= DNF_SACK_LOAD_FLAG_USE_OTHER;
-    if ((flags & DNF_SACK_ADD_FLAG_UPDATEINFO) > 0)
-        flags_hy |= DNF_SACK_LOAD_FLAG_USE_UPDATEINFO;
-
-    /* load solv */
-    g_debug("Loading repo %s", dnf_repo_get_id(repo));
-    dnf_state_action_start(state, DNF_STATE_ACTION_LOADING_CACHE, NULL);
-    if (!dnf_sack_load_repo(sack, dnf_repo_get_repo(repo), flags_hy, error))
-        return FALSE;
+/* at most this many repos download new metadata at the same time */
+#define MAX_PARALLEL_REPO_UPDATES 4
 
-    /* done */
-    return dnf_state_done(state, error);
-} CATCH_TO_GERROR(FALSE)
+typedef struct {
+    DnfRepo     *repo;
+    gboolean     needs_update;
+    gboolean     finished;
+    gboolean     updated;
+    GError      *error;
+} DnfSackRepoUpdate;
 
 /**
  * dnf_sack_add_repos:
@@ -2232,14 +2504,15 @@ dnf_sack_add_repos(DnfSack *sack,
                      DnfState *state,
                      GError **error) try
 {
-    gboolean ret;
-    guint cnt = 0;
+    gboolean ret = TRUE;
     guint i;
     DnfRepo *repo;
     DnfState *state_local;
     g_autoptr(GPtrArray) enabled_repos = g_ptr_array_new();
+    std::vector<DnfSackRepoUpdate> updates;
+    std::vector<guint> pending;
 
-    /* count the enabled repos */
+    /* find the enabled repos */
     for (i = 0; i < repos->len; i++) {
         repo = static_cast<DnfRepo *>(g_ptr_array_index(repos, i));
         if (dnf_repo_get_enabled(repo) == DNF_REPO_ENABLED_NONE)
@@ -2251,41 +2524,164 @@ dnf_sack_add_repos(DnfSack *sack,
                 continue;
         }
 
-        cnt++;
+        updates.push_back({repo, FALSE, FALSE, FALSE, NULL});
     }
 
-    /* add each repo */
-    dnf_state_set_number_steps(state, cnt);
-    for (i = 0; i < repos->len; i++) {
-        repo = static_cast<DnfRepo *>(g_ptr_array_index(repos, i));
-        if (dnf_repo_get_enabled(repo) == DNF_REPO_ENABLED_NONE)
-            continue;
+    /* set state */
+    ret = dnf_state_set_steps(state, error,
+                              5, /* check repos */
+                              95, /* add repos */
+                              -1);
+    if (!ret)
+        return FALSE;
 
-        /* only allow metadata-only repos if FLAG_UNAVAILABLE is set */
-        if (dnf_repo_get_enabled(repo) == DNF_REPO_ENABLED_METADATA) {
-            if ((flags & DNF_SACK_ADD_FLAG_UNAVAILABLE) == 0)
-                continue;
+    /* the states of the worker threads are not children of state,
+     * cancelling it must still stop them */
+    GCancellable *cancellable = dnf_state_get_cancellable(state);
+    if (cancellable == NULL) {
+        g_autoptr(GCancellable) cancellable_new = g_cancellable_new();
+        dnf_state_set_cancellable(state, cancellable_new);
+        cancellable = dnf_state_get_cancellable(state);
+    }
+
+    /* check them all first, so the repos that need new metadata can
+     * download it in parallel, the others are loaded meanwhile */
+    state_local = dnf_state_get_child(state);
+    dnf_state_set_number_steps(state_local, updates.size());
+    for (i = 0; i < updates.size(); i++) {
+        DnfState *state_check = dnf_state_get_child(state_local);
+        g_autoptr(GError) error_local = NULL;
+        if (!dnf_repo_check(updates[i].repo, permissible_cache_age, state_check, &error_local)) {
+            g_debug("failed to check, attempting update: %s", error_local->message);
+            dnf_state_reset(state_check);
+            updates[i].needs_update = TRUE;
+            pending.push_back(i);
+        }
+        if (!dnf_state_done(state_local, error))
+            return FALSE;
+    }
+    if (!dnf_state_done(state, error))
+        return FALSE;
+
+    /* a single update runs in order below and reports progress, more
+     * run in worker threads covered by one metadata lock taken here; the
+     * workers only download and check, the steps touching the keyfiles,
+     * the logger and the context run on this thread */
+    std::mutex mutex;
+    std::condition_variable finished_cond;
+    std::atomic<guint> next_pending{0};
+    std::atomic<bool> cancel{false};
+    std::vector<std::thread> workers;
+    g_autoptr(DnfLock) lock = NULL;
+    guint lock_id = 0;
+    auto finish_updates = [&]() {
+        cancel = true;
+        for (auto & worker : workers) {
+            if (worker.joinable())
+                worker.join();
+        }
+        for (auto & update : updates) {
+            if (update.updated)
+                dnf_repo_update_finish(update.repo);
+            update.updated = FALSE;
+            g_clear_error(&update.error);
+        }
+        if (lock_id != 0 && !dnf_lock_release(lock, lock_id, NULL))
+            g_debug("failed to release the metadata lock");
+        lock_id = 0;
+    };
+    libdnf::Finalizer finish_updates_on_exit(finish_updates);
+    gboolean parallel = pending.size() > 1;
+    if (parallel) {
+        lock = dnf_lock_new();
+        lock_id = dnf_lock_take(lock, DNF_LOCK_TYPE_METADATA, DNF_LOCK_MODE_PROCESS, error);
+        if (lock_id == 0)
+            return FALSE;
+        std::vector<guint> queued;
+        for (auto idx : pending) {
+            auto & update = updates[idx];
+            if (dnf_repo_update_prepare(update.repo, &update.error))
+                queued.push_back(idx);
+            else
+                update.finished = TRUE;
         }
+        pending.swap(queued);
+        auto worker = [&]() {
+            guint idx;
+            while ((idx = next_pending++) < pending.size()) {
+                auto & update = updates[pending[idx]];
+                GError *error_local = NULL;
+                gboolean updated = FALSE;
+                g_autoptr(DnfState) state_update = dnf_state_new();
+                dnf_state_set_cancellable(state_update, cancellable);
+                /* a cancelled update reports the cancellation, not missing metadata */
+                if (!cancel && dnf_state_check(state_update, &error_local)) {
+                    updated = dnf_repo_update_locked(update.repo,
+                                                     DNF_REPO_UPDATE_FLAG_FORCE,
+                                                     state_update,
+                                                     &error_local);
+                }
+                std::lock_guard<std::mutex> guard(mutex);
+                update.error = error_local;
+                update.updated = updated;
+                update.finished = TRUE;
+                finished_cond.notify_all();
+            }
+        };
+        auto nworkers = std::min<size_t>(pending.size(), MAX_PARALLEL_REPO_UPDATES);
+        for (size_t w = 0; w < nworkers; w++)
+            workers.emplace_back(worker);
+    }
 
-        state_local = dnf_state_get_child(state);
-        ret = dnf_sack_add_repo(sack,
-                                  repo,
-                                  permissible_cache_age,
-                                  flags,
-                                  state_local,
-                                  error);
+    /* add each repo, in order */
+    DnfState *state_add = dnf_state_get_child(state);
+    dnf_state_set_number_steps(state_add, updates.size());
+    for (auto & update : updates) {
+        state_local = dnf_state_get_child(state_add);
+        ret = dnf_state_set_steps(state_local, error,
+                                  5, /* check repo */
+                                  95, /* load solv */
+                                  -1);
         if (!ret)
-            return FALSE;
+            break;
 
-        g_ptr_array_add(enabled_repos, repo);
+        GError *error_update = NULL;
+        if (update.needs_update && !parallel) {
+            DnfState *state_update = dnf_state_get_child(state_local);
+            dnf_repo_update(update.repo,
+                            DNF_REPO_UPDATE_FLAG_FORCE,
+                            state_update,
+                            &error_update);
+        } else if (update.needs_update) {
+            std::unique_lock<std::mutex> guard(mutex);
+            finished_cond.wait(guard, [&update]() { return update.finished; });
+            error_update = update.error;
+            update.error = NULL;
+        }
+        ret = dnf_sack_load_checked_repo(sack, update.repo, error_update,
+                                         flags, state_local, error);
+        if (!ret)
+            break;
+
+        g_ptr_array_add(enabled_repos, update.repo);
 
         /* done */
-        if (!dnf_state_done(state, error))
-            return FALSE;
+        ret = dnf_state_done(state_add, error);
+        if (!ret)
+            break;
     }
 
+    /* skip the downloads of repos that were not reached */
+    finish_updates();
+    if (!ret)
+        return FALSE;
+
     process_excludes(sack, enabled_repos);
 
+    /* done */
+    if (!dnf_state_done(state, error))
+        return FALSE;
+
     /* success */
     return TRUE;
 } CATCH_TO_GERROR(FALSE)
@@ -2368,6 +2764,8 @@ setModuleExcludes(DnfSack *sack, const char ** hotfixRepos,
     if (hotfixRepos != nullptr) {
         keepPackages.addFilter(HY_PKG_REPONAME, HY_NEQ, hotfixRepos);
     }
+    // the queries derived below share the applied result until they are filtered
+    keepPackages.apply();
 
     libdnf::Query includeQuery{sack};
     libdnf::Query excludeQuery{keepPackages};
@@ -2393,10 +2791,10 @@ setModuleExcludes(DnfSack *sack, const char ** hotfixRepos,
     excludeNamesQuery.queryUnion(excludeSrcNamesQuery);
     excludeNamesQuery.queryDifference(includeQuery);
 
-    dnf_sack_set_module_excludes(sack, excludeQuery.getResultPset());
-    dnf_sack_add_module_excludes(sack, excludeProvidesQuery.getResultPset());
-    dnf_sack_add_module_excludes(sack, excludeNamesQuery.getResultPset());
-    dnf_sack_set_module_includes(sack, includeQuery.getResultPset());
+    dnf_sack_set_module_excludes(sack, excludeQuery.runSet());
+    dnf_sack_add_module_excludes(sack, excludeProvidesQuery.runSet());
+    dnf_sack_add_module_excludes(sack, excludeNamesQuery.runSet());
+    dnf_sack_set_module_includes(sack, includeQuery.runSet());
 }
 
 }
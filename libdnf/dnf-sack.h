@@ -72,6 +72,7 @@ typedef enum {
  * @DNF_SACK_LOAD_FLAG_USE_PRESTO:              Use presto deltas metadata
  * @DNF_SACK_LOAD_FLAG_USE_UPDATEINFO:          Use updateinfo metadata
  * @DNF_SACK_LOAD_FLAG_USE_OTHER:               Use other metadata
+ * @DNF_SACK_LOAD_FLAG_USE_TEXT_INDEX:          Search summary, description and url using an index (Since: 0.64.0)
  *
  * Flags to use when loading from the sack.
  **/
@@ -82,6 +83,7 @@ typedef enum {
     DNF_SACK_LOAD_FLAG_USE_PRESTO           = 1 << 2,
     DNF_SACK_LOAD_FLAG_USE_UPDATEINFO       = 1 << 3,
     DNF_SACK_LOAD_FLAG_USE_OTHER            = 1 << 4,
+    DNF_SACK_LOAD_FLAG_USE_TEXT_INDEX       = 1 << 5,
     /*< private >*/
     DNF_SACK_LOAD_FLAG_LAST
 } DnfSackLoadFlags;
@@ -183,6 +185,7 @@ void dnf_sack_filter_modules(DnfSack *sack, GPtrArray *repos, const char *instal
  * @DNF_SACK_ADD_FLAG_REMOTE:                   Use remote repos
  * @DNF_SACK_ADD_FLAG_UNAVAILABLE:              Add repos that are unavailable
  * @DNF_SACK_ADD_FLAG_OTHER:                    Add the other
+ * @DNF_SACK_ADD_FLAG_TEXT_INDEX:               Index summary, description and url for searching (Since: 0.64.0)
  *
  * Flags to control repo loading into the sack.
  **/
@@ -193,6 +196,7 @@ typedef enum {
         DNF_SACK_ADD_FLAG_REMOTE                = 1 << 2,
         DNF_SACK_ADD_FLAG_UNAVAILABLE           = 1 << 3,
         DNF_SACK_ADD_FLAG_OTHER                 = 1 << 4,
+        DNF_SACK_ADD_FLAG_TEXT_INDEX            = 1 << 5,
         /*< private >*/
         DNF_SACK_ADD_FLAG_LAST
 } DnfSackAddFlags;
@@ -32,6 +32,15 @@
 #include <rpm/rpmlog.h>
 #include <rpm/rpmts.h>
 
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
 #include "catch-error.hpp"
 #include "log.hpp"
 #include "tinyformat/tinyformat.hpp"
@@ -45,6 +54,7 @@
 #include "dnf-transaction.h"
 #include "dnf-types.h"
 #include "dnf-utils.h"
+#include "hy-package-private.hpp"
 #include "hy-query.h"
 #include "hy-util-private.hpp"
 #include "plugin/plugin-private.hpp"
@@ -52,6 +62,8 @@
 #include "module/ModulePackageContainer.hpp"
 #include "transaction/Swdb.hpp"
 #include "transaction/Transformer.hpp"
+#include "utils/Instrumentation.hpp"
+#include "utils/utils.hpp"
 #include "utils/bgettext/bgettext-lib.h"
 
 typedef enum {
@@ -79,6 +91,8 @@ typedef struct {
     GPtrArray *remove_helper;
     GPtrArray *install;
     GPtrArray *pkgs_to_download;
+    GHashTable *install_headers;
+    GHashTable *remove_headers;
     GHashTable *erased_by_package_hash;
     guint64 flags;
     gboolean dont_solve_goal;
@@ -129,6 +143,9 @@ dnf_transaction_finalize(GObject *object)
         g_ptr_array_unref(priv->remove);
     if (priv->remove_helper != NULL)
         g_ptr_array_unref(priv->remove_helper);
+    g_hash_table_unref(priv->install_headers);
+    if (priv->remove_headers != NULL)
+        g_hash_table_unref(priv->remove_headers);
     if (priv->erased_by_package_hash != NULL)
         g_hash_table_unref(priv->erased_by_package_hash);
     if (priv->context != NULL)
@@ -146,6 +163,8 @@ dnf_transaction_init(DnfTransaction *transaction)
     DnfTransactionPrivate *priv = GET_PRIVATE(transaction);
     priv->timer = g_timer_new();
     priv->pkgs_to_download = g_ptr_array_new_with_free_func((GDestroyNotify)g_object_unref);
+    priv->install_headers = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
+                                                  (GDestroyNotify)headerFree);
 }
 
 /**
@@ -354,33 +373,26 @@ dnf_transaction_ensure_repo_list(DnfTransaction *transaction, GPtrArray *pkglist
     return TRUE;
 } CATCH_TO_GERROR(FALSE)
 
-gboolean
-dnf_transaction_gpgcheck_package(DnfTransaction *transaction, DnfPackage *pkg, GError **error) try
+/**
+ * dnf_transaction_gpgcheck_file:
+ * @gpgcheck_repo_id: the id of the package repo if it is GPG enabled, or %NULL
+ *
+ * Checks the signature of a downloaded package file. Neither the pool nor
+ * any GObject is touched, the verifier thread of dnf_transaction_download()
+ * calls this directly.
+ **/
+static gboolean
+dnf_transaction_gpgcheck_file(rpmKeyring keyring,
+                              guint64 flags,
+                              const gchar *fn,
+                              const gchar *nevra,
+                              const gchar *gpgcheck_repo_id,
+                              GError **error)
 {
-    DnfTransactionPrivate *priv = GET_PRIVATE(transaction);
     GError *error_local = NULL;
-    DnfRepo *repo;
-    const gchar *fn;
-
-    /* ensure the filename is set */
-    if (!dnf_transaction_ensure_repo(transaction, pkg, error)) {
-        g_prefix_error(error, _("Failed to check untrusted: "));
-        return FALSE;
-    }
-
-    /* find the location of the local file */
-    fn = dnf_package_get_filename(pkg);
-    if (fn == NULL) {
-        g_set_error(error,
-                    DNF_ERROR,
-                    DNF_ERROR_FILE_NOT_FOUND,
-                    _("Downloaded file for %s not found"),
-                    dnf_package_get_name(pkg));
-        return FALSE;
-    }
 
     /* check file */
-    if (!dnf_keyring_check_untrusted_file(priv->keyring, fn, &error_local)) {
+    if (!dnf_keyring_check_untrusted_file(keyring, fn, &error_local)) {
 
         /* probably an i/o error */
         if (!g_error_matches(error_local, DNF_ERROR, DNF_ERROR_GPG_SIGNATURE_INVALID)) {
@@ -389,22 +401,21 @@ dnf_transaction_gpgcheck_package(DnfTransaction *transaction, DnfPackage *pkg, G
         }
 
         /* if the repo is signed this is ALWAYS an error */
-        repo = dnf_package_get_repo(pkg);
-        if (repo != NULL && dnf_repo_get_gpgcheck(repo)) {
+        if (gpgcheck_repo_id != NULL) {
             g_set_error(error,
                         DNF_ERROR,
                         DNF_ERROR_FILE_INVALID,
                         _("package %1$s cannot be verified "
                           "and repo %2$s is GPG enabled: %3$s"),
-                        dnf_package_get_nevra(pkg),
-                        dnf_repo_get_id(repo),
+                        nevra,
+                        gpgcheck_repo_id,
                         error_local->message);
             g_error_free(error_local);
             return FALSE;
         }
 
         /* we can only install signed packages in this mode */
-        if ((priv->flags & DNF_TRANSACTION_FLAG_ONLY_TRUSTED) > 0) {
+        if ((flags & DNF_TRANSACTION_FLAG_ONLY_TRUSTED) > 0) {
             g_propagate_error(error, error_local);
             return FALSE;
         } else {
@@ -413,6 +424,64 @@ dnf_transaction_gpgcheck_package(DnfTransaction *transaction, DnfPackage *pkg, G
     }
 
     return TRUE;
+}
+
+/**
+ * dnf_transaction_find_package_file:
+ *
+ * Sets the repo of @pkg and returns its local file.
+ **/
+static const gchar *
+dnf_transaction_find_package_file(DnfTransaction *transaction, DnfPackage *pkg, GError **error)
+{
+    const gchar *fn;
+
+    /* ensure the filename is set */
+    if (!dnf_transaction_ensure_repo(transaction, pkg, error)) {
+        g_prefix_error(error, _("Failed to check untrusted: "));
+        return NULL;
+    }
+
+    /* find the location of the local file */
+    fn = dnf_package_get_filename(pkg);
+    if (fn == NULL) {
+        g_set_error(error,
+                    DNF_ERROR,
+                    DNF_ERROR_FILE_NOT_FOUND,
+                    _("Downloaded file for %s not found"),
+                    dnf_package_get_name(pkg));
+        return NULL;
+    }
+    return fn;
+}
+
+/**
+ * dnf_transaction_gpgcheck_repo_id:
+ *
+ * Returns the id of the repo of @pkg if the repo is GPG enabled, or %NULL.
+ **/
+static const gchar *
+dnf_transaction_gpgcheck_repo_id(DnfPackage *pkg)
+{
+    DnfRepo *repo = dnf_package_get_repo(pkg);
+    if (repo == NULL || !dnf_repo_get_gpgcheck(repo))
+        return NULL;
+    return dnf_repo_get_id(repo);
+}
+
+gboolean
+dnf_transaction_gpgcheck_package(DnfTransaction *transaction, DnfPackage *pkg, GError **error) try
+{
+    DnfTransactionPrivate *priv = GET_PRIVATE(transaction);
+    const gchar *fn = dnf_transaction_find_package_file(transaction, pkg, error);
+    if (fn == NULL)
+        return FALSE;
+    return dnf_transaction_gpgcheck_file(priv->keyring,
+                                         priv->flags,
+                                         fn,
+                                         dnf_package_get_nevra(pkg),
+                                         dnf_transaction_gpgcheck_repo_id(pkg),
+                                         error);
 } CATCH_TO_GERROR(FALSE)
 
 /**
@@ -427,6 +496,7 @@ dnf_transaction_gpgcheck_package(DnfTransaction *transaction, DnfPackage *pkg, G
 gboolean
 dnf_transaction_check_untrusted(DnfTransaction *transaction, HyGoal goal, GError **error) try
 {
+    DnfTransactionPrivate *priv = GET_PRIVATE(transaction);
     guint i;
     g_autoptr(GPtrArray) install = NULL;
 
@@ -444,6 +514,11 @@ dnf_transaction_check_untrusted(DnfTransaction *transaction, HyGoal goal, GError
     for (i = 0; i < install->len; i++) {
         auto pkg = static_cast< DnfPackage * >(g_ptr_array_index(install, i));
 
+        /* already verified while downloading */
+        if (g_hash_table_contains(priv->install_headers,
+                                  GUINT_TO_POINTER(dnf_package_get_id(pkg))))
+            continue;
+
         if (!dnf_transaction_gpgcheck_package(transaction, pkg, error))
             return FALSE;
     }
@@ -942,6 +1017,117 @@ dnf_transaction_check_free_space(DnfTransaction *transaction, GError **error)
     return TRUE;
 }
 
+/* A downloaded package, resolved on the main thread. The verifier thread
+ * only gets plain strings, the pool and the packages are not thread-safe. */
+struct DnfTransactionVerifierItem {
+    Id id;
+    std::string filename;
+    std::string nevra;
+    std::string gpgcheck_repo_id;   /* empty unless the repo is GPG enabled */
+};
+
+/* Packages handed over by the download callback are verified here, so
+ * librepo can keep the other transfers going meanwhile. While downloading
+ * only this thread calls into rpm, which makes swapping the rpmlog callback
+ * in dnf_keyring_check_untrusted_file() safe. */
+struct DnfTransactionVerifier {
+    DnfTransactionVerifier(DnfTransaction *transaction, rpmKeyring keyring, rpmts ts, guint64 flags)
+    : transaction(transaction), keyring(rpmKeyringLink(keyring)), ts(rpmtsLink(ts)), flags(flags) {}
+    ~DnfTransactionVerifier();
+
+    void run();
+
+    DnfTransaction *transaction;    /* main thread only */
+    rpmKeyring keyring;
+    rpmts ts;
+    guint64 flags;
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<DnfTransactionVerifierItem> queue;
+    std::vector<std::pair<Id, Header>> headers;
+    bool done{false};
+    GError *error{nullptr};
+    std::thread thread;
+};
+
+DnfTransactionVerifier::~DnfTransactionVerifier()
+{
+    for (auto & item : headers)
+        headerFree(item.second);
+    g_clear_error(&error);
+    rpmtsFree(ts);
+    rpmKeyringFree(keyring);
+}
+
+void
+DnfTransactionVerifier::run()
+{
+    gboolean allow_untrusted = (flags & DNF_TRANSACTION_FLAG_ONLY_TRUSTED) == 0;
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (true) {
+        cond.wait(lock, [this] { return done || !queue.empty(); });
+        if (queue.empty())
+            return;
+        DnfTransactionVerifierItem item = std::move(queue.front());
+        queue.pop_front();
+
+        /* once one package failed the transaction is dead anyway */
+        if (error != nullptr)
+            continue;
+
+        lock.unlock();
+        GError *error_local = nullptr;
+        Header hdr = nullptr;
+        const gchar *gpgcheck_repo_id =
+            item.gpgcheck_repo_id.empty() ? nullptr : item.gpgcheck_repo_id.c_str();
+        if (dnf_transaction_gpgcheck_file(keyring, flags, item.filename.c_str(),
+                                          item.nevra.c_str(), gpgcheck_repo_id, &error_local))
+            hdr = dnf_rpmts_read_package_header(ts, item.filename.c_str(),
+                                                allow_untrusted, &error_local);
+        lock.lock();
+
+        if (hdr != nullptr)
+            headers.emplace_back(item.id, hdr);
+        else if (error == nullptr)
+            error = error_local;
+        else
+            g_error_free(error_local);
+    }
+}
+
+/**
+ * dnf_transaction_package_downloaded_cb:
+ *
+ * Queues a freshly downloaded package for signature checking and
+ * reading its header for the rpmts, so nothing is left to do for it at
+ * commit time. Fails the download as soon as a verification failed.
+ * Called by librepo on the thread running the download.
+ **/
+static gboolean
+dnf_transaction_package_downloaded_cb(DnfPackage *pkg, gpointer user_data, GError **error)
+{
+    auto verifier = static_cast< DnfTransactionVerifier * >(user_data);
+    const gchar *fn = dnf_transaction_find_package_file(verifier->transaction, pkg, error);
+    if (fn == NULL)
+        return FALSE;
+    const gchar *gpgcheck_repo_id = dnf_transaction_gpgcheck_repo_id(pkg);
+    DnfTransactionVerifierItem item{dnf_package_get_id(pkg),
+                                    fn,
+                                    dnf_package_get_nevra(pkg),
+                                    gpgcheck_repo_id != NULL ? gpgcheck_repo_id : ""};
+    {
+        std::lock_guard<std::mutex> lock(verifier->mutex);
+        if (verifier->error != nullptr) {
+            g_propagate_error(error, g_error_copy(verifier->error));
+            return FALSE;
+        }
+        verifier->queue.push_back(std::move(item));
+    }
+    verifier->cond.notify_one();
+    return TRUE;
+}
+
 /**
  * dnf_transaction_download:
  * @transaction: a #DnfTransaction instance.
@@ -964,7 +1150,55 @@ dnf_transaction_download(DnfTransaction *transaction, DnfState *state, GError **
         return FALSE;
 
     /* just download the list */
-    return dnf_package_array_download(priv->pkgs_to_download, NULL, state, error);
+    if ((priv->flags & DNF_TRANSACTION_FLAG_PIPELINE) == 0)
+        return dnf_package_array_download(priv->pkgs_to_download, NULL, state, error);
+
+    /* verify each package as soon as it arrives */
+    if (!dnf_transaction_import_keys(transaction, error))
+        return FALSE;
+    DnfTransactionVerifier verifier(transaction, priv->keyring, priv->ts, priv->flags);
+    auto stopVerifier = [&verifier]() {
+        {
+            std::lock_guard<std::mutex> lock(verifier.mutex);
+            verifier.done = true;
+        }
+        verifier.cond.notify_one();
+        if (verifier.thread.joinable())
+            verifier.thread.join();
+    };
+    gboolean threaded = TRUE;
+    try {
+        verifier.thread = std::thread(&DnfTransactionVerifier::run, &verifier);
+    } catch (const std::system_error & ex) {
+        g_debug("cannot start verifier thread, verifying after download: %s", ex.what());
+        threaded = FALSE;
+    }
+
+    /* the worker must be gone before the verifier goes out of scope */
+    libdnf::Finalizer joinVerifier(stopVerifier);
+    gboolean ret = dnf_package_array_download_full(priv->pkgs_to_download,
+                                                   NULL,
+                                                   dnf_transaction_package_downloaded_cb,
+                                                   &verifier,
+                                                   state,
+                                                   error);
+    stopVerifier();
+    if (!threaded)
+        verifier.run();
+
+    /* the headers of the packages that did verify are valid either way */
+    for (auto & item : verifier.headers)
+        g_hash_table_insert(priv->install_headers, GUINT_TO_POINTER(item.first), item.second);
+    verifier.headers.clear();
+
+    if (!ret)
+        return FALSE;
+    if (verifier.error != NULL) {
+        g_propagate_error(error, verifier.error);
+        verifier.error = NULL;
+        return FALSE;
+    }
+    return TRUE;
 } CATCH_TO_GERROR(FALSE)
 
 /**
@@ -996,6 +1230,7 @@ dnf_transaction_depsolve(DnfTransaction *transaction, HyGoal goal, DnfState *sta
 
     /* find a list of all the packages we have to download */
     g_ptr_array_set_size(priv->pkgs_to_download, 0);
+    g_hash_table_remove_all(priv->install_headers);
     packages = dnf_goal_get_packages(goal,
                                      DNF_PACKAGE_INFO_INSTALL,
                                      DNF_PACKAGE_INFO_REINSTALL,
@@ -1038,6 +1273,7 @@ dnf_transaction_reset(DnfTransaction *transaction)
     /* reset */
     priv->child = NULL;
     g_ptr_array_set_size(priv->pkgs_to_download, 0);
+    g_hash_table_remove_all(priv->install_headers);
     rpmtsEmpty(priv->ts);
     rpmtsSetNotifyCallback(priv->ts, NULL, NULL);
 
@@ -1054,6 +1290,10 @@ dnf_transaction_reset(DnfTransaction *transaction)
         g_ptr_array_unref(priv->remove_helper);
         priv->remove_helper = NULL;
     }
+    if (priv->remove_headers != NULL) {
+        g_hash_table_unref(priv->remove_headers);
+        priv->remove_headers = NULL;
+    }
     if (priv->erased_by_package_hash != NULL) {
         g_hash_table_unref(priv->erased_by_package_hash);
         priv->erased_by_package_hash = NULL;
@@ -1130,6 +1370,7 @@ dnf_transaction_commit(DnfTransaction *transaction, HyGoal goal, DnfState *state
     GPtrArray *pkglist;
     DnfPackage *pkg;
     DnfPackage *pkg_tmp;
+    Header hdr;
     rpmprobFilterFlags problems_filter = 0;
     rpmtransFlags rpmts_flags = RPMTRANS_FLAG_NONE;
     DnfTransactionPrivate *priv = GET_PRIVATE(transaction);
@@ -1139,6 +1380,7 @@ dnf_transaction_commit(DnfTransaction *transaction, HyGoal goal, DnfState *state
     DnfSack * rpmdb_version_sack = NULL;
     std::string rpmdb_begin;
     std::string rpmdb_end;
+    libdnf::ScopedTimer timer("transaction.commit");
 
     /* take lock */
     ret = dnf_state_take_lock(state, DNF_LOCK_TYPE_RPMDB, DNF_LOCK_MODE_PROCESS, error);
@@ -1220,8 +1462,13 @@ dnf_transaction_commit(DnfTransaction *transaction, HyGoal goal, DnfState *state
         filename = dnf_package_get_filename(pkg);
         allow_untrusted = (priv->flags & DNF_TRANSACTION_FLAG_ONLY_TRUSTED) == 0;
         is_update = action == DNF_STATE_ACTION_UPDATE || action == DNF_STATE_ACTION_DOWNGRADE;
-        ret = dnf_rpmts_add_install_filename2(
-            priv->ts, filename, allow_untrusted, is_update, pkg, error);
+        hdr = static_cast< Header >(g_hash_table_lookup(priv->install_headers,
+                                                        GUINT_TO_POINTER(dnf_package_get_id(pkg))));
+        if (hdr != NULL)
+            ret = dnf_rpmts_add_install_header(priv->ts, hdr, filename, is_update, pkg, error);
+        else
+            ret = dnf_rpmts_add_install_filename2(
+                priv->ts, filename, allow_untrusted, is_update, pkg, error);
         if (!ret)
             goto out;
 
@@ -1252,9 +1499,17 @@ dnf_transaction_commit(DnfTransaction *transaction, HyGoal goal, DnfState *state
     /* add things to remove */
     priv->remove =
         dnf_goal_get_packages(goal, DNF_PACKAGE_INFO_OBSOLETE, DNF_PACKAGE_INFO_REMOVE, -1);
+
+    /* read all the installed headers in one rpmdb pass; they are kept
+     * until the transaction is reset */
+    priv->remove_headers = dnf_rpmts_find_packages(priv->ts, priv->remove, error);
+    if (priv->remove_headers == NULL) {
+        ret = FALSE;
+        goto out;
+    }
     for (i = 0; i < priv->remove->len; i++) {
         pkg = static_cast< DnfPackage * >(g_ptr_array_index(priv->remove, i));
-        ret = dnf_rpmts_add_remove_pkg(priv->ts, pkg, error);
+        ret = dnf_rpmts_add_remove_pkg2(priv->ts, pkg, priv->remove_headers, error);
         if (!ret)
             goto out;
 
@@ -1449,7 +1704,10 @@ dnf_transaction_commit(DnfTransaction *transaction, HyGoal goal, DnfState *state
     rpmtsSetFlags(priv->ts, rpmts_flags);
     g_debug("Running actual transaction");
     dnf_state_set_allow_cancel(state, FALSE);
-    rc = rpmtsRun(priv->ts, NULL, problems_filter);
+    {
+        libdnf::ScopedTimer rpm_timer("transaction.rpm_run");
+        rc = rpmtsRun(priv->ts, NULL, problems_filter);
+    }
     if (rc < 0) {
         ret = FALSE;
         g_set_error(
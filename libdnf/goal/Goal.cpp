@@ -46,6 +46,7 @@ extern "C" {
 #include "../utils/tinyformat/tinyformat.hpp"
 #include "IdQueue.hpp"
 #include "../utils/filesystem.hpp"
+#include "../utils/Instrumentation.hpp"
 
 namespace {
 
@@ -319,11 +320,27 @@ filterFileToJob(DnfSack *sack, const Filter *f, Queue *job)
     const char *file = matches[0].str;
     Pool *pool = dnf_sack_get_pool(sack);
 
-    int flags = f->getCmpType() & HY_GLOB ? SELECTION_GLOB : 0;
-    if (f->getCmpType() & HY_GLOB)
-        flags |= SELECTION_NOCASE;
-    if (selection_make(pool, job, file, flags | SELECTION_FILELIST) == 0)
+    int cmpType = f->getCmpType() & HY_GLOB ? HY_GLOB | HY_ICASE : HY_EQ;
+    Map owners;
+    map_init(&owners, pool->nsolvables);
+    dnf_sack_get_file_index(sack)->match(file, cmpType, &owners);
+    IdQueue solvables;
+    for (Id id = 2; id < pool->nsolvables; ++id) {
+        if (!MAPTST(&owners, id))
+            continue;
+        Solvable *s = pool_id2solvable(pool, id);
+        if (s->repo != pool->installed && !pool_installable(pool, s))
+            continue;
+        solvables.pushBack(id);
+    }
+    map_free(&owners);
+
+    if (solvables.size() == 0)
         return NO_MATCH;
+    if (solvables.size() == 1)
+        queue_push2(job, SOLVER_SOLVABLE | SOLVER_NOAUTOSET, solvables[0]);
+    else
+        queue_push2(job, SOLVER_SOLVABLE_ONE_OF, pool_queuetowhatprovides(pool, solvables.getQueue()));
     return 0;
 }
 
@@ -706,7 +723,7 @@ Goal::addProtected(PackageSet & pset)
     if (!pImpl->protectedPkgs) {
         pImpl->protectedPkgs.reset(new PackageSet(pset));
     } else {
-        map_or(pImpl->protectedPkgs->getMap(), pset.getMap());
+        *pImpl->protectedPkgs += pset;
     }
 }
 
@@ -868,6 +885,7 @@ Goal::jobLength()
 bool
 Goal::run(DnfGoalActions flags)
 {
+    ScopedTimer timer("goal.run");
     auto job = pImpl->constructJob(flags);
     pImpl->actions = static_cast<DnfGoalActions>(pImpl->actions | flags);
     int ret = pImpl->solve(job->getQueue(), flags);
@@ -1232,10 +1250,9 @@ Goal::Impl::allowUninstallAllButProtected(Queue *job, DnfGoalActions flags)
 {
     Pool *pool = dnf_sack_get_pool(sack);
 
-    if (!protectedPkgs) {
+    /* no need to grow the set for solvables added since, has() is false for them */
+    if (!protectedPkgs)
         protectedPkgs.reset(new PackageSet(sack));
-    } else
-        map_grow(protectedPkgs->getMap(), pool->nsolvables);
 
     Id protected_kernel = protectedRunningKernel();
 
@@ -1513,7 +1530,7 @@ Goal::Impl::protectedInRemovals()
         return false;
     auto pkgRemoveList = listResults(SOLVER_TRANSACTION_ERASE, 0);
     auto pkgObsoleteList = listResults(SOLVER_TRANSACTION_OBSOLETED, 0);
-    map_or(pkgRemoveList.getMap(), pkgObsoleteList.getMap());
+    pkgRemoveList += pkgObsoleteList;
 
     removalOfProtected.reset(new PackageSet(pkgRemoveList));
     Id id = -1;
@@ -30,6 +30,7 @@ int checksum_cmp(const unsigned char *cs1, const unsigned char *cs2);
 int checksum_fp(unsigned char *out, FILE *fp);
 int checksum_read(unsigned char *csout, FILE *fp);
 int checksum_stat(unsigned char *out, FILE *fp);
+int checksum_strv(unsigned char *out, const char * const *strv);
 int checksum_write(const unsigned char *cs, FILE *fp);
 int checksumt_l2h(int type);
 const char *pool_checksum_str(Pool *pool, const unsigned char *chksum);
@@ -38,6 +39,9 @@ const char *id2nevra(Pool *pool, Id id);
 
 /* filesystem utils */
 char *abspath(const char *path);
+FILE *solv_cache_fopen(const char *fn);
+void solv_cache_loaded(FILE *fp);
+FILE *solv_xfopen_pipelined(const char *fn);
 int is_readable_rpm(const char *fn);
 int mkcachedir(char *path);
 gboolean mv(const char *old_path, const char *new_path, GError **error);
@@ -32,6 +32,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/utsname.h>
@@ -43,6 +44,7 @@ extern "C" {
 #include <solv/evr.h>
 #include <solv/solver.h>
 #include <solv/solverdebug.h>
+#include <solv/solv_xfopen.h>
 #include <solv/util.h>
 #include <solv/pool_parserpmrichdep.h>
 }
@@ -66,7 +68,10 @@ extern "C" {
 #include <glib.h>
 #include <gio/gio.h>
 
+#include <atomic>
 #include <string>
+#include <system_error>
+#include <thread>
 
 #define BUF_BLOCK 4096
 #define CHKSUM_TYPE REPOKEY_TYPE_SHA256
@@ -141,14 +146,16 @@ checksum_fp(unsigned char *out, FILE *fp)
     return 0;
 }
 
-/* calls rewind(fp) before returning */
+/* does not move the fp position */
 int
 checksum_read(unsigned char *csout, FILE *fp)
 {
-    if (fseek(fp, -32, SEEK_END) ||
-        fread(csout, CHKSUM_BYTES, 1, fp) != 1)
+    /* read past the stdio buffer, a seek to the end would discard it */
+    struct stat st;
+    int fd = fileno(fp);
+    if (fstat(fd, &st) || st.st_size < CHKSUM_BYTES ||
+        pread(fd, csout, CHKSUM_BYTES, st.st_size - CHKSUM_BYTES) != CHKSUM_BYTES)
         return 1;
-    rewind(fp);
     return 0;
 }
 
@@ -173,6 +180,18 @@ checksum_stat(unsigned char *out, FILE *fp)
     return 0;
 }
 
+int
+checksum_strv(unsigned char *out, const char * const *strv)
+{
+    auto h = solv_chksum_create(CHKSUM_TYPE);
+    solv_chksum_add(h, CHKSUM_IDENT, strlen(CHKSUM_IDENT));
+    /* including the terminating '\0' keeps ("ab", "c") apart from ("a", "bc") */
+    for (; *strv; ++strv)
+        solv_chksum_add(h, *strv, strlen(*strv) + 1);
+    solv_chksum_free(h, out);
+    return 0;
+}
+
 /* moves fp to the end of file */
 int checksum_write(const unsigned char *cs, FILE *fp)
 {
@@ -182,6 +201,135 @@ int checksum_write(const unsigned char *cs, FILE *fp)
     return 0;
 }
 
+/* opens a .solv file for repo_add_solv(), NULL on failure with errno set */
+FILE *
+solv_cache_fopen(const char *fn)
+{
+    /* the file must stay backed by a descriptor, libsolv pages its large
+       blobs in from a dup() of it on demand rather than reading them */
+    int fd = open(fn, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return NULL;
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    FILE *fp = fdopen(fd, "r");
+    if (fp == NULL) {
+        int saved_errno = errno;
+        close(fd);
+        errno = saved_errno;
+    }
+    return fp;
+}
+
+/* called after repo_add_solv() read fp opened by solv_cache_fopen(): the
+   advice belongs to the open file shared with the dup() libsolv keeps for
+   paging, whose reads are random */
+void
+solv_cache_loaded(FILE *fp)
+{
+    posix_fadvise(fileno(fp), 0, 0, POSIX_FADV_NORMAL);
+}
+
+/* read end of a metadata file decompressed by a thread of its own */
+struct PipelinedFile {
+    int fd;
+    std::thread decompressor;
+    /* errno of a decompression error, stored before the write end is closed */
+    std::atomic<int> error{0};
+};
+
+/* a decompression error is reported at the end of the data, not as EOF */
+static ssize_t
+pipelined_file_read(void *cookie, char *buf, size_t size)
+{
+    auto file = static_cast<PipelinedFile *>(cookie);
+    ssize_t ret;
+    do {
+        ret = read(file->fd, buf, size);
+    } while (ret < 0 && errno == EINTR);
+    if (ret == 0 && file->error) {
+        errno = file->error;
+        return -1;
+    }
+    return ret;
+}
+
+static int
+pipelined_file_close(void *cookie)
+{
+    auto file = static_cast<PipelinedFile *>(cookie);
+    /* a decompressor still writing gets EPIPE and stops */
+    close(file->fd);
+    file->decompressor.join();
+    int error = file->error;
+    delete file;
+    if (error) {
+        errno = error;
+        return EOF;
+    }
+    return 0;
+}
+
+static void
+pipelined_file_decompress(PipelinedFile *file, FILE *source, int fd)
+{
+    char buf[65536];
+    size_t len;
+    int error = 0;
+    while ((len = fread(buf, 1, sizeof(buf), source)) > 0) {
+        for (size_t done = 0; done < len;) {
+            auto ret = send(fd, buf + done, len - done, MSG_NOSIGNAL);
+            if (ret < 0 && errno == EINTR)
+                continue;
+            /* the reader stopped early, nobody reads the rest */
+            if (ret < 0) {
+                fclose(source);
+                close(fd);
+                return;
+            }
+            done += ret;
+        }
+    }
+    /* the decompressors report corrupt or truncated data as read errors */
+    if (ferror(source))
+        error = EIO;
+    if (fclose(source))
+        error = EIO;
+    file->error = error;
+    close(fd);
+}
+
+/* Opens a metadata file like solv_xfopen() does. A compressed file is decompressed by another
+ * thread, so libsolv parses the XML meanwhile instead of alternating between the two. A
+ * decompression error fails the read at the end of the data and fclose(), the caller must
+ * check the latter. */
+FILE *
+solv_xfopen_pipelined(const char *fn)
+{
+    FILE *source = solv_xfopen(fn, "r");
+    if (source == NULL || solv_xfopen_iscompressed(fn) != 1)
+        return source;
+
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds))
+        return source;
+    auto file = new PipelinedFile;
+    file->fd = fds[0];
+    try {
+        file->decompressor = std::thread(pipelined_file_decompress, file, source, fds[1]);
+    } catch (const std::system_error &) {
+        close(fds[0]);
+        close(fds[1]);
+        delete file;
+        return source;
+    }
+
+    cookie_io_functions_t io = {pipelined_file_read, NULL, NULL, pipelined_file_close};
+    FILE *fp = fopencookie(file, "r", io);
+    if (fp == NULL)
+        pipelined_file_close(file);
+    return fp;
+}
+
 int
 checksum_type2length(int type)
 {
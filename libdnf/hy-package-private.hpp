@@ -26,11 +26,18 @@
 #include <vector>
 
 #include "hy-package.h"
+#include "dnf-repo.hpp"
 #include "dnf-sack.h"
 #include "sack/changelog.hpp"
 
 Pool        *dnf_package_get_pool       (DnfPackage *pkg);
 DnfSack     *dnf_package_get_sack       (DnfPackage *pkg);
 std::vector<libdnf::Changelog>   dnf_package_get_changelogs (DnfPackage *pkg);
+gboolean     dnf_package_array_download_full(GPtrArray *packages,
+                                             const gchar *directory,
+                                             DnfRepoPackageDownloadedFunc downloaded_cb,
+                                             gpointer user_data,
+                                             DnfState *state,
+                                             GError **error);
 
 #endif // __HY_PACKAGE_INTERNAL_H
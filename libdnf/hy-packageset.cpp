@@ -71,7 +71,8 @@ dnf_packageset_from_bitmap(DnfSack *sack, Map *map)
  * dnf_packageset_get_map: (skip):
  * @pset: a #DnfPackageSet instance.
  *
- * Gets the map.
+ * Gets the map. A small set is converted to the bitmap and stays one, the
+ * map is valid until @pset is freed.
  *
  * Returns: A #Map, or %NULL
  *
@@ -89,13 +89,10 @@ hy_subject_get_best_solution(HySubject subject, DnfSack *sack, HyForm *forms, Hy
 }
 
 
-HySelector
-hy_subject_get_best_selector(HySubject subject, DnfSack *sack, HyForm *forms, bool obsoletes,
-    const char *reponame)
+/// Enriches the best solution of a subject for obsoletes and reponame and frees it
+static HySelector
+best_solution_to_selector(HyQuery query, HyNevra nevra, bool obsoletes, const char *reponame)
 {
-    HyNevra nevra{nullptr};
-    HyQuery query = hy_subject_get_best_solution(subject, sack, forms, &nevra, FALSE, TRUE, TRUE,
-                                                 TRUE, false);
     if (!hy_query_is_empty(query)) {
         if (obsoletes && nevra && nevra->hasJustName()) {
             DnfPackageSet *pset;
@@ -114,8 +111,40 @@ hy_subject_get_best_selector(HySubject subject, DnfSack *sack, HyForm *forms, bo
             hy_query_free(installed_query);
         }
     }
-    delete nevra;
     HySelector selector = hy_query_to_selector(query);
     hy_query_free(query);
     return selector;
 }
+
+HySelector
+hy_subject_get_best_selector(HySubject subject, DnfSack *sack, HyForm *forms, bool obsoletes,
+    const char *reponame)
+{
+    HyNevra nevra{nullptr};
+    HyQuery query = hy_subject_get_best_solution(subject, sack, forms, &nevra, FALSE, TRUE, TRUE,
+                                                 TRUE, false);
+    HySelector selector = best_solution_to_selector(query, nevra, obsoletes, reponame);
+    delete nevra;
+    return selector;
+}
+
+GPtrArray *
+hy_subjects_get_best_selectors(const char **subjects, DnfSack *sack, HyForm *forms,
+    bool obsoletes, const char *reponame)
+{
+    std::vector<std::string> patterns;
+    for (const char **subject = subjects; *subject != NULL; ++subject)
+        patterns.emplace_back(*subject);
+
+    libdnf::Query base(sack, libdnf::Query::ExcludeFlags::APPLY_EXCLUDES);
+    base.addFilter(HY_PKG_ARCH, HY_NEQ, "src");
+    auto matches = base.filterSubjects(patterns, forms, false, true, true, true);
+
+    GPtrArray *selectors = g_ptr_array_new_full(matches.size(), (GDestroyNotify) hy_selector_free);
+    for (auto & match : matches) {
+        HyQuery query = new libdnf::Query(std::move(match.query));
+        g_ptr_array_add(selectors,
+                        best_solution_to_selector(query, match.nevra.get(), obsoletes, reponame));
+    }
+    return selectors;
+}
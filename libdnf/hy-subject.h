@@ -88,6 +88,21 @@ HyQuery hy_subject_get_best_query(HySubject subject, DnfSack *sack, gboolean wit
 HySelector hy_subject_get_best_selector(HySubject subject, DnfSack *sack, HyForm *forms,
     bool obsoletes, const char *reponame);
 
+/**
+* @brief Returns HySelector for every subject, each equal to the result of
+* hy_subject_get_best_selector(). The subjects are resolved together, which is faster than
+* resolving them one by one for long lists of subjects.
+*
+* @param subjects NULL terminated array of subjects
+* @param sack DnfSack
+* @param forms HyForm *forms or NULL
+* @param obsoletes If TRUE, obsoletes will be added to results
+* @param reponame Id of repo
+* @return GPtrArray of HySelector in the order of subjects
+*/
+GPtrArray *hy_subjects_get_best_selectors(const char **subjects, DnfSack *sack, HyForm *forms,
+    bool obsoletes, const char *reponame);
+
 G_END_DECLS
 
 G_DEFINE_AUTO_CLEANUP_FREE_FUNC(HySubject, hy_subject_free, NULL)
@@ -26,6 +26,7 @@
 #include "../hy-iutil.h"
 #include "../hy-util-private.hpp"
 #include "../hy-types.h"
+#include "../sack/textindex.hpp"
 
 #include <utils.hpp>
 
@@ -41,10 +42,12 @@
 #include <solv/repo.h>
 #include <solv/util.h>
 
+#include <atomic>
 #include <cctype>
 #include <map>
 #include <mutex>
 #include <set>
+#include <thread>
 
 #include <string.h>
 #include <time.h>
@@ -165,6 +168,8 @@ public:
 
     SyncStrategy syncStrategy;
     std::map<std::string, std::string> metadataPaths;
+    /* checksums of the metadata files as listed in repomd.xml */
+    std::map<std::string, std::string> metadataChecksums;
 
     LibsolvRepo * libsolvRepo{nullptr};
     bool needs_internalizing{false};
@@ -184,17 +189,40 @@ public:
     int main_nsolvables{0};
     int main_nrepodata{0};
     int main_end{0};
+    /* built on demand for DNF_SACK_LOAD_FLAG_USE_TEXT_INDEX */
+    std::unique_ptr<TextIndex> textIndex;
 
     // Lock attachLibsolvRepo(), detachLibsolvRepo() and hy_repo_free() to ensure atomic behavior
     // in threaded environment such as PackageKit.
     std::mutex attachLibsolvMutex;
 
+    /* background refresh for SyncStrategy::BACKGROUND */
+    enum class RefreshState { NONE, RUNNING, UNCHANGED, READY, FAILED };
+    void startRefresh();
+    bool applyRefresh();
+    void waitForRefresh();
+    std::thread refreshThread;
+    std::atomic<RefreshState> refreshState{RefreshState::NONE};
+    std::atomic<bool> refreshCancel{false};
+    /* temporary directory of a refresh, valid once refreshState is READY */
+    std::string refreshTmpDir;
+    /* why a refresh failed, valid once refreshState is FAILED; the refresh thread does not log,
+     * the logger may call back into an interpreter */
+    std::string refreshError;
+
 private:
     Repo * owner;
     std::unique_ptr<LrResult> lrHandlePerform(LrHandle * handle, const std::string & destDirectory,
         bool setGPGHomeDir);
     bool isMetalinkInSync();
     bool isRepomdInSync();
+    bool setupRevalidation(LrHandle * h, const std::string & cachedir);
+    static void storeRepomdLastModified(const std::string & cachedir, const char * downloadedRepomd,
+                                        time_t downloadStarted);
+    void refresh(std::unique_ptr<LrHandle> repomdHandle, std::unique_ptr<LrHandle> fullHandle,
+                 bool conditional, const std::string & cachedir, const std::string & currentRepomd,
+                 const std::string & primary);
+    static int refreshProgressCB(void * data, double totalToDownload, double downloaded);
     void resetMetadataExpired();
     std::vector<Key> retrieve(const std::string & url);
     void importRepoKeys();
@@ -215,6 +243,41 @@ private:
     std::string getHash() const;
 };
 
+/* Conditional revalidation of repomd.xml
+ *
+ * The Last-Modified date the server reported for the cached repomd.xml is kept next to it and sent
+ * as If-Modified-Since. librepo does not expose response headers, so the date is taken from the
+ * mtime of a repomd.xml downloaded with LRO_PRESERVETIME. Only handles with baseurls alone send it,
+ * a mirrorlist or metalink is fetched with the same headers and must not be answered by a 304.
+ * A "304 Not Modified" response is reported by librepo as a mirror failure, the callback records it
+ * and stops the download with LR_CB_ERROR. The repomd.xml is not modified only if the download then
+ * failed with LRE_CBINTERRUPTED, any other error is a real one. Other progress and mirror failures
+ * are passed to the user callbacks, if any. */
+struct RevalidationData {
+    const std::atomic<bool> * cancel;
+    bool notModified;
+    RepoCB * callbacks;
+    bool conditional;
+};
+
+/// LRO_PROGRESSCB of a revalidation, data is a RevalidationData
+int revalidationProgressCB(void * data, double totalToDownload, double downloaded);
+/// LRO_HMFCB of a revalidation, data is a RevalidationData
+int revalidationMirrorFailureCB(void * data, const char * msg, const char * url,
+                                const char * metadata);
+/// Returns true if a mirror failure reported by librepo is a "304 Not Modified" response
+bool isNotModifiedFailure(const char * msg);
+/// Returns true if the download of a revalidation failed only because the repomd.xml was not modified
+bool isNotModified(const RevalidationData & data, const LrException & ex);
+/// Formats time as an HTTP date, independently of the locale
+std::string httpDate(time_t time);
+
+/// Moves the entries of stagingdir over the entries of the same name in cachedir. The replaced
+/// entries are left in stagingdir, or in olddir where renameat2(RENAME_EXCHANGE) is not used.
+/// Without exchange the replaced entry is always renamed into olddir first.
+void swapStagedMetadata(const std::string & stagingdir, const std::string & cachedir,
+                        const std::string & olddir, bool exchange = true);
+
 }
 
 #endif
@@ -34,6 +34,7 @@
 #include "../hy-iutil-private.hpp"
 #include "../hy-types.h"
 #include "libdnf/utils/File.hpp"
+#include "libdnf/utils/Instrumentation.hpp"
 #include "libdnf/utils/utils.hpp"
 #include "libdnf/utils/os-release.hpp"
 #include "libdnf/utils/url-encode.hpp"
@@ -281,6 +282,12 @@ Repo::Impl::Impl(Repo & owner, const std::string & id, Type type, std::unique_pt
 
 Repo::Impl::~Impl()
 {
+    if (refreshThread.joinable()) {
+        refreshCancel = true;
+        refreshThread.join();
+    }
+    if (refreshState == RefreshState::READY)
+        dnf_remove_recursive(refreshTmpDir.c_str(), NULL);
     g_strfreev(mirrors);
     if (libsolvRepo)
         libsolvRepo->appdata = nullptr;
@@ -1037,10 +1044,13 @@ bool Repo::Impl::loadCache(bool throwExcept, bool ignoreMissing)
     }
 
     metadata_locations.clear();
+    metadataChecksums.clear();
     for (auto elem = yum_repomd->records; elem; elem = g_slist_next(elem)) {
         if (elem->data) {
             auto rec = static_cast<LrYumRepoMdRecord *>(elem->data);
             metadata_locations.emplace_back(rec->type, rec->location_href);
+            if (rec->checksum)
+                metadataChecksums.emplace(rec->type, rec->checksum);
         }
     }
 
@@ -1225,6 +1235,103 @@ bool Repo::Impl::isMetalinkInSync()
     return true;
 }
 
+/* Conditional revalidation of repomd.xml, see RevalidationData */
+
+#define REPOMD_LAST_MODIFIED "repomd.xml.last-modified"
+
+bool isNotModifiedFailure(const char * msg)
+{
+    return g_str_has_prefix(msg, "Status code: 304 ");
+}
+
+int revalidationProgressCB(void * data, double totalToDownload, double downloaded)
+{
+    auto revalidation = static_cast<RevalidationData *>(data);
+    if (revalidation->cancel && *revalidation->cancel)
+        return LR_CB_ABORT;
+    if (revalidation->callbacks)
+        return revalidation->callbacks->progress(totalToDownload, downloaded);
+    return LR_CB_OK;
+}
+
+int revalidationMirrorFailureCB(void * data, const char * msg, const char * url,
+                                const char * metadata)
+{
+    auto revalidation = static_cast<RevalidationData *>(data);
+    if (revalidation->conditional && isNotModifiedFailure(msg)) {
+        revalidation->notModified = true;
+        return LR_CB_ERROR;
+    }
+    if (revalidation->callbacks)
+        return revalidation->callbacks->handleMirrorFailure(msg, url, metadata);
+    return LR_CB_OK;
+}
+
+bool isNotModified(const RevalidationData & data, const LrException & ex)
+{
+    // the callback stopped the download, librepo reports that as LRE_CBINTERRUPTED
+    return data.conditional && data.notModified && ex.getCode() == LRE_CBINTERRUPTED;
+}
+
+std::string httpDate(time_t time)
+{
+    static const char * const DAYS[] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+    static const char * const MONTHS[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                          "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+    struct tm tm;
+    gmtime_r(&time, &tm);
+    return tfm::format("%s, %02d %s %04d %02d:%02d:%02d GMT", DAYS[tm.tm_wday], tm.tm_mday,
+                       MONTHS[tm.tm_mon], tm.tm_year + 1900, tm.tm_hour, tm.tm_min, tm.tm_sec);
+}
+
+// Sets up a handle to download only the repomd.xml, conditionally if the server's date of the
+// cached one is known. LRO_PROGRESSDATA must point to a RevalidationData. Returns whether the
+// request is conditional. Handles with a mirrorlist or metalink fetch that first, on the same
+// handle and with the same headers, so their requests are never conditional.
+bool Repo::Impl::setupRevalidation(LrHandle * h, const std::string & cachedir)
+{
+    const char *dlist[] = LR_YUM_REPOMDONLY;
+    handleSetOpt(h, LRO_YUMDLIST, dlist);
+    handleSetOpt(h, LRO_PRESERVETIME, 1L);
+    handleSetOpt(h, LRO_PROGRESSCB, static_cast<LrProgressCb>(revalidationProgressCB));
+    handleSetOpt(h, LRO_HMFCB, static_cast<LrHandleMirrorFailureCb>(revalidationMirrorFailureCB));
+
+    if ((!conf->metalink().empty() && !conf->metalink().getValue().empty()) ||
+        (!conf->mirrorlist().empty() && !conf->mirrorlist().getValue().empty()))
+        return false;
+    auto fn = cachedir + "/" + METADATA_RELATIVE_DIR + "/" + REPOMD_LAST_MODIFIED;
+    std::ifstream lastModifiedFile(fn);
+    std::string lastModified;
+    if (!std::getline(lastModifiedFile, lastModified) || lastModified.empty())
+        return false;
+    std::vector<std::string> headers;
+    if (httpHeaders) {
+        for (auto item = httpHeaders.get(); *item; ++item)
+            headers.emplace_back(*item);
+    }
+    headers.push_back("If-Modified-Since: " + lastModified);
+    std::vector<const char *> headersPtrs;
+    for (const auto & header : headers)
+        headersPtrs.push_back(header.c_str());
+    headersPtrs.push_back(nullptr);
+    handleSetOpt(h, LRO_HTTPHEADER, headersPtrs.data());
+    return true;
+}
+
+// Stores the server's date of a downloaded repomd.xml that matches the cached one. Nothing is
+// stored if the server did not send a date and the mtime is just the time of the download.
+void Repo::Impl::storeRepomdLastModified(const std::string & cachedir, const char * downloadedRepomd,
+                                         time_t downloadStarted)
+{
+    struct stat st;
+    if (stat(downloadedRepomd, &st) != 0 || st.st_mtime >= downloadStarted)
+        return;
+    auto fn = cachedir + "/" + METADATA_RELATIVE_DIR + "/" + REPOMD_LAST_MODIFIED;
+    auto lastModified = httpDate(st.st_mtime);
+    if (!g_file_set_contents(fn.c_str(), lastModified.c_str(), -1, NULL))
+        dnf_ensure_file_unlinked(fn.c_str(), NULL);
+}
+
 // Use repomd to check whether our metadata are still current.
 bool Repo::Impl::isRepomdInSync()
 {
@@ -1240,18 +1347,29 @@ bool Repo::Impl::isRepomdInSync()
         dnf_remove_recursive(tmpdir, NULL);
     });
 
-    const char *dlist[] = LR_YUM_REPOMDONLY;
-
     std::unique_ptr<LrHandle> h(lrHandleInitRemote(tmpdir));
-
-    handleSetOpt(h.get(), LRO_YUMDLIST, dlist);
-    auto r = lrHandlePerform(h.get(), tmpdir, conf->repo_gpgcheck().getValue());
+    auto cachedir = getCachedir();
+    // the user callbacks of the handle are called through the revalidation ones
+    RevalidationData data{nullptr, false, callbacks.get(), false};
+    data.conditional = setupRevalidation(h.get(), cachedir);
+    handleSetOpt(h.get(), LRO_PROGRESSDATA, &data);
+    auto started = time(NULL);
+    std::unique_ptr<LrResult> r;
+    try {
+        r = lrHandlePerform(h.get(), tmpdir, conf->repo_gpgcheck().getValue());
+    } catch (const LrException & ex) {
+        if (!isNotModified(data, ex))
+            throw;
+        logger->debug(tfm::format(_("reviving: '%s' can be revived - repomd not modified."), id));
+        return true;
+    }
     resultGetInfo(r.get(), LRR_YUM_REPO, &yum_repo);
 
     auto same = haveFilesSameContent(repomdFn.c_str(), yum_repo->repomd);
-    if (same)
+    if (same) {
+        storeRepomdLastModified(cachedir, yum_repo->repomd, started);
         logger->debug(tfm::format(_("reviving: '%s' can be revived - repomd matches."), id));
-    else
+    } else
         logger->debug(tfm::format(_("reviving: failed for '%s', mismatched repomd."), id));
     return same;
 }
@@ -1331,8 +1449,16 @@ void Repo::Impl::downloadMetadata(const std::string & destdir)
 
 bool Repo::Impl::load()
 {
+    ScopedTimer timer("repo.load");
     auto logger(Log::getLogger());
     try {
+        if (applyRefresh()) {
+            timestamp = -1;
+            loadCache(true);
+            fresh = true;
+            expired = false;
+            return true;
+        }
         if (!getMetadataPath(MD_TYPE_PRIMARY).empty() || loadCache(false)) {
             resetMetadataExpired();
             if (!expired || syncStrategy == SyncStrategy::ONLY_CACHE || syncStrategy == SyncStrategy::LAZY) {
@@ -1340,6 +1466,17 @@ bool Repo::Impl::load()
                 return false;
             }
 
+            if (syncStrategy == SyncStrategy::BACKGROUND) {
+                logger->debug(tfm::format(_("repo: using cache for: %s, refreshing it in background"), id));
+                try {
+                    startRefresh();
+                } catch (const std::exception & ex) {
+                    logger->debug(tfm::format(_("repo: cannot refresh '%s' in background: %s"),
+                                              id, ex.what()));
+                }
+                return false;
+            }
+
             if (isInSync()) {
                 // the expired metadata still reflect the origin:
                 utimes(getMetadataPath(MD_TYPE_PRIMARY).c_str(), NULL);
@@ -1366,6 +1503,174 @@ bool Repo::Impl::load()
     return true;
 }
 
+int Repo::Impl::refreshProgressCB(void * data, double totalToDownload, double downloaded)
+{
+    auto cancel = static_cast<std::atomic<bool> *>(data);
+    return *cancel ? LR_CB_ABORT : LR_CB_OK;
+}
+
+void Repo::Impl::startRefresh()
+{
+    auto state = refreshState.load();
+    if (state == RefreshState::RUNNING || state == RefreshState::READY)
+        return;
+    if (refreshThread.joinable())
+        refreshThread.join();
+
+    // The handles are set up here, the refresh thread does not touch the repo configuration.
+    // It does not call the user callbacks either, only checks for cancellation.
+    auto cachedir = getCachedir();
+    auto setupHandle = [this, &cachedir](LrHandle * h) {
+        handleSetOpt(h, LRO_HMFCB, static_cast<LrHandleMirrorFailureCb>(nullptr));
+        handleSetOpt(h, LRO_FASTESTMIRRORCB, static_cast<LrFastestMirrorCb>(nullptr));
+        handleSetOpt(h, LRO_PROGRESSCB, static_cast<LrProgressCb>(refreshProgressCB));
+        handleSetOpt(h, LRO_PROGRESSDATA, &refreshCancel);
+        if (conf->repo_gpgcheck().getValue()) {
+            auto pubringdir = cachedir + "/pubring";
+            handleSetOpt(h, LRO_GNUPGHOMEDIR, pubringdir.c_str());
+        }
+    };
+    std::unique_ptr<LrHandle> repomdHandle(lrHandleInitRemote(nullptr));
+    setupHandle(repomdHandle.get());
+    bool conditional = setupRevalidation(repomdHandle.get(), cachedir);
+    std::unique_ptr<LrHandle> fullHandle(lrHandleInitRemote(nullptr));
+    setupHandle(fullHandle.get());
+
+    refreshCancel = false;
+    refreshState = RefreshState::RUNNING;
+    refreshThread = std::thread(&Impl::refresh, this, std::move(repomdHandle), std::move(fullHandle),
+                                conditional, cachedir, repomdFn, getMetadataPath(MD_TYPE_PRIMARY));
+}
+
+// Runs in the refresh thread. Downloads the repomd and, if it changed, all the metadata into
+// a temporary directory in the cache directory. applyRefresh() moves them into the cache.
+void Repo::Impl::refresh(std::unique_ptr<LrHandle> repomdHandle, std::unique_ptr<LrHandle> fullHandle,
+                         bool conditional, const std::string & cachedir, const std::string & currentRepomd,
+                         const std::string & primary)
+{
+    auto state = RefreshState::FAILED;
+    auto tmpdir = cachedir + "/refresh.XXXXXX";
+    bool haveTmpdir = false;
+    auto perform = [](LrHandle * h, const std::string & destdir) -> std::unique_ptr<LrResult> {
+        if (g_mkdir_with_parents(destdir.c_str(), 0755) == -1) {
+            const char * errTxt = strerror(errno);
+            throw RepoError(tfm::format(_("Cannot create repo destination directory \"%s\": %s"),
+                                          destdir, errTxt));
+        }
+        handleSetOpt(h, LRO_DESTDIR, destdir.c_str());
+        GError * errP{nullptr};
+        std::unique_ptr<LrResult> result(lr_result_init());
+        if (!lr_handle_perform(h, result.get(), &errP))
+            throwException(std::unique_ptr<GError>(errP));
+        return result;
+    };
+    try {
+        if (!mkdtemp(&tmpdir.front())) {
+            const char * errTxt = strerror(errno);
+            throw RepoError(tfm::format(_("Cannot create repo temporary directory \"%s\": %s"),
+                                          tmpdir, errTxt));
+        }
+        haveTmpdir = true;
+
+        LrYumRepo *yum_repo{nullptr};
+        RevalidationData data{&refreshCancel, false, nullptr, conditional};
+        handleSetOpt(repomdHandle.get(), LRO_PROGRESSDATA, &data);
+        auto started = time(NULL);
+        std::unique_ptr<LrResult> r;
+        try {
+            r = perform(repomdHandle.get(), tmpdir + "/repomd");
+            resultGetInfo(r.get(), LRR_YUM_REPO, &yum_repo);
+        } catch (const LrException & ex) {
+            if (!isNotModified(data, ex))
+                throw;
+        }
+        if (!yum_repo || haveFilesSameContent(currentRepomd.c_str(), yum_repo->repomd)) {
+            // the expired metadata still reflect the origin:
+            if (yum_repo)
+                storeRepomdLastModified(cachedir, yum_repo->repomd, started);
+            utimes(primary.c_str(), NULL);
+            state = RefreshState::UNCHANGED;
+        } else {
+            perform(fullHandle.get(), tmpdir + "/staging");
+            refreshTmpDir = tmpdir;
+            state = RefreshState::READY;
+        }
+    } catch (const std::exception & ex) {
+        refreshError = ex.what();
+    }
+    if (haveTmpdir && state != RefreshState::READY)
+        dnf_remove_recursive(tmpdir.c_str(), NULL);
+    refreshState = state;
+}
+
+void swapStagedMetadata(const std::string & stagingdir, const std::string & cachedir,
+                        const std::string & olddir, bool exchange)
+{
+    auto * dir = opendir(stagingdir.c_str());
+    if (!dir)
+        return;
+    Finalizer dirCloser([dir](){ closedir(dir); });
+    while (auto ent = readdir(dir)) {
+        auto elName = ent->d_name;
+        if (elName[0] == '.' && (elName[1] == '\0' || (elName[1] == '.' && elName[2] == '\0'))) {
+            continue;
+        }
+        auto staged = stagingdir + "/" + elName;
+        auto target = cachedir + "/" + elName;
+        // other readers of the cache see the old or the new repodata, never a mix of both
+#ifdef RENAME_EXCHANGE
+        if (exchange &&
+            renameat2(AT_FDCWD, staged.c_str(), AT_FDCWD, target.c_str(), RENAME_EXCHANGE) == 0)
+            continue;
+#else
+        (void)exchange;
+#endif
+        auto old = olddir + "/old." + elName;
+        bool moved = rename(target.c_str(), old.c_str()) == 0;
+        if ((!moved && errno != ENOENT) || rename(staged.c_str(), target.c_str()) == -1) {
+            const char * errTxt = strerror(errno);
+            if (moved)
+                rename(old.c_str(), target.c_str());
+            throw RepoError(tfm::format(_("Cannot rename directory \"%s\" to \"%s\": %s"),
+                                          staged, target, errTxt));
+        }
+    }
+}
+
+// Finishes a background refresh. Returns true if new metadata were moved into the cache.
+bool Repo::Impl::applyRefresh()
+{
+    auto state = refreshState.load();
+    if (state == RefreshState::NONE || state == RefreshState::RUNNING)
+        return false;
+    if (refreshThread.joinable())
+        refreshThread.join();
+    refreshState = RefreshState::NONE;
+    auto logger(Log::getLogger());
+    if (state == RefreshState::FAILED) {
+        logger->debug(tfm::format(_("repo: background refresh of '%s' failed: %s"),
+                                  id, refreshError));
+        refreshError.clear();
+    }
+    if (state == RefreshState::UNCHANGED)
+        expired = false;
+    if (state != RefreshState::READY)
+        return false;
+
+    Finalizer tmpDirRemover([this](){
+        dnf_remove_recursive(refreshTmpDir.c_str(), NULL);
+    });
+    swapStagedMetadata(refreshTmpDir + "/staging", getCachedir(), refreshTmpDir);
+    logger->debug(tfm::format(_("repo: using metadata refreshed in background for: %s"), id));
+    return true;
+}
+
+void Repo::Impl::waitForRefresh()
+{
+    if (refreshThread.joinable())
+        refreshThread.join();
+}
+
 std::string Repo::Impl::getHash() const
 {
     std::string tmp;
@@ -1525,6 +1830,7 @@ void Repo::Impl::attachLibsolvRepo(LibsolvRepo * libsolvRepo)
         ++nrefs;
 
     libsolvRepo->appdata = owner; // The libsolvRepo references back to us.
+    textIndex.reset();
     libsolvRepo->subpriority = -owner->getCost();
     libsolvRepo->priority = -owner->getPriority();
     this->libsolvRepo = libsolvRepo;
@@ -1633,6 +1939,16 @@ Repo::SyncStrategy Repo::getSyncStrategy() const noexcept
     return pImpl->syncStrategy;
 }
 
+bool Repo::isRefreshReady() const
+{
+    return pImpl->refreshState == Impl::RefreshState::READY;
+}
+
+void Repo::waitForRefresh()
+{
+    pImpl->waitForRefresh();
+}
+
 void Repo::downloadUrl(const char * url, int fd)
 {
     pImpl->downloadUrl(url, fd);
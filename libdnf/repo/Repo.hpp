@@ -115,7 +115,10 @@ public:
         // use the local cache, even if it's expired, never download.
         ONLY_CACHE = 2,
         // try the cache, if it is expired download new md.
-        TRY_CACHE = 3
+        TRY_CACHE = 3,
+        // use the local cache even if it's expired and download new md in a background thread.
+        // download if there's no cache.
+        BACKGROUND = 4
     };
 
 
@@ -286,6 +289,20 @@ public:
     const std::string & getRepoFilePath() const noexcept;
     void setSyncStrategy(SyncStrategy strategy);
     SyncStrategy getSyncStrategy() const noexcept;
+
+    /**
+    * @brief Returns true if a background refresh downloaded new metadata
+    *
+    * With SyncStrategy::BACKGROUND, load() uses an expired cache right away and refreshes it
+    * in a background thread. New metadata are staged next to the cache and the following
+    * load() swaps them into the cache directory, so the caller knows when to reload.
+    */
+    bool isRefreshReady() const;
+
+    /**
+    * @brief Waits for a running background refresh to finish
+    */
+    void waitForRefresh();
     void downloadUrl(const char * url, int fd);
 
     /**
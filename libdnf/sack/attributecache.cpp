@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "attributecache.hpp"
+#include "../utils/Instrumentation.hpp"
+
+#include <solv/knownid.h>
+#include <solv/repo.h>
+
+namespace libdnf {
+
+static const Id COLUMN_KEYS[] = {
+    SOLVABLE_BUILDTIME,
+    SOLVABLE_INSTALLTIME,
+    SOLVABLE_DOWNLOADSIZE,
+    SOLVABLE_INSTALLSIZE,
+    SOLVABLE_MEDIANR,
+};
+
+AttributeCache::AttributeCache(Pool * pool)
+: pool(pool)
+{}
+
+bool
+AttributeCache::hasColumn(Column column) const noexcept
+{
+    return !columns[static_cast<int>(column)].empty();
+}
+
+bool
+AttributeCache::useColumn(Column column, std::size_t count) const noexcept
+{
+    return hasColumn(column) || count * COLUMN_MIN_SHARE >= static_cast<std::size_t>(pool->nsolvables);
+}
+
+uint64_t
+AttributeCache::lookup(Column column, Id id) const
+{
+    auto & values = columns[static_cast<int>(column)];
+    if (!values.empty())
+        return values[id];
+    return solvable_lookup_num(pool_id2solvable(pool, id), COLUMN_KEYS[static_cast<int>(column)], 0);
+}
+
+const std::vector<uint64_t> &
+AttributeCache::column(Column column)
+{
+    auto & values = columns[static_cast<int>(column)];
+    if (!values.empty())
+        return values;
+
+    ScopedTimer timer("attributecache.build");
+    Id key = COLUMN_KEYS[static_cast<int>(column)];
+    repo_internalize_all_trigger(pool);
+    values.assign(pool->nsolvables, 0);
+    for (Id id = 2; id < pool->nsolvables; ++id) {
+        Solvable * s = pool_id2solvable(pool, id);
+        if (s->repo)
+            values[id] = solvable_lookup_num(s, key, 0);
+    }
+    return values;
+}
+
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef __ATTRIBUTE_CACHE_HPP
+#define __ATTRIBUTE_CACHE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <solv/pool.h>
+
+namespace libdnf {
+
+/**
+* @brief Numeric attributes of all solvables in the pool stored in arrays indexed by solvable Id
+*
+* Every column is read from the repodata on its first use. Solvables without the attribute
+* have the value 0, like solvable_lookup_num() with the default 0.
+*/
+class AttributeCache {
+public:
+    enum class Column {
+        BUILDTIME,
+        INSTALLTIME,
+        DOWNLOADSIZE,
+        INSTALLSIZE,
+        MEDIANR,
+    };
+
+    explicit AttributeCache(Pool * pool);
+
+    /// Returns the values of the column, reads them if they were not read yet
+    const std::vector<uint64_t> & column(Column column);
+
+    /// Returns whether the column was already read
+    bool hasColumn(Column column) const noexcept;
+
+    /// Returns whether looking up count solvables should go through the column: either it
+    /// was already read or count is a large part of the pool, so reading it pays off
+    bool useColumn(Column column, std::size_t count) const noexcept;
+
+    /// Returns the attribute of one solvable, from the column if it was already read
+    uint64_t lookup(Column column, Id id) const;
+
+private:
+    /// A column is read for at least 1/COLUMN_MIN_SHARE of the solvables in the pool
+    static constexpr std::size_t COLUMN_MIN_SHARE = 4;
+    static constexpr int COLUMNS = static_cast<int>(Column::MEDIANR) + 1;
+
+    Pool * pool;
+    std::vector<uint64_t> columns[COLUMNS];
+};
+
+}
+
+#endif /* __ATTRIBUTE_CACHE_HPP */
@@ -0,0 +1,338 @@
+/*
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "fileindex.hpp"
+#include "../hy-types.h"
+#include "../hy-util-private.hpp"
+#include "../utils/Instrumentation.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fnmatch.h>
+#include <limits>
+#include <numeric>
+#include <strings.h>
+#include <unordered_map>
+
+#include <glib.h>
+#include <solv/knownid.h>
+#include <solv/repo.h>
+#include <solv/dataiterator.h>
+#include <solv/repodata.h>
+
+namespace libdnf {
+
+namespace {
+
+constexpr uint32_t NONE = std::numeric_limits<uint32_t>::max();
+
+/// Orders by the case folded value, ties are broken by the raw value
+bool
+foldedLess(const std::string & a, const std::string & b)
+{
+    int cmp = g_ascii_strcasecmp(a.c_str(), b.c_str());
+    return cmp != 0 ? cmp < 0 : a < b;
+}
+
+/// Compares case folded values from their ends, at most limit characters are compared
+int
+suffixCompare(const std::string & a, const std::string & b,
+              std::size_t limit = std::numeric_limits<std::size_t>::max())
+{
+    std::size_t i = a.size();
+    std::size_t j = b.size();
+    for (std::size_t n = 0; n < limit; ++n) {
+        if (i == 0 || j == 0)
+            return i == j ? 0 : (i == 0 ? -1 : 1);
+        auto ca = static_cast<unsigned char>(g_ascii_tolower(a[--i]));
+        auto cb = static_cast<unsigned char>(g_ascii_tolower(b[--j]));
+        if (ca != cb)
+            return ca < cb ? -1 : 1;
+    }
+    return 0;
+}
+
+uint32_t
+intern(std::unordered_map<std::string, uint32_t> & ids, std::vector<std::string> & values,
+       std::string && value)
+{
+    auto it = ids.find(value);
+    if (it != ids.end())
+        return it->second;
+    uint32_t id = values.size();
+    ids.emplace(value, id);
+    values.push_back(std::move(value));
+    return id;
+}
+
+/// Sorts values by foldedLess() and returns the new positions of the original items
+std::vector<uint32_t>
+sortFolded(std::vector<std::string> & values)
+{
+    std::vector<uint32_t> order(values.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&values](uint32_t a, uint32_t b) {
+        return foldedLess(values[a], values[b]);
+    });
+    std::vector<std::string> sorted;
+    sorted.reserve(values.size());
+    std::vector<uint32_t> position(values.size());
+    for (uint32_t i = 0; i < order.size(); ++i) {
+        position[order[i]] = i;
+        sorted.push_back(std::move(values[order[i]]));
+    }
+    values.swap(sorted);
+    return position;
+}
+
+/// Returns the start of the literal text after the last wildcard of a fnmatch() pattern
+std::size_t
+globSuffixStart(const char * pattern)
+{
+    std::size_t start = 0;
+    std::size_t i = 0;
+    while (pattern[i]) {
+        char c = pattern[i];
+        if (c == '[') {
+            ++i;
+            if (pattern[i] == '!' || pattern[i] == '^')
+                ++i;
+            if (pattern[i] == ']')
+                ++i;
+            while (pattern[i] && pattern[i] != ']')
+                ++i;
+            if (pattern[i])
+                ++i;
+            start = i;
+        } else if (c == '\\') {
+            i += pattern[i + 1] ? 2 : 1;
+            start = i;
+        } else {
+            ++i;
+            if (c == '*' || c == '?')
+                start = i;
+        }
+    }
+    return start;
+}
+
+}
+
+FileIndex::FileIndex(Pool * pool)
+{
+    ScopedTimer timer("fileindex.build");
+    {
+        std::unordered_map<std::string, uint32_t> dirIds;
+        std::unordered_map<std::string, uint32_t> baseIds;
+        // directory ids are local to repodata, remember what they were translated to
+        std::unordered_map<Repodata *, std::vector<uint32_t>> dirCache;
+
+        Dataiterator di;
+        dataiterator_init(&di, pool, 0, 0, SOLVABLE_FILELIST, 0, SEARCH_FILES | SEARCH_COMPLETE_FILELIST);
+        while (dataiterator_step(&di)) {
+            auto & cache = dirCache[di.data];
+            if (cache.size() <= static_cast<std::size_t>(di.kv.id))
+                cache.resize(di.kv.id + 1, NONE);
+            uint32_t dir = cache[di.kv.id];
+            if (dir == NONE) {
+                std::string dirName = repodata_dir2str(di.data, di.kv.id, NULL);
+                while (!dirName.empty() && dirName.back() == '/')
+                    dirName.pop_back();
+                dir = cache[di.kv.id] = intern(dirIds, dirs, std::move(dirName));
+            }
+            uint32_t base = intern(baseIds, bases, di.kv.str);
+            entries.push_back({dir, base, di.solvid});
+        }
+        dataiterator_free(&di);
+    }
+
+    auto dirPosition = sortFolded(dirs);
+    auto basePosition = sortFolded(bases);
+    for (auto & entry : entries) {
+        entry.dir = dirPosition[entry.dir];
+        entry.base = basePosition[entry.base];
+    }
+    std::sort(entries.begin(), entries.end(), [](const Entry & a, const Entry & b) {
+        if (a.dir != b.dir)
+            return a.dir < b.dir;
+        if (a.base != b.base)
+            return a.base < b.base;
+        return a.solvable < b.solvable;
+    });
+    entries.erase(std::unique(entries.begin(), entries.end(), [](const Entry & a, const Entry & b) {
+        return a.dir == b.dir && a.base == b.base && a.solvable == b.solvable;
+    }), entries.end());
+
+    dirStart.assign(dirs.size() + 1, 0);
+    baseStart.assign(bases.size() + 1, 0);
+    for (const auto & entry : entries) {
+        ++dirStart[entry.dir + 1];
+        ++baseStart[entry.base + 1];
+    }
+    std::partial_sum(dirStart.begin(), dirStart.end(), dirStart.begin());
+    std::partial_sum(baseStart.begin(), baseStart.end(), baseStart.begin());
+
+    entriesByBase.resize(entries.size());
+    std::vector<uint32_t> fill(baseStart.begin(), baseStart.end() - 1);
+    for (uint32_t i = 0; i < entries.size(); ++i)
+        entriesByBase[fill[entries[i].base]++] = i;
+
+    basesBySuffix.resize(bases.size());
+    std::iota(basesBySuffix.begin(), basesBySuffix.end(), 0);
+    std::sort(basesBySuffix.begin(), basesBySuffix.end(), [this](uint32_t a, uint32_t b) {
+        int cmp = suffixCompare(bases[a], bases[b]);
+        return cmp != 0 ? cmp < 0 : a < b;
+    });
+}
+
+std::pair<uint32_t, uint32_t>
+FileIndex::dirRange(const std::string & prefix) const
+{
+    auto lo = std::partition_point(dirs.begin(), dirs.end(), [&prefix](const std::string & dir) {
+        return g_ascii_strcasecmp(dir.c_str(), prefix.c_str()) < 0;
+    });
+    auto hi = std::partition_point(lo, dirs.end(), [&prefix](const std::string & dir) {
+        return g_ascii_strncasecmp(dir.c_str(), prefix.c_str(), prefix.size()) == 0;
+    });
+    return {static_cast<uint32_t>(lo - dirs.begin()), static_cast<uint32_t>(hi - dirs.begin())};
+}
+
+std::pair<uint32_t, uint32_t>
+FileIndex::suffixRange(const std::string & suffix) const
+{
+    auto lo = std::partition_point(basesBySuffix.begin(), basesBySuffix.end(),
+                                   [this, &suffix](uint32_t base) {
+        return suffixCompare(bases[base], suffix) < 0;
+    });
+    auto hi = std::partition_point(lo, basesBySuffix.end(), [this, &suffix](uint32_t base) {
+        return suffixCompare(bases[base], suffix, suffix.size()) == 0;
+    });
+    return {static_cast<uint32_t>(lo - basesBySuffix.begin()),
+            static_cast<uint32_t>(hi - basesBySuffix.begin())};
+}
+
+uint32_t
+FileIndex::findBase(const std::string & base, bool icase, std::vector<uint32_t> & out) const
+{
+    auto lo = std::partition_point(bases.begin(), bases.end(), [&base](const std::string & value) {
+        return g_ascii_strcasecmp(value.c_str(), base.c_str()) < 0;
+    });
+    uint32_t cost = 0;
+    for (auto it = lo; it != bases.end() && g_ascii_strcasecmp(it->c_str(), base.c_str()) == 0; ++it) {
+        if (!icase && *it != base)
+            continue;
+        uint32_t index = it - bases.begin();
+        out.push_back(index);
+        cost += baseStart[index + 1] - baseStart[index];
+    }
+    return cost;
+}
+
+void
+FileIndex::match(const char * pattern, int cmpType, Map * m) const
+{
+    bool icase = cmpType & HY_ICASE;
+    bool glob = (cmpType & ~HY_COMPARISON_FLAG_MASK) == HY_GLOB && hy_is_glob_pattern(pattern);
+    std::size_t length = strlen(pattern);
+
+    // literal text every matching path starts and ends with
+    std::size_t prefixLength = glob ? strcspn(pattern, "*?[\\") : length;
+    std::size_t suffixStart = glob ? globSuffixStart(pattern) : 0;
+    if (icase) {
+        // the index folds ASCII only
+        for (std::size_t i = 0; i < length; ++i) {
+            if (static_cast<unsigned char>(pattern[i]) & 0x80) {
+                prefixLength = std::min(prefixLength, i);
+                suffixStart = std::max(suffixStart, i + 1);
+            }
+        }
+    }
+    std::string prefix(pattern, prefixLength);
+    std::string suffix(pattern + std::min(suffixStart, length));
+
+    // candidate directories share the directory part of the prefix
+    auto prefixSlash = prefix.rfind('/');
+    bool useDirs = prefixSlash != std::string::npos;
+    std::string dirPrefix = useDirs ? prefix.substr(0, prefixSlash) : std::string();
+    // without wildcards the directory is known exactly
+    bool exactDir = !glob && useDirs && prefixLength == length;
+    std::pair<uint32_t, uint32_t> dirsFound{0, 0};
+    uint64_t dirCost = std::numeric_limits<uint64_t>::max();
+    if (useDirs) {
+        dirsFound = dirRange(dirPrefix);
+        dirCost = 0;
+        for (auto dir = dirsFound.first; dir < dirsFound.second; ++dir) {
+            if (!exactDir || dirs[dir].size() == dirPrefix.size())
+                dirCost += dirStart[dir + 1] - dirStart[dir];
+        }
+    }
+
+    // candidate basenames end with the suffix, or are equal to its part after the last '/'
+    std::vector<uint32_t> basesFound;
+    uint64_t baseCost = std::numeric_limits<uint64_t>::max();
+    auto suffixSlash = suffix.rfind('/');
+    if (suffixSlash != std::string::npos) {
+        if (suffixSlash + 1 < suffix.size())
+            baseCost = findBase(suffix.substr(suffixSlash + 1), icase, basesFound);
+    } else if (!suffix.empty()) {
+        auto range = suffixRange(suffix);
+        baseCost = 0;
+        for (auto i = range.first; i < range.second; ++i) {
+            auto base = basesBySuffix[i];
+            basesFound.push_back(base);
+            baseCost += baseStart[base + 1] - baseStart[base];
+        }
+    }
+
+    std::string path;
+    auto test = [&](const Entry & entry) {
+        if (MAPTST(m, entry.solvable))
+            return;
+        path.assign(dirs[entry.dir]);
+        path += '/';
+        path += bases[entry.base];
+        bool matched;
+        if (glob)
+            matched = fnmatch(pattern, path.c_str(), icase ? FNM_CASEFOLD : 0) == 0;
+        else
+            matched = (icase ? strcasecmp(pattern, path.c_str()) : strcmp(pattern, path.c_str())) == 0;
+        if (matched)
+            MAPSET(m, entry.solvable);
+    };
+
+    if (dirCost <= baseCost && dirCost < entries.size()) {
+        for (auto dir = dirsFound.first; dir < dirsFound.second; ++dir) {
+            if (exactDir && dirs[dir].size() != dirPrefix.size())
+                continue;
+            for (auto i = dirStart[dir]; i < dirStart[dir + 1]; ++i)
+                test(entries[i]);
+        }
+    } else if (baseCost < entries.size()) {
+        for (auto base : basesFound) {
+            for (auto i = baseStart[base]; i < baseStart[base + 1]; ++i)
+                test(entries[entriesByBase[i]]);
+        }
+    } else {
+        for (const auto & entry : entries)
+            test(entry);
+    }
+}
+
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef __FILE_INDEX_HPP
+#define __FILE_INDEX_HPP
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <solv/bitmap.h>
+#include <solv/pool.h>
+
+namespace libdnf {
+
+/**
+* @brief Index of the file lists of all solvables in the pool
+*
+* Files are stored as pairs of a directory and a basename. Directories and basenames are
+* sorted by their case folded value, which gives prefix lookups of directories and, through
+* reversed basenames, suffix lookups of basenames. Exact paths and globs with a literal
+* prefix or suffix are then resolved from the files found by those lookups only.
+*/
+class FileIndex {
+public:
+    /// Indexes the complete file lists of all solvables in the pool
+    explicit FileIndex(Pool * pool);
+
+    /**
+    * @brief Sets solvables owning a file that matches the pattern in m
+    *
+    * Matching follows the dataiterator with SEARCH_FILES, globs are fnmatch() patterns where
+    * '*' also matches '/'.
+    *
+    * @param pattern absolute path or glob
+    * @param cmpType HY_EQ or HY_GLOB optionally combined with HY_ICASE
+    * @param m map of pool size
+    */
+    void match(const char * pattern, int cmpType, Map * m) const;
+
+private:
+    struct Entry {
+        uint32_t dir;
+        uint32_t base;
+        Id solvable;
+    };
+
+    std::pair<uint32_t, uint32_t> dirRange(const std::string & prefix) const;
+    std::pair<uint32_t, uint32_t> suffixRange(const std::string & suffix) const;
+    uint32_t findBase(const std::string & base, bool icase, std::vector<uint32_t> & out) const;
+
+    /// Sorted by case folded value, the root directory is ""
+    std::vector<std::string> dirs;
+    /// Sorted by case folded value
+    std::vector<std::string> bases;
+    /// Indexes of bases sorted by case folded reversed value
+    std::vector<uint32_t> basesBySuffix;
+    /// Sorted by directory and basename
+    std::vector<Entry> entries;
+    /// Position of the first entry of every directory, one item more than dirs
+    std::vector<uint32_t> dirStart;
+    /// Indexes of entries grouped by basename
+    std::vector<uint32_t> entriesByBase;
+    /// Position of the first item in entriesByBase of every basename, one item more than bases
+    std::vector<uint32_t> baseStart;
+};
+
+}
+
+#endif /* __FILE_INDEX_HPP */
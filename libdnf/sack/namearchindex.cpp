@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "namearchindex.hpp"
+#include "../utils/Instrumentation.hpp"
+
+#include <algorithm>
+
+#include <solv/evr.h>
+#include <solv/repo.h>
+
+namespace libdnf {
+
+NameArchIndex::NameArchIndex(Pool * pool)
+: nameArchRanks(pool->nsolvables, 0)
+, nameRanks(pool->nsolvables, 0)
+, nameArchGroups(pool->nsolvables, 0)
+, nameGroups(pool->nsolvables, 0)
+{
+    ScopedTimer timer("namearchindex.build");
+    std::vector<Id> ids;
+    ids.reserve(pool->nsolvables);
+    for (Id id = 1; id < pool->nsolvables; ++id)
+        ids.push_back(id);
+
+    std::sort(ids.begin(), ids.end(), [pool](Id a, Id b) {
+        const Solvable * sa = pool->solvables + a;
+        const Solvable * sb = pool->solvables + b;
+        if (sa->name != sb->name)
+            return sa->name < sb->name;
+        if (sa->arch != sb->arch)
+            return sa->arch < sb->arch;
+        int r = pool_evrcmp(pool, sb->evr, sa->evr, EVRCMP_COMPARE);
+        if (r)
+            return r < 0;
+        return a < b;
+    });
+    const Solvable * previous = nullptr;
+    for (uint32_t rank = 0; rank < ids.size(); ++rank) {
+        const Solvable * s = pool->solvables + ids[rank];
+        if (previous && (previous->name != s->name || previous->arch != s->arch))
+            ++nameArchGroupsCount;
+        previous = s;
+        nameArchRanks[ids[rank]] = rank;
+        nameArchGroups[ids[rank]] = nameArchGroupsCount;
+    }
+    ++nameArchGroupsCount;
+
+    std::sort(ids.begin(), ids.end(), [pool](Id a, Id b) {
+        const Solvable * sa = pool->solvables + a;
+        const Solvable * sb = pool->solvables + b;
+        if (sa->name != sb->name)
+            return sa->name < sb->name;
+        int r = pool_evrcmp(pool, sb->evr, sa->evr, EVRCMP_COMPARE);
+        if (r)
+            return r < 0;
+        return a < b;
+    });
+    previous = nullptr;
+    for (uint32_t rank = 0; rank < ids.size(); ++rank) {
+        const Solvable * s = pool->solvables + ids[rank];
+        if (previous && previous->name != s->name)
+            ++nameGroupsCount;
+        previous = s;
+        nameRanks[ids[rank]] = rank;
+        nameGroups[ids[rank]] = nameGroupsCount;
+    }
+    ++nameGroupsCount;
+}
+
+void
+NameArchIndex::sortByNameArch(Id * first, Id * last) const
+{
+    std::sort(first, last, [this](Id a, Id b) {
+        return nameArchRanks[a] < nameArchRanks[b];
+    });
+}
+
+void
+NameArchIndex::sortByNameArchPriority(Pool * pool, Id * first, Id * last) const
+{
+    std::sort(first, last, [this, pool](Id a, Id b) {
+        if (nameArchGroups[a] != nameArchGroups[b])
+            return nameArchGroups[a] < nameArchGroups[b];
+        int priorityA = pool->solvables[a].repo->priority;
+        int priorityB = pool->solvables[b].repo->priority;
+        if (priorityA != priorityB)
+            return priorityA > priorityB;
+        return nameArchRanks[a] < nameArchRanks[b];
+    });
+}
+
+void
+NameArchIndex::sortByName(Id * first, Id * last) const
+{
+    std::sort(first, last, [this](Id a, Id b) {
+        return nameRanks[a] < nameRanks[b];
+    });
+}
+
+}
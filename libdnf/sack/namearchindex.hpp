@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef __NAME_ARCH_INDEX_HPP
+#define __NAME_ARCH_INDEX_HPP
+
+#include <cstdint>
+#include <vector>
+
+#include <solv/pool.h>
+
+namespace libdnf {
+
+/**
+* @brief Order of all solvables in the pool by name, arch and evr
+*
+* Solvables are ranked once by name, arch, descending evr and Id, and once by name, descending
+* evr and Id. Sorting any set of solvables by these ranks gives the same order as sorting them
+* with pool_evrcmp(), but compares only integers. Solvables with the same name, or the same name
+* and arch, share a group number. Groups are numbered in the order of their name and arch Ids.
+* Repository priorities can change at any time and are not part of the index.
+*/
+class NameArchIndex {
+public:
+    explicit NameArchIndex(Pool * pool);
+
+    /// Sorts solvables by name, arch, descending evr and Id
+    void sortByNameArch(Id * first, Id * last) const;
+    /// Sorts solvables by name, arch, descending repo priority, descending evr and Id
+    void sortByNameArchPriority(Pool * pool, Id * first, Id * last) const;
+    /// Sorts solvables by name, descending evr and Id
+    void sortByName(Id * first, Id * last) const;
+
+    /// Position of the solvable in the order of sortByNameArch()
+    uint32_t nameArchRank(Id id) const { return nameArchRanks[id]; }
+    /// Group of solvables with the same name and arch
+    uint32_t nameArchGroup(Id id) const { return nameArchGroups[id]; }
+    /// Group of solvables with the same name
+    uint32_t nameGroup(Id id) const { return nameGroups[id]; }
+    uint32_t nameArchGroupCount() const noexcept { return nameArchGroupsCount; }
+    uint32_t nameGroupCount() const noexcept { return nameGroupsCount; }
+
+private:
+    std::vector<uint32_t> nameArchRanks;
+    std::vector<uint32_t> nameRanks;
+    std::vector<uint32_t> nameArchGroups;
+    std::vector<uint32_t> nameGroups;
+    uint32_t nameArchGroupsCount{0};
+    uint32_t nameGroupsCount{0};
+};
+
+}
+
+#endif /* __NAME_ARCH_INDEX_HPP */
@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "obsoletesindex.hpp"
+#include "../utils/Instrumentation.hpp"
+
+#include <algorithm>
+
+#include <solv/repo.h>
+
+namespace libdnf {
+
+ObsoletesIndex::ObsoletesIndex(Pool * pool, bool obsoleteUsesProvides)
+: obsoleteUsesProvides(obsoleteUsesProvides)
+{
+    ScopedTimer timer("obsoletesindex.build");
+    // pairs of the obsoleted solvable and its obsoleter
+    std::vector<std::pair<Id, Id>> pairs;
+    for (Id id = 2; id < pool->nsolvables; ++id) {
+        Solvable * s = pool_id2solvable(pool, id);
+        if (!s->repo || !s->obsoletes)
+            continue;
+        for (Id * r_id = s->repo->idarraydata + s->obsoletes; *r_id; ++r_id) {
+            Id r, rr;
+            FOR_PROVIDES(r, rr, *r_id) {
+                if (!obsoleteUsesProvides && !pool_match_nevr(pool, pool_id2solvable(pool, r), *r_id))
+                    continue; /* only matching pkg names */
+                pairs.emplace_back(r, id);
+            }
+        }
+    }
+    std::sort(pairs.begin(), pairs.end());
+    pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+
+    start.assign(pool->nsolvables + 1, 0);
+    obsoletersData.reserve(pairs.size());
+    for (const auto & pair : pairs) {
+        ++start[pair.first + 1];
+        obsoletersData.push_back(pair.second);
+    }
+    for (std::size_t i = 1; i < start.size(); ++i)
+        start[i] += start[i - 1];
+}
+
+}
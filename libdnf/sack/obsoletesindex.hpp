@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef __OBSOLETES_INDEX_HPP
+#define __OBSOLETES_INDEX_HPP
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include <solv/pool.h>
+
+namespace libdnf {
+
+/**
+* @brief Reverse index of obsoletes, maps every solvable to the solvables obsoleting it
+*
+* A solvable is obsoleted by an obsoletes entry of another solvable if it provides the entry and,
+* unless POOL_FLAG_OBSOLETEUSESPROVIDES is set, its name and evr match the entry. The index needs
+* the whatprovides of the pool and is valid until it is created again.
+*/
+class ObsoletesIndex {
+public:
+    ObsoletesIndex(Pool * pool, bool obsoleteUsesProvides);
+
+    /// Value of POOL_FLAG_OBSOLETEUSESPROVIDES the index was built with
+    bool getObsoleteUsesProvides() const noexcept { return obsoleteUsesProvides; }
+
+    /// Returns the range of sorted Ids of solvables obsoleting the solvable id
+    std::pair<const Id *, const Id *> obsoleters(Id id) const
+    {
+        return {obsoletersData.data() + start[id], obsoletersData.data() + start[id + 1]};
+    }
+
+private:
+    bool obsoleteUsesProvides;
+    /// Position of the first obsoleter of every solvable, one item more than solvables
+    std::vector<uint32_t> start;
+    std::vector<Id> obsoletersData;
+};
+
+}
+
+#endif /* __OBSOLETES_INDEX_HPP */
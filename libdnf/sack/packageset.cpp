@@ -18,7 +18,10 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include <algorithm>
 #include <assert.h>
+#include <iterator>
+#include <vector>
 
 #include "packageset.hpp"
 #include "../dnf-sack.h"
@@ -35,7 +38,21 @@ public:
 
 private:
     friend PackageSet;
+    /// Sparse sets larger than this are converted to the bitmap
+    std::size_t sparseLimit() const { return static_cast<std::size_t>(std::max(nsolvables / 64, 16)); }
+    void makeDense();
+    void checkSparse() { if (ids.size() > sparseLimit()) makeDense(); }
+    static bool mapHas(const Map * map, Id id) { return id < (map->size << 3) && MAPTST(map, id); }
+    bool has(Id id) const;
     DnfSack *sack;
+    /// Number of solvables in the pool when the set was created
+    int nsolvables;
+    bool dense{false};
+    /// getMap() handed out the bitmap, the set must not be compacted
+    bool mapHandedOut{false};
+    /// Sorted ids of a sparse set
+    std::vector<Id> ids;
+    /// Bitmap of a dense set, empty while the set is sparse
     Map map;
 };
 
@@ -46,23 +63,51 @@ PackageSet::PackageSet(PackageSet && pset): pImpl(std::move(pset.pImpl)) {}
 PackageSet::~PackageSet() = default;
 
 PackageSet::Impl::Impl(DnfSack* sack) :
-sack(sack)
+sack(sack), nsolvables(dnf_sack_get_pool(sack)->nsolvables)
 {
-    map_init(&map, dnf_sack_get_pool(sack)->nsolvables);
+    map_init(&map, 0);
 }
-PackageSet::Impl::Impl(DnfSack* sack, Map* map_source) : sack(sack)
+PackageSet::Impl::Impl(DnfSack* sack, Map* map_source) :
+sack(sack), nsolvables(dnf_sack_get_pool(sack)->nsolvables), dense(true)
 {
     map_init_clone(&map, map_source);
 }
-PackageSet::Impl::Impl(const PackageSet & pset): sack(pset.pImpl->sack)
+PackageSet::Impl::Impl(const PackageSet & pset):
+sack(pset.pImpl->sack), nsolvables(pset.pImpl->nsolvables), dense(pset.pImpl->dense),
+ids(pset.pImpl->ids)
 {
     map_init_clone(&map, &pset.pImpl->map);
 }
 PackageSet::Impl::~Impl() { map_free(&map); }
 
+void
+PackageSet::Impl::makeDense()
+{
+    if (dense)
+        return;
+    int size = ids.empty() ? nsolvables : std::max(nsolvables, ids.back() + 1);
+    map_free(&map);
+    map_init(&map, size);
+    for (auto id : ids)
+        MAPSET(&map, id);
+    std::vector<Id>().swap(ids);
+    dense = true;
+}
+
+bool
+PackageSet::Impl::has(Id id) const
+{
+    if (dense)
+        return mapHas(&map, id);
+    return std::binary_search(ids.begin(), ids.end(), id);
+}
+
 Id
 PackageSet::operator [](unsigned int index) const
 {
+    if (!pImpl->dense)
+        return index < pImpl->ids.size() ? pImpl->ids[index] : -1;
+
     const unsigned char *ti = pImpl->map.map;
     const unsigned char *end = ti + pImpl->map.size;
     unsigned int enabled;
@@ -93,27 +138,69 @@ PackageSet::operator [](unsigned int index) const
 PackageSet &
 PackageSet::operator +=(const PackageSet & other)
 {
-    map_or(&pImpl->map, &other.pImpl->map);
+    auto & ids = pImpl->ids;
+    const auto & otherIds = other.pImpl->ids;
+    if (!pImpl->dense && !other.pImpl->dense) {
+        std::vector<Id> merged;
+        merged.reserve(ids.size() + otherIds.size());
+        std::set_union(ids.begin(), ids.end(), otherIds.begin(), otherIds.end(),
+                       std::back_inserter(merged));
+        ids.swap(merged);
+        pImpl->checkSparse();
+    } else if (!other.pImpl->dense) {
+        for (auto id : otherIds)
+            set(id);
+    } else {
+        pImpl->makeDense();
+        map_or(&pImpl->map, &other.pImpl->map);
+    }
     return *this;
 }
 
 PackageSet &
 PackageSet::operator -=(const PackageSet & other)
 {
-    map_subtract(&pImpl->map, &other.pImpl->map);
+    if (!pImpl->dense) {
+        auto & ids = pImpl->ids;
+        ids.erase(std::remove_if(ids.begin(), ids.end(), [&other](Id id) {
+            return other.pImpl->has(id);
+        }), ids.end());
+    } else if (!other.pImpl->dense) {
+        for (auto id : other.pImpl->ids)
+            remove(id);
+    } else {
+        map_subtract(&pImpl->map, &other.pImpl->map);
+    }
     return *this;
 }
 
 PackageSet &
 PackageSet::operator /=(const PackageSet & other)
 {
-    map_and(&pImpl->map, &other.pImpl->map);
+    if (!pImpl->dense) {
+        auto & ids = pImpl->ids;
+        ids.erase(std::remove_if(ids.begin(), ids.end(), [&other](Id id) {
+            return !other.pImpl->has(id);
+        }), ids.end());
+    } else if (!other.pImpl->dense) {
+        std::vector<Id> kept;
+        for (auto id : other.pImpl->ids) {
+            if (Impl::mapHas(&pImpl->map, id))
+                kept.push_back(id);
+        }
+        map_empty(&pImpl->map);
+        for (auto id : kept)
+            MAPSET(&pImpl->map, id);
+    } else {
+        map_and(&pImpl->map, &other.pImpl->map);
+    }
     return *this;
 }
 
 PackageSet &
 PackageSet::operator +=(const Map * other)
 {
+    pImpl->makeDense();
     map_or(&pImpl->map, const_cast<Map *>(other));
     return *this;
 }
@@ -121,6 +208,13 @@ PackageSet::operator +=(const Map * other)
 PackageSet &
 PackageSet::operator -=(const Map * other)
 {
+    if (!pImpl->dense) {
+        auto & ids = pImpl->ids;
+        ids.erase(std::remove_if(ids.begin(), ids.end(), [other](Id id) {
+            return Impl::mapHas(other, id);
+        }), ids.end());
+        return *this;
+    }
     map_subtract(&pImpl->map, const_cast<Map *>(other));
     return *this;
 }
@@ -128,6 +222,13 @@ PackageSet::operator -=(const Map * other)
 PackageSet &
 PackageSet::operator /=(const Map * other)
 {
+    if (!pImpl->dense) {
+        auto & ids = pImpl->ids;
+        ids.erase(std::remove_if(ids.begin(), ids.end(), [other](Id id) {
+            return !Impl::mapHas(other, id);
+        }), ids.end());
+        return *this;
+    }
     map_and(&pImpl->map, const_cast<Map *>(other));
     return *this;
 }
@@ -135,12 +236,18 @@ PackageSet::operator /=(const Map * other)
 void
 PackageSet::clear()
 {
-    map_empty(&pImpl->map);
+    if (pImpl->dense)
+        map_empty(&pImpl->map);
+    else
+        pImpl->ids.clear();
 }
 
 bool
 PackageSet::empty()
 {
+    if (!pImpl->dense)
+        return pImpl->ids.empty();
+
     const unsigned char *res = pImpl->map.map;
     const unsigned char *end = res + pImpl->map.size;
 
@@ -152,17 +259,101 @@ PackageSet::empty()
 }
 
 
-void PackageSet::set(DnfPackage *pkg) { MAPSET(&pImpl->map, dnf_package_get_id(pkg)); }
-void PackageSet::set(Id id) { MAPSET(&pImpl->map, id); }
-bool PackageSet::has(DnfPackage *pkg) const { return MAPTST(&pImpl->map, dnf_package_get_id(pkg)); }
-bool PackageSet::has(Id id) const { return MAPTST(&pImpl->map, id); }
-void PackageSet::remove(Id id) { MAPCLR(&pImpl->map, id); }
-Map *PackageSet::getMap() const { return &pImpl->map; }
+void PackageSet::set(DnfPackage *pkg) { set(dnf_package_get_id(pkg)); }
+
+void
+PackageSet::set(Id id)
+{
+    if (pImpl->dense) {
+        MAPSET(&pImpl->map, id);
+        return;
+    }
+    auto & ids = pImpl->ids;
+    if (ids.empty() || id > ids.back()) {
+        ids.push_back(id);
+    } else {
+        auto it = std::lower_bound(ids.begin(), ids.end(), id);
+        if (*it == id)
+            return;
+        ids.insert(it, id);
+    }
+    pImpl->checkSparse();
+}
+
+bool PackageSet::has(DnfPackage *pkg) const { return has(dnf_package_get_id(pkg)); }
+
+bool
+PackageSet::has(Id id) const
+{
+    if (pImpl->dense)
+        return MAPTST(&pImpl->map, id);
+    return pImpl->has(id);
+}
+
+void
+PackageSet::remove(Id id)
+{
+    if (pImpl->dense) {
+        MAPCLR(&pImpl->map, id);
+        return;
+    }
+    auto & ids = pImpl->ids;
+    auto it = std::lower_bound(ids.begin(), ids.end(), id);
+    if (it != ids.end() && *it == id)
+        ids.erase(it);
+}
+
+Map *
+PackageSet::getMap() const
+{
+    pImpl->makeDense();
+    pImpl->mapHandedOut = true;
+    return &pImpl->map;
+}
+
+Map *
+PackageSet::getMutableMap()
+{
+    pImpl->makeDense();
+    return &pImpl->map;
+}
+
 DnfSack *PackageSet::getSack() const { return pImpl->sack; }
-size_t PackageSet::size() const { return map_count(&pImpl->map); }
+
+size_t
+PackageSet::size() const
+{
+    if (!pImpl->dense)
+        return pImpl->ids.size();
+    return map_count(&pImpl->map);
+}
+
+void
+PackageSet::compact()
+{
+    if (!pImpl->dense || pImpl->mapHandedOut)
+        return;
+    auto count = map_count(&pImpl->map);
+    if (count > pImpl->sparseLimit())
+        return;
+    std::vector<Id> ids;
+    ids.reserve(count);
+    for (Id id = next(-1); id != -1; id = next(id))
+        ids.push_back(id);
+    pImpl->ids.swap(ids);
+    map_free(&pImpl->map);
+    map_init(&pImpl->map, 0);
+    pImpl->dense = false;
+}
 
 Id PackageSet::next(Id previous) const
 {
+    if (!pImpl->dense) {
+        auto & ids = pImpl->ids;
+        auto it = std::upper_bound(ids.begin(), ids.end(), previous);
+        return it == ids.end() ? -1 : *it;
+    }
+
     const unsigned char *ti = pImpl->map.map;
     const unsigned char *end = ti + pImpl->map.size;
     Id id;
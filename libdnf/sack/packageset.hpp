@@ -50,10 +50,34 @@ public:
     bool has(DnfPackage *pkg) const;
     bool has(Id id) const;
     void remove(Id id);
+
+    /**
+    * @brief Returns the set as a bitmap of pool size
+    *
+    * Small sets are kept as sorted arrays of ids and converted to the bitmap on the first call.
+    * The conversion does not change the content of the set. The set stays a bitmap from then
+    * on, so the returned Map stays valid until the set is destroyed.
+    */
     Map *getMap() const;
+
+    /**
+    * @brief Returns the set as a bitmap of pool size for modification
+    *
+    * Like getMap(), but the returned Map is only valid until the set is destroyed or
+    * compacted. Meant for code that fills the set through the bitmap and compacts it after.
+    */
+    Map *getMutableMap();
     DnfSack *getSack() const;
     size_t size() const;
 
+    /**
+    * @brief Converts a small set back from the bitmap to a sorted array of ids
+    *
+    * Invalidates Map pointers returned by getMutableMap(). Does nothing once getMap() was
+    * called.
+    */
+    void compact();
+
     /**
     * @brief Returns next id in packageset or -1 if end of package set reached
     *
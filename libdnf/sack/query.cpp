@@ -22,7 +22,12 @@
 
 #include <algorithm>
 #include <assert.h>
+#include <atomic>
 #include <fnmatch.h>
+#include <limits>
+#include <map>
+#include <system_error>
+#include <thread>
 #include <vector>
 
 extern "C" {
@@ -39,16 +44,22 @@ extern "C" {
 #include "../nevra.hpp"
 #include "../hy-query-private.hpp"
 #include "../dnf-sack-private.hpp"
+#include "../dnf-context.hpp"
 #include "../dnf-advisorypkg.h"
 #include "../dnf-advisory-private.hpp"
 #include "../goal/IdQueue.hpp"
 #include "../goal/Goal-private.hpp"
 #include "advisory.hpp"
 #include "advisorypkg.hpp"
+#include "fileindex.hpp"
 #include "packageset.hpp"
+#include "textindex.hpp"
 
 #include "libdnf/repo/solvable/Dependency.hpp"
 #include "libdnf/repo/solvable/DependencyContainer.hpp"
+#include "libdnf/utils/Instrumentation.hpp"
+#include "libdnf/utils/tinyformat/tinyformat.hpp"
+#include "libdnf/log.hpp"
 
 
 namespace std {
@@ -189,25 +200,6 @@ NameArchSolvableComparator(const Solvable * first, const Solvable * second)
     return first->arch < second->arch;
 }
 
-static bool
-NamePrioritySolvableKey(const Solvable * first, const Solvable * second)
-{
-    if (first->name != second->name)
-        return first->name < second->name;
-    return first->repo->priority > second->repo->priority;
-}
-
-static bool
-NameArchPrioritySolvableKey(const Solvable * first, const Solvable * second)
-{
-    if (first->name != second->name)
-        return first->name < second->name;
-    if (first->arch != second->arch) {
-        return first->arch < second->arch;
-    }
-    return first->repo->priority > second->repo->priority;
-}
-
 struct NameArchEVRComparator {
    NameArchEVRComparator(Pool * pool) : pool(pool) {};
    bool operator()(const Solvable * first, const Solvable * second) {
@@ -417,6 +409,184 @@ di_keyname2id(int keyname)
     }
 }
 
+/**
+* @brief Sets solvables that can match the pattern in candidates using text indexes of the repos
+*
+* All solvables of repos without an index are candidates.
+*
+* @return false if no repo provides a usable index and all solvables have to be searched
+*/
+static bool
+textIndexCandidates(DnfSack * sack, Id keyname, int cmpType, const char * match, Map * candidates)
+{
+    Pool * pool = dnf_sack_get_pool(sack);
+    bool used = false;
+    ::Repo * repo;
+    Id repoId;
+
+    map_empty(candidates);
+    FOR_REPOS(repoId, repo) {
+        auto index = TextIndex::getForRepo(sack, repo);
+        if (index && index->addCandidates(keyname, cmpType, match, candidates)) {
+            used = true;
+            continue;
+        }
+        for (Id id = repo->start; id < repo->end; ++id) {
+            if (pool->solvables[id].repo == repo)
+                MAPSET(candidates, id);
+        }
+    }
+    return used;
+}
+
+/// Candidates below this count are filtered on the calling thread
+constexpr std::size_t PARALLEL_FILTER_MIN_PACKAGES = 4096;
+/// Limit of the automatically chosen number of threads
+constexpr unsigned PARALLEL_FILTER_MAX_THREADS = 8;
+/// Chunks per thread, more chunks even out differences in the cost of packages
+constexpr unsigned PARALLEL_FILTER_CHUNKS_PER_THREAD = 4;
+
+/**
+* @brief Returns the number of threads used to filter the candidates
+*
+* The count comes from the query_threads option of the main configuration, 0 selects the number
+* of CPUs.
+*/
+static unsigned
+filterThreads(const PackageSet * candidates)
+{
+    auto size = candidates->size();
+    if (size < PARALLEL_FILTER_MIN_PACKAGES)
+        return 1;
+    unsigned threads = getGlobalMainConfig().query_threads().getValue();
+    if (threads == 0)
+        threads = std::min(std::thread::hardware_concurrency(), PARALLEL_FILTER_MAX_THREADS);
+    // every thread gets at least half of the minimum
+    threads = std::min<std::size_t>(threads, size / (PARALLEL_FILTER_MIN_PACKAGES / 2));
+    return std::max(threads, 1u);
+}
+
+/**
+* @brief Sets the candidates for which match(id) returns true in m
+*
+* With more than one thread the id range is split into chunks of whole 64 bit words of m, so
+* threads never write to the same word. Every thread evaluates its own copy of match, which must
+* only read from the pool; functions using the pool temporary space or loading paged repodata
+* are not safe.
+*/
+template<typename Match>
+static void
+filterCandidates(const PackageSet * candidates, Map * m, unsigned threads, const Match & match)
+{
+    Id total = m->size << 3;
+    auto evaluate = [candidates, m](Match & localMatch, Id begin, Id end) {
+        for (Id id = candidates->next(begin - 1); id != -1 && id < end; id = candidates->next(id)) {
+            if (localMatch(id))
+                MAPSET(m, id);
+        }
+    };
+    if (threads <= 1) {
+        Match localMatch(match);
+        evaluate(localMatch, 0, total);
+        return;
+    }
+
+    unsigned chunks = threads * PARALLEL_FILTER_CHUNKS_PER_THREAD;
+    Id chunkSize = ((total + chunks - 1) / chunks + 63) & ~63;
+    std::atomic<unsigned> nextChunk{0};
+    auto worker = [&]() {
+        Match localMatch(match);
+        for (unsigned chunk = nextChunk++; chunk < chunks; chunk = nextChunk++) {
+            Id begin = chunk * chunkSize;
+            if (begin >= total)
+                break;
+            evaluate(localMatch, begin, std::min(total, begin + chunkSize));
+        }
+    };
+    Instrumentation::count("query.parallel_filters", 1);
+    std::vector<std::thread> workers;
+    try {
+        for (unsigned i = 1; i < threads; ++i)
+            workers.emplace_back(worker);
+    } catch (const std::system_error &) {
+        // chunks not taken by the started threads are filtered by the calling thread below
+    }
+    worker();
+    for (auto & thread : workers)
+        thread.join();
+}
+
+/// Candidates covering at least 1/POOL_ITERATOR_MIN_SHARE of the pool are matched by one iterator
+constexpr std::size_t POOL_ITERATOR_MIN_SHARE = 4;
+
+/**
+* @brief Returns whether one iterator over the whole pool is cheaper than one per candidate
+*
+* The pool iterator visits every solvable having the key, so it only pays off when the
+* candidates are a large part of the pool.
+*/
+static bool
+usePoolIterator(const Pool * pool, const PackageSet * candidates)
+{
+    return candidates->size() * POOL_ITERATOR_MIN_SHARE >= static_cast<std::size_t>(pool->nsolvables);
+}
+
+/**
+* @brief Loads repodata stored in pages of .solv files that holds the keyname
+*
+* Pages are otherwise read on demand, which is not safe from multiple threads.
+*/
+static void
+loadPagedRepodata(Pool * pool, Id keyname)
+{
+    ::Repo * repo;
+    Id repoId;
+    Repodata * data;
+    int dataId;
+
+    FOR_REPOS(repoId, repo) {
+        FOR_REPODATAS(repo, dataId, data) {
+            if (repodata_has_keyname(data, keyname))
+                repodata_disable_paging(data);
+        }
+    }
+}
+
+/// Splits an evr like pool_split_evr() without using the pool temporary space
+static void
+splitVersionRelease(const char * evr, std::string & version, std::string & release)
+{
+    if (*evr == '\0') {
+        version.clear();
+        release.clear();
+        return;
+    }
+    const char * e = evr + 1;
+    while (*e != ':' && *e != '-' && *e != '\0')
+        ++e;
+    const char * v = evr;
+    if (*e == ':') {
+        v = e + 1;
+        e = *v ? strchr(v + 1, '-') : nullptr;
+    }
+    if (!e || *e == '\0') {
+        version.assign(v);
+        release.clear();
+        return;
+    }
+    version.assign(v, e - v);
+    release.assign(e + 1);
+}
+
+/// Smaller sets are matched against their file lists directly, without building the file index
+constexpr std::size_t FILE_INDEX_MIN_PACKAGES = 64;
+
+/// Size of the first range of Ids filtered by streaming, every next range is twice as large
+constexpr Id STREAM_FIRST_RANGE = 1024;
+
+/// Smaller sets look for obsoleted packages through their own obsoletes, without the reverse index
+constexpr std::size_t OBSOLETES_INDEX_MIN_PACKAGES = 256;
+
 static int
 type2flags(int type, int keyname)
 {
@@ -498,61 +668,27 @@ pool_solvable_epoch_optional_2str(Pool *pool, const Solvable *s, gboolean with_e
     return output_string;
 }
 
-static int
-filter_latest_sortcmp(const void *ap, const void *bp, void *dp)
+/**
+* @brief Returns the highest repo priority of solvables in pset for every name, or name and arch,
+* group of the index
+*
+* @param skipInstalled installed solvables do not count
+*/
+static std::vector<int>
+highestPriorityByGroup(Pool * pool, const PackageSet * pset, const NameArchIndex * index,
+    bool byArch, bool skipInstalled)
 {
-    auto pool = static_cast<Pool *>(dp);
-    Solvable *sa = pool->solvables + *(Id *)ap;
-    Solvable *sb = pool->solvables + *(Id *)bp;
-    int r;
-    r = sa->name - sb->name;
-    if (r)
-        return r;
-    r = pool_evrcmp(pool, sb->evr, sa->evr, EVRCMP_COMPARE);
-    if (r)
-        return r;
-    return *(Id *)ap - *(Id *)bp;
-}
-
-static int
-filter_latest_sortcmp_byarch(const void *ap, const void *bp, void *dp)
-{
-    auto pool = static_cast<Pool *>(dp);
-    Solvable *sa = pool->solvables + *(Id *)ap;
-    Solvable *sb = pool->solvables + *(Id *)bp;
-    int r;
-    r = sa->name - sb->name;
-    if (r)
-        return r;
-    r = sa->arch - sb->arch;
-    if (r)
-        return r;
-    r = pool_evrcmp(pool, sb->evr, sa->evr, EVRCMP_COMPARE);
-    if (r)
-        return r;
-    return *(Id *)ap - *(Id *)bp;
-}
-
-static int
-filter_latest_sortcmp_byarch_bypriority(const void *ap, const void *bp, void *dp)
-{
-    auto pool = static_cast<Pool *>(dp);
-    Solvable *sa = pool->solvables + *(Id *)ap;
-    Solvable *sb = pool->solvables + *(Id *)bp;
-    int r;
-    r = sa->name - sb->name;
-    if (r)
-        return r;
-    r = sa->arch - sb->arch;
-    if (r)
-        return r;
-    r = sb->repo->priority - sa->repo->priority;
-    if (r)
-        return r;
-    r = pool_evrcmp(pool, sb->evr, sa->evr, EVRCMP_COMPARE);
-    if (r)
-        return r;
-    return *(Id *)ap - *(Id *)bp;
+    auto groups = byArch ? index->nameArchGroupCount() : index->nameGroupCount();
+    std::vector<int> priorities(groups, std::numeric_limits<int>::min());
+    Id id = -1;
+    while ((id = pset->next(id)) != -1) {
+        Solvable * s = pool_id2solvable(pool, id);
+        if (skipInstalled && s->repo == pool->installed)
+            continue;
+        auto & priority = priorities[byArch ? index->nameArchGroup(id) : index->nameGroup(id)];
+        priority = std::max(priority, s->repo->priority);
+    }
+    return priorities;
 }
 
 /**
@@ -784,9 +920,26 @@ private:
     bool applied{0};
     DnfSack *sack;
     Query::ExcludeFlags flags;
-    std::unique_ptr<PackageSet> result;
+    /// Shared by copies of the query until one of them modifies it
+    std::shared_ptr<PackageSet> result;
+    /// A mutable pointer to result was handed out, copies of the query must not share it
+    bool resultExposed{false};
     std::vector<Filter> filters;
     void apply();
+    template<typename Callback>
+    bool stream(const Callback & callback);
+    /**
+    * @brief Returns the result for modification. A result shared with another query is
+    * copied first.
+    */
+    PackageSet * getMutableResult();
+    /**
+    * @brief Returns the result for modification by the caller. The result is unshared and
+    * later copies of the query get their own copy of it.
+    */
+    PackageSet * exposeResult();
+    /// Returns result, or a copy of it when it is exposed
+    std::shared_ptr<PackageSet> shareResult() const;
     Map *considered_cached = nullptr;
 
     /**
@@ -824,7 +977,7 @@ private:
     void filterUpdownAble(const Filter  &f, Map *m);
     void filterDataiterator(const Filter & f, Map *m);
     int filterUnneededOrSafeToRemove(const Swdb &swdb, bool debug_solver, bool safeToRemove);
-    void obsoletesByPriority(Pool * pool, Solvable * candidate, Map * m, const Map * target, int obsprovides);
+    void matchObsoleters(const PackageSet * candidates, const PackageSet * target, Map * m);
 
     bool isGlob(const std::vector<const char *> &matches) const;
 };
@@ -842,12 +995,9 @@ Query::Impl::Impl(const Query::Impl & src)
 : applied(src.applied)
 , sack(src.sack)
 , flags(src.flags)
+, result(src.shareResult())
 , filters(src.filters)
-{
-    if (src.result) {
-        result.reset(new PackageSet(*src.result.get()));
-    }
-}
+{}
 
 Query::Impl &
 Query::Impl::operator=(const Query::Impl & src)
@@ -856,34 +1006,66 @@ Query::Impl::operator=(const Query::Impl & src)
     sack = src.sack;
     flags = src.flags;
     filters = src.filters;
-    if (src.result) {
-        result.reset(new PackageSet(*src.result.get()));
-    } else {
-        result.reset();
-    }
+    result = src.shareResult();
+    resultExposed = false;
     return *this;
 }
 
+PackageSet *
+Query::Impl::getMutableResult()
+{
+    if (result.use_count() > 1)
+        result = std::make_shared<PackageSet>(*result);
+    return result.get();
+}
+
+PackageSet *
+Query::Impl::exposeResult()
+{
+    auto mutableResult = getMutableResult();
+    resultExposed = true;
+    return mutableResult;
+}
+
+std::shared_ptr<PackageSet>
+Query::Impl::shareResult() const
+{
+    if (resultExposed && result)
+        return std::make_shared<PackageSet>(*result);
+    return result;
+}
+
 Query::Query(const Query & query_src) : pImpl(new Impl(*query_src.pImpl)) {}
+Query::Query(Query && query_src) noexcept = default;
 Query::Query(DnfSack *sack, Query::ExcludeFlags flags) : pImpl(new Impl(sack, flags)) {}
 Query::~Query() = default;
 
-Query & Query::operator=(const Query & query_src) { *pImpl = *query_src.pImpl; return *this; }
+Query &
+Query::operator=(const Query & query_src)
+{
+    if (pImpl)
+        *pImpl = *query_src.pImpl;
+    else
+        pImpl.reset(new Impl(*query_src.pImpl));
+    return *this;
+}
+
+Query & Query::operator=(Query && src_query) noexcept = default;
 
 Map *
-Query::getResult() noexcept
+Query::getResult()
 {
     if (pImpl->result)
-        return pImpl->result->getMap();
+        return pImpl->exposeResult()->getMap();
     else
         return nullptr;
 }
 
-const Map * Query::getResult() const noexcept { return pImpl->result->getMap(); }
+const Map * Query::getResult() const noexcept { return pImpl->result ? pImpl->result->getMap() : nullptr; }
 PackageSet * Query::getResultPset()
 {
     pImpl->apply();
-    return pImpl->result.get();
+    return pImpl->exposeResult();
 }
 bool Query::getApplied() const noexcept { return pImpl->applied; }
 DnfSack * Query::getSack() { return pImpl->sack; }
@@ -893,6 +1075,7 @@ Query::clear()
 {
     pImpl->applied = false;
     pImpl->result.reset();
+    pImpl->resultExposed = false;
     pImpl->filters.clear();
 }
 
@@ -1106,7 +1289,7 @@ Query::Impl::filterNevraStrict(int cmpType, const char **matches)
     }
     if (compareSet.empty()) {
         if (!(cmpType & HY_NOT))
-            map_empty(result->getMap());
+            map_empty(getMutableResult()->getMutableMap());
         return;
     }
     Map nevraResult;
@@ -1187,9 +1370,9 @@ Query::Impl::filterNevraStrict(int cmpType, const char **matches)
         }
     }
     if (cmpType & HY_NOT)
-        map_subtract(result->getMap(), &nevraResult);
+        map_subtract(getMutableResult()->getMutableMap(), &nevraResult);
     else
-        map_and(result->getMap(), &nevraResult);
+        map_and(getMutableResult()->getMutableMap(), &nevraResult);
     map_free(&nevraResult);
 }
 
@@ -1199,22 +1382,23 @@ Query::Impl::initResult()
     Pool *pool = dnf_sack_get_pool(sack);
     Id solvid;
     int sack_pool_nsolvables = dnf_sack_get_pool_nsolvables(sack);
+    resultExposed = false;
     if (sack_pool_nsolvables != 0 && sack_pool_nsolvables == pool->nsolvables)
         result.reset(dnf_sack_get_pkg_solvables(sack));
     else {
         result.reset(new PackageSet(sack));
         FOR_PKG_SOLVABLES(solvid)
             result->set(solvid);
-        dnf_sack_set_pkg_solvables(sack, result->getMap(), pool->nsolvables);
+        dnf_sack_set_pkg_solvables(sack, result->getMutableMap(), pool->nsolvables);
     }
     if (flags == Query::ExcludeFlags::APPLY_EXCLUDES) {
         dnf_sack_recompute_considered(sack);
         if (pool->considered)
-            map_and(result->getMap(), pool->considered);
+            map_and(result->getMutableMap(), pool->considered);
     } else {
         dnf_sack_recompute_considered_map(sack, &considered_cached, flags);
         if (considered_cached) {
-            map_and(result->getMap(), considered_cached);
+            map_and(result->getMutableMap(), considered_cached);
         }
     }
 }
@@ -1270,32 +1454,33 @@ Query::Impl::filterRcoReldep(const Filter & f, Map *m)
 {
     assert(f.getMatchType() == _HY_RELDEP);
 
-    Pool *pool = dnf_sack_get_pool(sack);
-    Id rco_key = reldep_keyname2id(f.getKeyname());
-    Queue rco;
-    auto resultPset = result.get();
+    /// Matches solvables with a dependency of the key that matches one of the reldeps
+    struct RcoMatch {
+        Pool * pool;
+        Id rcoKey;
+        const std::vector<_Match> * matches;
+        IdQueue rco;
 
-    queue_init(&rco);
-    Id resultId = -1;
-    while ((resultId = resultPset->next(resultId)) != -1) {
-        Solvable *s = pool_id2solvable(pool, resultId );
-        for (auto match : f.getMatches()) {
-            Id reldepFilterId = match.reldep;
-
-            queue_empty(&rco);
-            solvable_lookup_idarray(s, rco_key, &rco);
-            for (int j = 0; j < rco.count; ++j) {
-                Id reldepIdFromSolvable = rco.elements[j];
-
-                if (pool_match_dep(pool, reldepFilterId, reldepIdFromSolvable )) {
-                    MAPSET(m, resultId );
-                    goto nextId;
+        bool operator()(Id id)
+        {
+            Solvable *s = pool_id2solvable(pool, id);
+            for (auto match : *matches) {
+                Id reldepFilterId = match.reldep;
+
+                queue_empty(rco.getQueue());
+                solvable_lookup_idarray(s, rcoKey, rco.getQueue());
+                for (int j = 0; j < rco.size(); ++j) {
+                    if (pool_match_dep(pool, reldepFilterId, rco[j]))
+                        return true;
                 }
             }
+            return false;
         }
-        nextId:;
-    }
-    queue_free(&rco);
+    };
+
+    auto resultPset = result.get();
+    RcoMatch match{dnf_sack_get_pool(sack), reldep_keyname2id(f.getKeyname()), &f.getMatches(), {}};
+    filterCandidates(resultPset, m, filterThreads(resultPset), match);
 }
 
 void
@@ -1349,47 +1534,28 @@ Query::Impl::filterName(const Filter & f, Map *m)
         return;
     }
     
+    auto threads = filterThreads(resultPset);
     for (auto match_union : f.getMatches()) {
         const char *match = match_union.str;
-        Id id = -1;
-        while (true) {
-            id = resultPset->next(id);
-            if (id == -1)
-                break;
-
+        filterCandidates(resultPset, m, threads, [pool, cmpType, match](Id id) {
             Solvable *s = pool_id2solvable(pool, id);
+            const char *name = pool_id2str(pool, s->name);
             if (cmpType & HY_ICASE) {
-                const char *name = pool_id2str(pool, s->name);
-                if (cmpType & HY_SUBSTR) {
-                    if (strcasestr(name, match) != NULL)
-                        MAPSET(m, id);
-                    continue;
-                }
-                if (cmpType & HY_EQ) {
-                    if (strcasecmp(name, match) == 0)
-                        MAPSET(m, id);
-                    continue;
-                }
-                if (cmpType & HY_GLOB) {
-                    if (fnmatch(match, name, FNM_CASEFOLD) == 0)
-                        MAPSET(m, id);
-                    continue;
-                }
-                continue;
+                if (cmpType & HY_SUBSTR)
+                    return strcasestr(name, match) != NULL;
+                if (cmpType & HY_EQ)
+                    return strcasecmp(name, match) == 0;
+                if (cmpType & HY_GLOB)
+                    return fnmatch(match, name, FNM_CASEFOLD) == 0;
+                return false;
             }
 
-            const char *name = pool_id2str(pool, s->name);
-            if (cmpType & HY_GLOB) {
-                if (fnmatch(match, name, 0) == 0)
-                    MAPSET(m, id);
-                continue;
-            }
-            if (cmpType & HY_SUBSTR) {
-                if (strstr(name, match) != NULL)
-                    MAPSET(m, id);
-                continue;
-            }
-        }
+            if (cmpType & HY_GLOB)
+                return fnmatch(match, name, 0) == 0;
+            if (cmpType & HY_SUBSTR)
+                return strstr(name, match) != NULL;
+            return false;
+        });
     }
 }
 
@@ -1495,8 +1661,22 @@ Query::Impl::filterVersion(const Filter & f, Map *m)
     int cmp_type = f.getCmpType();
     auto resultPset = result.get();
 
+    auto threads = (cmp_type & HY_GLOB) ? filterThreads(resultPset) : 1;
     for (auto match_in : f.getMatches()) {
         const char *match = match_in.str;
+        if (cmp_type & HY_GLOB) {
+            filterCandidates(resultPset, m, threads, [pool, match](Id id) {
+                Solvable *s = pool_id2solvable(pool, id);
+                if (s->evr == ID_EMPTY)
+                    return false;
+                std::string version;
+                std::string release;
+                splitVersionRelease(pool_id2str(pool, s->evr), version, release);
+                return fnmatch(match, version.c_str(), 0) == 0;
+            });
+            continue;
+        }
+
         char *filter_vr = solv_dupjoin(match, "-0", NULL);
 
         Id id = -1;
@@ -1512,12 +1692,6 @@ Query::Impl::filterVersion(const Filter & f, Map *m)
 
             pool_split_evr(pool, evr, &e, &v, &r);
 
-            if (cmp_type & HY_GLOB) {
-                if (fnmatch(match, v, 0) == 0)
-                    MAPSET(m, id);
-                continue;
-            }
-
             char *vr = pool_tmpjoin(pool, v, "-0", NULL);
             int cmp = pool_evrcmp_str(pool, vr, filter_vr, EVRCMP_COMPARE);
             if ((cmp > 0 && cmp_type & HY_GT) ||
@@ -1537,8 +1711,22 @@ Query::Impl::filterRelease(const Filter & f, Map *m)
     int cmp_type = f.getCmpType();
     auto resultPset = result.get();
 
+    auto threads = (cmp_type & HY_GLOB) ? filterThreads(resultPset) : 1;
     for (auto match_in : f.getMatches()) {
         const char *match = match_in.str;
+        if (cmp_type & HY_GLOB) {
+            filterCandidates(resultPset, m, threads, [pool, match](Id id) {
+                Solvable *s = pool_id2solvable(pool, id);
+                if (s->evr == ID_EMPTY)
+                    return false;
+                std::string version;
+                std::string release;
+                splitVersionRelease(pool_id2str(pool, s->evr), version, release);
+                return fnmatch(match, release.c_str(), 0) == 0;
+            });
+            continue;
+        }
+
         char *filter_vr = solv_dupjoin("0-", match, NULL);
 
         Id id = -1;
@@ -1554,12 +1742,6 @@ Query::Impl::filterRelease(const Filter & f, Map *m)
 
             pool_split_evr(pool, evr, &e, &v, &r);
 
-            if (cmp_type & HY_GLOB) {
-                if (fnmatch(match, r, 0) == 0)
-                    MAPSET(m, id);
-                continue;
-            }
-
             char *vr = pool_tmpjoin(pool, "0-", r, NULL);
 
             int cmp = pool_evrcmp_str(pool, vr, filter_vr, EVRCMP_COMPARE);
@@ -1645,18 +1827,41 @@ Query::Impl::filterSourcerpm(const Filter & f, Map *m)
 void
 Query::Impl::filterObsoletes(const Filter & f, Map *m)
 {
-    Pool *pool = dnf_sack_get_pool(sack);
-    int obsprovides = pool_get_flag(pool, POOL_FLAG_OBSOLETEUSESPROVIDES);
-    Map *target;
-    auto resultPset = result.get();
-
     assert(f.getMatchType() == _HY_PKG);
     assert(f.getMatches().size() == 1);
-    target = dnf_packageset_get_map(f.getMatches()[0].pset);
+    matchObsoleters(result.get(), f.getMatches()[0].pset, m);
+}
+
+/**
+* @brief Sets candidates that obsolete a package in target in m
+*
+* Large sets of candidates look up obsoleters of the target packages in the obsoletes index
+* of the sack instead of expanding obsoletes of every candidate.
+*/
+void
+Query::Impl::matchObsoleters(const PackageSet * candidates, const PackageSet * target, Map * m)
+{
+    Pool *pool = dnf_sack_get_pool(sack);
+
     dnf_sack_make_provides_ready(sack);
+    if (candidates->size() >= OBSOLETES_INDEX_MIN_PACKAGES) {
+        auto index = dnf_sack_get_obsoletes_index(sack);
+        Id id = -1;
+        while ((id = target->next(id)) != -1) {
+            assert(id != SYSTEMSOLVABLE);
+            auto obsoleters = index->obsoleters(id);
+            for (auto obsoleter = obsoleters.first; obsoleter != obsoleters.second; ++obsoleter) {
+                if (candidates->has(*obsoleter))
+                    MAPSET(m, *obsoleter);
+            }
+        }
+        return;
+    }
+
+    int obsprovides = pool_get_flag(pool, POOL_FLAG_OBSOLETEUSESPROVIDES);
     Id id = -1;
     while (true) {
-        id = resultPset->next(id);
+        id = candidates->next(id);
         if (id == -1)
             break;
         Solvable *s = pool_id2solvable(pool, id);
@@ -1666,7 +1871,7 @@ Query::Impl::filterObsoletes(const Filter & f, Map *m)
             Id r, rr;
 
             FOR_PROVIDES(r, rr, *r_id) {
-                if (!MAPTST(target, r))
+                if (!target->has(r))
                     continue;
                 assert(r != SYSTEMSOLVABLE);
                 Solvable *so = pool_id2solvable(pool, r);
@@ -1679,63 +1884,31 @@ Query::Impl::filterObsoletes(const Filter & f, Map *m)
     }
 }
 
-void
-Query::Impl::obsoletesByPriority(Pool * pool, Solvable * candidate, Map * m, const Map * target, int obsprovides)
-{
-    if (!candidate->repo)
-        return;
-    for (Id *r_id = candidate->repo->idarraydata + candidate->obsoletes; *r_id; ++r_id) {
-        Id r, rr;
-        FOR_PROVIDES(r, rr, *r_id) {
-            if (!MAPTST(target, r))
-                continue;
-            assert(r != SYSTEMSOLVABLE);
-            Solvable *so = pool_id2solvable(pool, r);
-            if (!obsprovides && !pool_match_nevr(pool, so, *r_id))
-                continue; /* only matching pkg names */
-            MAPSET(m, pool_solvable2id(pool, candidate));
-            break;
-        }
-    }
-}
-
 void
 Query::Impl::filterObsoletesByPriority(const Filter & f, Map *m)
 {
     Pool *pool = dnf_sack_get_pool(sack);
-    int obsprovides = pool_get_flag(pool, POOL_FLAG_OBSOLETEUSESPROVIDES);
-    Map *target;
     auto resultPset = result.get();
 
     assert(f.getMatchType() == _HY_PKG);
     assert(f.getMatches().size() == 1);
-    target = dnf_packageset_get_map(f.getMatches()[0].pset);
-    dnf_sack_make_provides_ready(sack);
-    std::vector<Solvable *> obsoleteCandidates;
-    obsoleteCandidates.reserve(resultPset->size());
+    if (resultPset->empty()) {
+        return;
+    }
+    // only installed packages and packages from the repos with the highest priority for their
+    // name can obsolete
+    auto index = dnf_sack_get_name_arch_index(sack);
+    auto priorities = highestPriorityByGroup(pool, resultPset, index, false, false);
+    PackageSet candidates(sack);
     Id id = -1;
     while ((id = resultPset->next(id)) != -1) {
         Solvable *candidate = pool_id2solvable(pool, id);
-        obsoleteCandidates.push_back(candidate);
-    }
-    if (obsoleteCandidates.empty()) {
-        return;
-    }
-    std::sort(obsoleteCandidates.begin(), obsoleteCandidates.end(), NamePrioritySolvableKey);
-    Id name = 0;
-    int priority = 0;
-    for (auto * candidate: obsoleteCandidates) {
-        if (candidate->repo == pool->installed) {
-            obsoletesByPriority(pool, candidate, m, target, obsprovides);
-        }
-        if (name != candidate->name) {
-            name = candidate->name;
-            priority = candidate->repo->priority;
-            obsoletesByPriority(pool, candidate, m, target, obsprovides);
-        } else if (priority == candidate->repo->priority) {
-            obsoletesByPriority(pool, candidate, m, target, obsprovides);
+        if (candidate->repo == pool->installed ||
+            candidate->repo->priority == priorities[index->nameGroup(id)]) {
+            candidates.set(id);
         }
     }
+    matchObsoleters(&candidates, f.getMatches()[0].pset, m);
 }
 
 void
@@ -1882,6 +2055,7 @@ Query::Impl::filterAdvisory(const Filter & f, Map *m, int keyname)
             candidates.push_back(pool_id2solvable(pool, id));
         }
         NameArchEVRComparator cmp_key(pool);
+        auto index = dnf_sack_get_name_arch_index(sack);
 
         if (cmp_type & HY_UPGRADE) {
             Query installed(sack, ExcludeFlags::IGNORE_EXCLUDES);
@@ -1896,27 +2070,27 @@ Query::Impl::filterAdvisory(const Filter & f, Map *m, int keyname)
 
             // Apply security filters only to packages with lower priority - to unify behaviour upgrade
             // and upgrade-minimal
-            std::sort(candidates.begin(), candidates.end(), NameArchPrioritySolvableKey);
+            auto priorities = highestPriorityByGroup(pool, resultPset, index, true, true);
             std::vector<Solvable *> priority_candidates;
-            Id name = 0;
-            Id arch = 0;
-            int priority = 0;
 
             for (auto * candidate: candidates) {
-                if (candidate->repo == pool->installed) {
-                    priority_candidates.push_back(candidate);
-                } else if (name != candidate->name || arch != candidate->arch) {
-                    name = candidate->name;
-                    arch = candidate->arch;
-                    priority = candidate->repo->priority;
-                    priority_candidates.push_back(candidate);
-                } else if (priority == candidate->repo->priority) {
+                Id candidate_id = pool_solvable2id(pool, candidate);
+                if (candidate->repo == pool->installed ||
+                    candidate->repo->priority == priorities[index->nameArchGroup(candidate_id)]) {
                     priority_candidates.push_back(candidate);
                 }
             }
             std::swap(candidates, priority_candidates);
         }
-        std::sort(candidates.begin(), candidates.end(), cmp_key);
+        // order of cmp_key, by name, arch and ascending evr
+        std::sort(candidates.begin(), candidates.end(),
+                  [pool, index](const Solvable * first, const Solvable * second) {
+            Id first_id = pool_solvable2id(pool, first);
+            Id second_id = pool_solvable2id(pool, second);
+            if (index->nameArchGroup(first_id) != index->nameArchGroup(second_id))
+                return index->nameArchGroup(first_id) < index->nameArchGroup(second_id);
+            return index->nameArchRank(first_id) > index->nameArchRank(second_id);
+        });
         for (auto & advisoryPkg : pkgs) {
             if (cmp_type & HY_UPGRADE) {
                 // skip advisory pkgs that have lower evr than installed version - important for upgrade logic
@@ -1994,15 +2168,15 @@ Query::Impl::filterLatest(const Filter & f, Map *m)
             queue_push(&samename, id);
         }
 
+        auto index = dnf_sack_get_name_arch_index(sack);
+        Id * first = samename.elements;
+        Id * last = samename.elements + samename.count;
         if (keyname == HY_PKG_LATEST_PER_ARCH) {
-            solv_sort(samename.elements, samename.count, sizeof(Id),
-                      filter_latest_sortcmp_byarch, pool);
+            index->sortByNameArch(first, last);
         } else if (keyname == HY_PKG_LATEST_PER_ARCH_BY_PRIORITY) {
-            solv_sort(samename.elements, samename.count, sizeof(Id),
-                      filter_latest_sortcmp_byarch_bypriority, pool);
+            index->sortByNameArchPriority(pool, first, last);
         } else {
-            solv_sort(samename.elements, samename.count, sizeof(Id),
-                      filter_latest_sortcmp, pool);
+            index->sortByName(first, last);
         }
 
         // Create blocks per name, arch and repo priority
@@ -2094,34 +2268,16 @@ Query::Impl::filterUpdownByPriority(const Filter & f, Map *m)
     for (auto match_in : f.getMatches()) {
         if (match_in.num == 0)
             continue;
-        std::vector<Solvable *> upgradeCandidates;
-        upgradeCandidates.reserve(resultPset->size());
+        auto index = dnf_sack_get_name_arch_index(sack);
+        auto priorities = highestPriorityByGroup(pool, resultPset, index, false, true);
         Id id = -1;
         while ((id = resultPset->next(id)) != -1) {
             Solvable *candidate = pool_id2solvable(pool, id);
             if (candidate->repo == repoInstalled)
                 continue;
-            upgradeCandidates.push_back(candidate);
-        }
-        if (upgradeCandidates.empty()) {
-            continue;
-        }
-        std::sort(upgradeCandidates.begin(), upgradeCandidates.end(), NamePrioritySolvableKey);
-        Id name = 0;
-        int priority = 0;
-        for (auto * candidate: upgradeCandidates) {
-            if (name != candidate->name) {
-                name = candidate->name;
-                priority = candidate->repo->priority;
-                id = pool_solvable2id(pool, candidate);
-                if (what_upgrades(pool, id) > 0) {
-                    MAPSET(m, id);
-                }
-            } else if (priority == candidate->repo->priority) {
-                id = pool_solvable2id(pool, candidate);
-                if (what_upgrades(pool, id) > 0) {
-                    MAPSET(m, id);
-                }
+            if (candidate->repo->priority == priorities[index->nameGroup(id)] &&
+                what_upgrades(pool, id) > 0) {
+                MAPSET(m, id);
             }
         }
     }
@@ -2139,7 +2295,7 @@ Query::Impl::filterUpdownAble(const Filter  &f, Map *m)
     if (!pool->installed) {
         return;
     }
-    auto resultMap = result->getMap();
+    auto resultMap = result->getMutableMap();
 
     for (auto match_in : f.getMatches()) {
         if (match_in.num == 0)
@@ -2169,28 +2325,60 @@ void
 Query::Impl::filterDataiterator(const Filter & f, Map *m)
 {
     Pool *pool = dnf_sack_get_pool(sack);
-    Dataiterator di;
     Id keyname = di_keyname2id(f.getKeyname());
     int flags = type2flags(f.getCmpType(), f.getKeyname());
     auto resultPset = result.get();
+    bool indexed = TextIndex::isIndexed(keyname);
+    Map candidates;
 
     assert(f.getMatchType() == _HY_STR);
 
+    int cmpType = f.getCmpType() & ~HY_COMPARISON_FLAG_MASK;
+    if (f.getKeyname() == HY_PKG_FILE && (cmpType == HY_EQ || cmpType == HY_GLOB) &&
+        resultPset->size() > FILE_INDEX_MIN_PACKAGES) {
+        auto fileIndex = dnf_sack_get_file_index(sack);
+        for (auto match_in : f.getMatches())
+            fileIndex->match(match_in.str, f.getCmpType() & ~HY_NOT, m);
+        return;
+    }
+
+    // file names are assembled in the pool temporary space, which is not thread safe
+    unsigned threads = keyname == SOLVABLE_FILELIST ? 1 : filterThreads(resultPset);
+    if (threads > 1)
+        loadPagedRepodata(pool, keyname);
+
+    if (indexed)
+        map_init(&candidates, pool->nsolvables);
     for (auto match_in : f.getMatches()) {
         const char *match = match_in.str;
-        Id id = -1;
-        while (true) {
-            id = resultPset->next(id);
-            if (id == -1)
-                break;
-            dataiterator_init(&di, pool, 0, id, keyname, match, flags);
+        bool useCandidates = indexed && textIndexCandidates(sack, keyname, f.getCmpType(), match,
+                                                            &candidates);
+        if (threads <= 1 && usePoolIterator(pool, resultPset)) {
+            Dataiterator di;
+            dataiterator_init(&di, pool, 0, 0, keyname, match, flags);
             while (dataiterator_step(&di)) {
-                MAPSET(m, id);
-                break;
+                Id id = di.solvid;
+                if (resultPset->has(id) && (!useCandidates || MAPTST(&candidates, id)))
+                    MAPSET(m, id);
+                dataiterator_skip_solvable(&di);
             }
             dataiterator_free(&di);
+            continue;
         }
+        const Map * candidatesMap = &candidates;
+        filterCandidates(resultPset, m, threads,
+                         [pool, keyname, match, flags, useCandidates, candidatesMap](Id id) {
+            if (useCandidates && !MAPTST(candidatesMap, id))
+                return false;
+            Dataiterator di;
+            dataiterator_init(&di, pool, 0, id, keyname, match, flags);
+            bool found = dataiterator_step(&di) != 0;
+            dataiterator_free(&di);
+            return found;
+        });
     }
+    if (indexed)
+        map_free(&candidates);
 }
 
 int
@@ -2231,7 +2419,7 @@ Query::Impl::filterUnneededOrSafeToRemove(const Swdb &swdb, bool debug_solver, b
     for (int i = 0; i < que.size(); ++i) {
         MAPSET(&resultInternal, que[i]);
     }
-    map_and(result->getMap(), &resultInternal);
+    map_and(getMutableResult()->getMutableMap(), &resultInternal);
     map_free(&resultInternal);
     return 0;
 }
@@ -2250,20 +2438,229 @@ bool Query::Impl::isGlob(const std::vector<const char *> &matches) const
 void
 Query::apply() { pImpl->apply(); }
 
+static bool
+mapIsEmpty(const Map * m)
+{
+    for (int i = 0; i < m->size; ++i) {
+        if (m->map[i])
+            return false;
+    }
+    return true;
+}
+
+/// Filters whose result depends on the packages kept by the preceding filters
+static bool
+isOrderDependent(const Filter & f)
+{
+    switch (f.getKeyname()) {
+        case HY_PKG_LATEST:
+        case HY_PKG_LATEST_PER_ARCH:
+        case HY_PKG_LATEST_PER_ARCH_BY_PRIORITY:
+        case HY_PKG_DOWNGRADABLE:
+        case HY_PKG_UPGRADABLE:
+        case HY_PKG_DOWNGRADES:
+        case HY_PKG_UPGRADES:
+        case HY_PKG_UPGRADES_BY_PRIORITY:
+        case HY_PKG_OBSOLETES_BY_PRIORITY:
+            return true;
+        // matched against the closest kept evr and the highest kept repo priority
+        case HY_PKG_ADVISORY:
+        case HY_PKG_ADVISORY_BUG:
+        case HY_PKG_ADVISORY_CVE:
+        case HY_PKG_ADVISORY_SEVERITY:
+        case HY_PKG_ADVISORY_TYPE:
+            return (f.getCmpType() & (HY_EQG | HY_UPGRADE)) != 0;
+        default:
+            return false;
+    }
+}
+
+/// Filters that keep a package only by its own data, whatever other packages the result holds
+static bool
+decidesPerPackage(const Filter & f)
+{
+    switch (f.getKeyname()) {
+        case HY_PKG:
+        case HY_PKG_ARCH:
+        case HY_PKG_CONFLICTS:
+        case HY_PKG_DESCRIPTION:
+        case HY_PKG_EMPTY:
+        case HY_PKG_ENHANCES:
+        case HY_PKG_EPOCH:
+        case HY_PKG_EVR:
+        case HY_PKG_FILE:
+        case HY_PKG_LOCATION:
+        case HY_PKG_NAME:
+        case HY_PKG_NEVRA:
+        case HY_PKG_NEVRA_STRICT:
+        case HY_PKG_OBSOLETES:
+        case HY_PKG_PROVIDES:
+        case HY_PKG_RECOMMENDS:
+        case HY_PKG_RELEASE:
+        case HY_PKG_REPONAME:
+        case HY_PKG_REQUIRES:
+        case HY_PKG_SOURCERPM:
+        case HY_PKG_SUGGESTS:
+        case HY_PKG_SUMMARY:
+        case HY_PKG_SUPPLEMENTS:
+        case HY_PKG_URL:
+        case HY_PKG_VERSION:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/**
+* @brief Estimates the cost of a filter, lower is cheaper or keeps fewer packages
+*
+* The estimate combines the work done per package with the expected selectivity. Exact matches
+* of indexed values come first, full text searches of file lists and advisories come last.
+*/
+static int
+filterCost(const Filter & f)
+{
+    int cmpType = f.getCmpType() & ~HY_COMPARISON_FLAG_MASK;
+    bool exact = cmpType == HY_EQ && !(f.getCmpType() & HY_ICASE);
+    int cost;
+    switch (f.getKeyname()) {
+        case HY_PKG_EMPTY:
+            return 0;
+        case HY_PKG:
+        case HY_PKG_ALL:
+            cost = 10;
+            break;
+        case HY_PKG_NAME:
+            cost = exact ? 10 : 30;
+            break;
+        case HY_PKG_NEVRA:
+        case HY_PKG_NEVRA_STRICT:
+            cost = exact ? 15 : 35;
+            break;
+        case HY_PKG_ARCH:
+        case HY_PKG_EPOCH:
+        case HY_PKG_EVR:
+        case HY_PKG_VERSION:
+        case HY_PKG_RELEASE:
+        case HY_PKG_REPONAME:
+            // exact, but usually shared by many packages
+            cost = 25;
+            break;
+        case HY_PKG_SOURCERPM:
+        case HY_PKG_LOCATION:
+            cost = 35;
+            break;
+        case HY_PKG_PROVIDES:
+        case HY_PKG_CONFLICTS:
+        case HY_PKG_ENHANCES:
+        case HY_PKG_OBSOLETES:
+        case HY_PKG_RECOMMENDS:
+        case HY_PKG_REQUIRES:
+        case HY_PKG_SUGGESTS:
+        case HY_PKG_SUPPLEMENTS:
+            cost = f.getMatchType() == _HY_STR ? 55 : 45;
+            break;
+        case HY_PKG_SUMMARY:
+        case HY_PKG_URL:
+            cost = 60;
+            break;
+        case HY_PKG_DESCRIPTION:
+            cost = 65;
+            break;
+        case HY_PKG_FILE:
+            cost = exact ? 50 : 70;
+            break;
+        case HY_PKG_ADVISORY:
+        case HY_PKG_ADVISORY_BUG:
+        case HY_PKG_ADVISORY_CVE:
+        case HY_PKG_ADVISORY_SEVERITY:
+        case HY_PKG_ADVISORY_TYPE:
+            cost = 80;
+            break;
+        default:
+            cost = 50;
+    }
+    // negated filters remove few packages
+    if (f.getCmpType() & HY_NOT)
+        cost += 5;
+    return cost;
+}
+
+/**
+* @brief Sorts filters by filterCost() between order dependent filters
+*
+* Filters between two order dependent filters only intersect the result or subtract from it,
+* so their order does not change the result. Order dependent filters keep their positions.
+*
+* @return true if the order was changed
+*/
+static bool
+planFilters(std::vector<Filter> & filters)
+{
+    bool changed = false;
+    auto begin = filters.begin();
+    while (begin != filters.end()) {
+        auto end = std::find_if(begin, filters.end(), isOrderDependent);
+        if (end - begin > 1) {
+            std::vector<std::pair<int, Filter>> segment;
+            segment.reserve(end - begin);
+            for (auto it = begin; it != end; ++it)
+                segment.emplace_back(filterCost(*it), *it);
+            if (!std::is_sorted(segment.begin(), segment.end(), [](
+                const std::pair<int, Filter> & a, const std::pair<int, Filter> & b) {
+                    return a.first < b.first; })) {
+                std::stable_sort(segment.begin(), segment.end(), [](
+                    const std::pair<int, Filter> & a, const std::pair<int, Filter> & b) {
+                        return a.first < b.first; });
+                auto it = begin;
+                for (auto & item : segment)
+                    *it++ = item.second;
+                changed = true;
+            }
+        }
+        begin = end == filters.end() ? end : end + 1;
+    }
+    return changed;
+}
+
+static std::string
+describePlan(const std::vector<Filter> & filters)
+{
+    std::string plan;
+    for (const auto & f : filters) {
+        if (!plan.empty())
+            plan += ", ";
+        plan += tfm::format("(key %d, cmp %d, cost %d%s)", f.getKeyname(), f.getCmpType(),
+                            filterCost(f), isOrderDependent(f) ? ", ordered" : "");
+    }
+    return plan;
+}
+
 void
 Query::Impl::apply()
 {
     if (applied)
         return;
 
+    ScopedTimer timer("query.apply");
+    Instrumentation::count("query.filters", filters.size());
     Pool *pool = dnf_sack_get_pool(sack);
     repo_internalize_all_trigger(pool);
     Map m;
     if (!result)
         initResult();
     map_init(&m, pool->nsolvables);
-    assert(m.size == result->getMap()->size);
+    Map * resultMap = filters.empty() ? nullptr : getMutableResult()->getMutableMap();
+    assert(!resultMap || m.size == resultMap->size);
+    if (planFilters(filters)) {
+        auto logger(Log::getLogger());
+        logger->debug("Query plan: " + describePlan(filters));
+    }
     for (auto f : filters) {
+        if (mapIsEmpty(resultMap)) {
+            Instrumentation::count("query.filters_skipped", 1);
+            break;
+        }
         map_empty(&m);
         switch (f.getKeyname()) {
             case HY_PKG:
@@ -2357,16 +2754,72 @@ Query::Impl::apply()
                 filterDataiterator(f, &m);
         }
         if (f.getCmpType() & HY_NOT)
-            map_subtract(result->getMap(), &m);
+            map_subtract(resultMap, &m);
         else
-            map_and(result->getMap(), &m);
+            map_and(resultMap, &m);
     }
     map_free(&m);
+    // small results are kept as id arrays, which makes copies and iteration cheap, unless
+    // their bitmap was handed out by getResult() or getResultPset()
+    if (resultMap && !resultExposed)
+        getMutableResult()->compact();
 
     applied = true;
     filters.clear();
 }
 
+/**
+* @brief Calls callback with matching Ids until it returns false, see Query::forEach()
+*
+* Every range of Ids is filtered by a copy of the query whose result is restricted to the range,
+* which is only done when every filter decides per package, otherwise the whole query is applied.
+* Growing ranges bound the number of times fixed costs of filters, like reading advisories or
+* expanding provides, are paid when the whole pool ends up filtered.
+*/
+template<typename Callback>
+bool
+Query::Impl::stream(const Callback & callback)
+{
+    // other filters, like advisories, may compare a package with the rest of the result
+    if (applied || !std::all_of(filters.begin(), filters.end(), decidesPerPackage)) {
+        apply();
+        for (Id id = result->next(-1); id != -1; id = result->next(id)) {
+            if (!callback(id))
+                return false;
+        }
+        return true;
+    }
+
+    ScopedTimer timer("query.stream");
+    Pool *pool = dnf_sack_get_pool(sack);
+    repo_internalize_all_trigger(pool);
+    if (!result)
+        initResult();
+    if (planFilters(filters)) {
+        auto logger(Log::getLogger());
+        logger->debug("Query plan: " + describePlan(filters));
+    }
+    Id rangeSize = STREAM_FIRST_RANGE;
+    for (Id begin = 0; begin < pool->nsolvables; begin += rangeSize, rangeSize *= 2) {
+        Id end = pool->nsolvables - begin > rangeSize ? begin + rangeSize : pool->nsolvables;
+        std::shared_ptr<PackageSet> range(new PackageSet(sack));
+        for (Id id = result->next(begin - 1); id != -1 && id < end; id = result->next(id))
+            range->set(id);
+        if (range->empty())
+            continue;
+        Instrumentation::count("query.stream_ranges", 1);
+        Impl rangeQuery(*this);
+        rangeQuery.result = range;
+        rangeQuery.resultExposed = false;
+        rangeQuery.apply();
+        for (Id id = range->next(-1); id != -1; id = range->next(id)) {
+            if (!callback(id))
+                return false;
+        }
+    }
+    return true;
+}
+
 GPtrArray *
 Query::run()
 {
@@ -2374,6 +2827,45 @@ Query::run()
     return packageSet2GPtrArray(pImpl->result.get());
 }
 
+bool
+Query::forEach(const std::function<bool(Id)> & callback)
+{
+    return pImpl->stream(callback);
+}
+
+bool
+Query::exists()
+{
+    return !pImpl->stream([](Id) { return false; });
+}
+
+size_t
+Query::count(size_t limit)
+{
+    if (limit == 0)
+        return size();
+    size_t count = 0;
+    pImpl->stream([&count, limit](Id) { return ++count < limit; });
+    return count;
+}
+
+void
+Query::limit(size_t n)
+{
+    std::shared_ptr<PackageSet> limited(new PackageSet(pImpl->sack));
+    if (n > 0) {
+        size_t count = 0;
+        pImpl->stream([&limited, &count, n](Id id) {
+            limited->set(id);
+            return ++count < n;
+        });
+    }
+    pImpl->result = limited;
+    pImpl->resultExposed = false;
+    pImpl->filters.clear();
+    pImpl->applied = true;
+}
+
 const DnfPackageSet *
 Query::runSet()
 {
@@ -2393,7 +2885,7 @@ Query::queryUnion(Query & other)
 {
     apply();
     other.apply();
-    *(pImpl->result.get()) += *(other.pImpl->result.get());
+    *pImpl->getMutableResult() += *other.pImpl->result;
 }
 
 void
@@ -2401,7 +2893,7 @@ Query::queryIntersection(Query & other)
 {
     apply();
     other.apply();
-    *(pImpl->result.get()) /= *(other.pImpl->result.get());
+    *pImpl->getMutableResult() /= *other.pImpl->result;
 }
 
 void
@@ -2409,7 +2901,7 @@ Query::queryDifference(Query & other)
 {
     apply();
     other.apply();
-    *(pImpl->result.get()) -= *(other.pImpl->result.get());
+    *pImpl->getMutableResult() -= *other.pImpl->result;
 }
 
 bool
@@ -2424,11 +2916,9 @@ Query::filterExtras()
 {
     apply();
 
-    Pool * pool = dnf_sack_get_pool(pImpl->sack);
-
-    auto resultMap = pImpl->result->getMap();
     Query query_installed(*this);
     query_installed.installed();
+    auto resultMap = pImpl->getMutableResult()->getMutableMap();
     MAPZERO(resultMap);
     if (query_installed.size() == 0) {
         return;
@@ -2442,22 +2932,17 @@ Query::filterExtras()
     auto resultAvailable = query_available.pImpl->result.get();
     Id id_available = -1;
 
-    // make vector of available solvables
-    std::vector<Solvable *> namesArch;
-    namesArch.reserve(resultAvailable->size());
+    // mark names and arches of available solvables
+    auto index = dnf_sack_get_name_arch_index(pImpl->sack);
+    std::vector<bool> availableNameArch(index->nameArchGroupCount(), false);
     while ((id_available = resultAvailable->next(id_available)) != -1) {
-        namesArch.push_back(pool_id2solvable(pool, id_available));
+        availableNameArch[index->nameArchGroup(id_available)] = true;
     }
-    std::sort(namesArch.begin(), namesArch.end(), NameArchSolvableComparator);
     Id id_installed = -1;
     auto resultInstalled = query_installed.pImpl->result.get();
 
     while ((id_installed = resultInstalled->next(id_installed)) != -1) {
-        Solvable * s_installed = pool_id2solvable(pool, id_installed);
-        auto low = std::lower_bound(namesArch.begin(), namesArch.end(), s_installed,
-                                    NameArchSolvableComparator);
-        if (low == namesArch.end() || (*low)->name != s_installed->name ||
-            (*low)->arch != s_installed->arch) {
+        if (!availableNameArch[index->nameArchGroup(id_installed)]) {
             MAPSET(resultMap, id_installed);
         }
     }
@@ -2465,22 +2950,32 @@ Query::filterExtras()
 
 void
 Query::filterRecent(const long unsigned int recent_limit)
+{
+    filterAttribute(AttributeCache::Column::BUILDTIME, HY_GT, recent_limit);
+}
+
+void
+Query::filterAttribute(AttributeCache::Column column, int cmpType, uint64_t value)
 {
     apply();
-    auto resultPset = pImpl->result.get();
-    auto resultMap = pImpl->result->getMap();
+    auto cache = dnf_sack_get_attribute_cache(pImpl->sack);
+    bool negate = cmpType & HY_NOT;
+    auto resultPset = pImpl->getMutableResult();
+    // small results look the attribute up per solvable instead of reading the whole column
+    if (cache->useColumn(column, resultPset->size()))
+        cache->column(column);
 
     Id id = -1;
     while (true) {
         id = resultPset->next(id);
         if (id == -1)
-                break;
-        DnfPackage *pkg = dnf_package_new(pImpl->sack, id);
-        guint64 build_time = dnf_package_get_buildtime(pkg);
-        g_object_unref(pkg);
-        if (build_time <= recent_limit) {
-            MAPCLR(resultMap, id);
-        }
+            break;
+        uint64_t attribute = cache->lookup(column, id);
+        bool matched = (attribute > value && cmpType & HY_GT) ||
+                       (attribute < value && cmpType & HY_LT) ||
+                       (attribute == value && cmpType & HY_EQ);
+        if (matched == negate)
+            resultPset->remove(id);
     }
 }
 
@@ -2492,7 +2987,7 @@ Query::filterDuplicated()
 
     installed();
 
-    auto resultMap = pImpl->result->getMap();
+    auto resultMap = pImpl->getMutableResult()->getMutableMap();
     hy_query_to_name_ordered_queue(this, &samename);
 
     Solvable *considered, *highest = 0;
@@ -2616,7 +3111,7 @@ Query::installed()
     apply();
     Pool * pool = dnf_sack_get_pool(pImpl->sack);
     auto * installed_repo = pool->installed;
-    auto queryResult = pImpl->result.get();
+    auto queryResult = pImpl->getMutableResult();
     if (installed_repo == nullptr) {
         queryResult->clear();
         return;
@@ -2638,7 +3133,7 @@ Query::installed()
         }
         break;
     }
-    map_and(queryResult->getMap(), &filterResult);
+    map_and(queryResult->getMutableMap(), &filterResult);
     map_free(&filterResult);
 }
 
@@ -2651,7 +3146,7 @@ Query::available()
     if (installed_repo == nullptr) {
         return;
     }
-    auto queryResult = pImpl->result.get();
+    auto queryResult = pImpl->getMutableResult();
     Id pkgId = installed_repo->start;
     if (!queryResult->has(pkgId)) {
         pkgId = queryResult->next(pkgId);
@@ -2669,54 +3164,163 @@ Query::available()
     }
 }
 
-std::pair<bool, std::unique_ptr<Nevra>>
-Query::filterSubject(const char * subject, HyForm * forms, bool icase, bool with_nevra,
-    bool with_provides, bool with_filenames)
+namespace {
+
+/// Ids of the packages in a query result ordered by their name
+class NameIndex {
+public:
+    NameIndex(Pool * pool, const PackageSet * pset)
+    {
+        entries.reserve(pset->size());
+        for (Id id = pset->next(-1); id != -1; id = pset->next(id))
+            entries.emplace_back(pool_id2solvable(pool, id)->name, id);
+        std::sort(entries.begin(), entries.end());
+    }
+
+    /// Adds packages with the given name to pset
+    void collect(Id name, PackageSet & pset) const
+    {
+        auto low = std::lower_bound(entries.begin(), entries.end(), std::make_pair(name, Id(0)));
+        for (; low != entries.end() && low->first == name; ++low)
+            pset.set(low->second);
+    }
+
+private:
+    std::vector<std::pair<Id, Id>> entries;
+};
+
+}
+
+/// Returns false if name is a pattern, an exact name is looked up in pool as an Id
+static bool
+exactNameId(Pool * pool, const std::string & name, Id & nameId)
 {
-    apply();
-    Query origQuery(*this);
+    if (name.empty() || hy_is_glob_pattern(name.c_str()))
+        return false;
+    nameId = pool_str2id(pool, name.c_str(), 0);
+    return true;
+}
+
+/**
+* @brief Body of Query::filterSubject() on an applied query
+*
+* With a name index of the query result, forms with an exact name and non-glob NEVRA subjects
+* are matched only against packages with a possible name. Forms whose name has no package are
+* skipped without running the query.
+*/
+static std::pair<bool, std::unique_ptr<Nevra>>
+filterSubjectApplied(Query & query, const NameIndex * names, const char * subject, HyForm * forms,
+    bool icase, bool with_nevra, bool with_provides, bool with_filenames)
+{
+    Query origQuery(query);
+    DnfSack * sack = query.getSack();
+    Pool * pool = dnf_sack_get_pool(sack);
 
     if (with_nevra) {
         Nevra nevraObj;
         const HyForm * tryForms = !forms ? HY_FORMS_MOST_SPEC : forms;
         for (std::size_t i = 0; tryForms[i] != _HY_FORM_STOP_; ++i) {
             if (nevraObj.parse(subject, tryForms[i])) {
-                addFilter(&nevraObj, icase);
-                if (!empty()) {
+                Id nameId;
+                if (names && exactNameId(pool, nevraObj.getName(), nameId)) {
+                    PackageSet candidates(sack);
+                    if (nameId)
+                        names->collect(nameId, candidates);
+                    if (candidates.empty())
+                        continue;
+                    query.addFilter(HY_PKG, HY_EQ, &candidates);
+                }
+                query.addFilter(&nevraObj, icase);
+                if (!query.empty()) {
                     return {true, std::unique_ptr<Nevra>(new Nevra(std::move(nevraObj)))};
                 }
-                queryUnion(origQuery);
+                query.queryUnion(origQuery);
             }
         }
         if (!forms) {
-            queryUnion(origQuery);
-            addFilter(HY_PKG_NEVRA, HY_GLOB, subject);
-            if (!empty()) {
-                return {true, std::unique_ptr<Nevra>()};
+            query.queryUnion(origQuery);
+            bool candidatesFound = true;
+            if (names && !hy_is_glob_pattern(subject)) {
+                // the name in "name-[epoch:]version-release.arch" ends before one of the dashes
+                PackageSet candidates(sack);
+                for (const char * dash = strchr(subject, '-'); dash; dash = strchr(dash + 1, '-')) {
+                    auto length = static_cast<unsigned int>(dash - subject);
+                    Id nameId = pool_strn2id(pool, subject, length, 0);
+                    if (nameId)
+                        names->collect(nameId, candidates);
+                }
+                candidatesFound = !candidates.empty();
+                if (candidatesFound)
+                    query.addFilter(HY_PKG, HY_EQ, &candidates);
+            }
+            if (candidatesFound) {
+                query.addFilter(HY_PKG_NEVRA, HY_GLOB, subject);
+                if (!query.empty()) {
+                    return {true, std::unique_ptr<Nevra>()};
+                }
             }
         }
     }
 
     if (with_provides) {
-        queryUnion(origQuery);
-        addFilter(HY_PKG_PROVIDES, HY_GLOB, subject);
-        if (!empty()) {
+        query.queryUnion(origQuery);
+        query.addFilter(HY_PKG_PROVIDES, HY_GLOB, subject);
+        if (!query.empty()) {
             return {true, std::unique_ptr<Nevra>()};
         }
     }
 
     if (with_filenames && hy_is_file_pattern(subject)) {
-        queryUnion(origQuery);
-        addFilter(HY_PKG_FILE, HY_GLOB, subject);
-        if (!empty()) {
+        query.queryUnion(origQuery);
+        query.addFilter(HY_PKG_FILE, HY_GLOB, subject);
+        if (!query.empty()) {
             return {true, std::unique_ptr<Nevra>()};
         }
     }
 
-    addFilter(HY_PKG_EMPTY, HY_EQ, 1);
+    query.addFilter(HY_PKG_EMPTY, HY_EQ, 1);
     return {false, std::unique_ptr<Nevra>()};
 }
 
+std::pair<bool, std::unique_ptr<Nevra>>
+Query::filterSubject(const char * subject, HyForm * forms, bool icase, bool with_nevra,
+    bool with_provides, bool with_filenames)
+{
+    apply();
+    return filterSubjectApplied(*this, nullptr, subject, forms, icase, with_nevra, with_provides,
+                                with_filenames);
+}
+
+std::vector<SubjectMatch>
+Query::filterSubjects(const std::vector<std::string> & subjects, HyForm * forms, bool icase,
+    bool with_nevra, bool with_provides, bool with_filenames)
+{
+    apply();
+    std::vector<SubjectMatch> matches;
+    matches.reserve(subjects.size());
+    // names of case insensitive forms can not be looked up by Id
+    std::unique_ptr<NameIndex> names;
+    if (with_nevra && !icase)
+        names.reset(new NameIndex(dnf_sack_get_pool(pImpl->sack), getResultPset()));
+
+    std::map<std::string, std::size_t> resolved;
+    for (const auto & subject : subjects) {
+        auto done = resolved.find(subject);
+        if (done != resolved.end()) {
+            const auto & first = matches[done->second];
+            matches.push_back({first.query, first.found,
+                std::unique_ptr<Nevra>(first.nevra ? new Nevra(*first.nevra) : nullptr)});
+            continue;
+        }
+        resolved.emplace(subject, matches.size());
+        Query query(*this);
+        auto ret = filterSubjectApplied(query, names.get(), subject.c_str(), forms, icase,
+                                        with_nevra, with_provides, with_filenames);
+        matches.push_back({std::move(query), ret.first, std::move(ret.second)});
+    }
+    return matches;
+}
+
 void
 hy_query_to_name_ordered_queue(HyQuery query, IdQueue * samename)
 {
@@ -2728,8 +3332,8 @@ hy_query_to_name_ordered_queue(HyQuery query, IdQueue * samename)
         if (MAPTST(result, i))
             samename->pushBack(i);
 
-    solv_sort(samename->data(), samename->size(), sizeof(Id), filter_latest_sortcmp,
-        pool);
+    auto index = dnf_sack_get_name_arch_index(query->getSack());
+    index->sortByName(samename->data(), samename->data() + samename->size());
 }
 
 void
@@ -2743,8 +3347,8 @@ hy_query_to_name_arch_ordered_queue(HyQuery query, IdQueue * samename)
         if (MAPTST(result, i))
             samename->pushBack(i);
 
-    solv_sort(samename->data(), samename->size(), sizeof(Id),
-        filter_latest_sortcmp_byarch, pool);
+    auto index = dnf_sack_get_name_arch_index(query->getSack());
+    index->sortByNameArch(samename->data(), samename->data() + samename->size());
 }
 
 }
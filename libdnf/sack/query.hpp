@@ -21,7 +21,9 @@
 #ifndef __QUERY_HPP
 #define __QUERY_HPP
 
+#include <functional>
 #include <memory>
+#include <string>
 #include <vector>
 #include "../hy-types.h"
 #include "../hy-query.h"
@@ -31,6 +33,7 @@
 #include "../transaction/Swdb.hpp"
 #include "../dnf-types.h"
 #include "advisorypkg.hpp"
+#include "attributecache.hpp"
 
 #include <set>
 #include <utility>
@@ -64,6 +67,8 @@ private:
     std::shared_ptr<Impl> pImpl;
 };
 
+struct SubjectMatch;
+
 /**
 * @brief Provides package filtering
 * addFilter() can return DNF_ERROR_BAD_QUERY in case if cmp_type or keyname is incompatible with provided data type
@@ -78,16 +83,30 @@ public:
     IGNORE_EXCLUDES = IGNORE_MODULAR_EXCLUDES | IGNORE_REGULAR_EXCLUDES
     };
 
+    /**
+    * @brief Copies the query. The result of an applied query is shared with the copy
+    * until one of them is modified, so deriving queries from a common base is cheap.
+    */
     Query(const Query & query_src);
-    Query(Query && query_src) = delete;
+    /// The moved-from query can only be assigned to or destroyed
+    Query(Query && query_src) noexcept;
     Query(DnfSack* sack, ExcludeFlags flags = ExcludeFlags::APPLY_EXCLUDES);
     ~Query();
     Query & operator=(const Query& query_src);
-    Query & operator=(Query && src_query) = delete;
-    Map * getResult() noexcept;
+    Query & operator=(Query && src_query) noexcept;
+    /**
+    * @brief Returns the result map. The pointer is valid until the query is modified.
+    * A result shared with copies of the query is copied first and later copies get their
+    * own result, so changes through the pointer affect only this query.
+    */
+    Map * getResult();
+    /**
+    * @brief Returns the result map without unsharing it, it must not be modified
+    */
     const Map * getResult() const noexcept;
     /**
     * @brief Applies query and returns pointer of PackageSet
+    * Like getResult(), the set is not shared with any other query.
     *
     * @return PackageSet*
     */
@@ -166,6 +185,37 @@ public:
     * @return bool
     */
     bool empty();
+
+    /**
+    * @brief Calls callback with Ids of matching packages in ascending order until it returns false
+    *
+    * Filters of a query that was not applied yet are evaluated on growing ranges of package Ids,
+    * so the packages after the last visited range are never filtered. Queries with latest,
+    * upgrades, downgrades or by priority filters depend on the whole result and are applied
+    * first. The query itself is not modified.
+    *
+    * @return bool false if the callback stopped the iteration
+    */
+    bool forEach(const std::function<bool(Id)> & callback);
+    /**
+    * @brief Returns true if any package matches, stops filtering at the first match
+    *
+    * @return bool
+    */
+    bool exists();
+    /**
+    * @brief Returns count of matching packages, stops filtering when limit is reached
+    *
+    * @param limit maximal returned count, 0 means no limit
+    * @return size_t
+    */
+    size_t count(size_t limit);
+    /**
+    * @brief Applies the query keeping only the first n packages in the order of their Ids
+    *
+    * @param n maximal number of packages kept
+    */
+    void limit(size_t n);
     /**
      * @brief Applies all filters and keep only installed packages that have no available package
      * with a same name and architecture.
@@ -173,7 +223,19 @@ public:
      * applied.
      */
     void filterExtras();
+    /**
+     * @brief Applies all filters and keeps only packages with buildtime greater than recent_limit
+     */
     void filterRecent(const long unsigned int recent_limit);
+    /**
+     * @brief Applies all filters and keeps only packages whose numeric attribute compares to value
+     * Values are read from the attribute cache of the sack, missing attributes are 0.
+     *
+     * @param column attribute like buildtime or download size
+     * @param cmpType HY_EQ, HY_LT, HY_GT or their combination, optionally combined with HY_NOT
+     * @param value value to compare with
+     */
+    void filterAttribute(AttributeCache::Column column, int cmpType, uint64_t value);
     void filterDuplicated();
     int filterUnneeded(const Swdb &swdb, bool debug_solver);
     int filterSafeToRemove(const Swdb &swdb, bool debug_solver);
@@ -214,11 +276,39 @@ public:
     */
     std::pair<bool, std::unique_ptr<Nevra>> filterSubject(const char * subject, HyForm * forms,
         bool icase, bool with_nevra, bool with_provides, bool with_filenames);
+
+    /**
+    * @brief Resolves many subjects against the query, each one like filterSubject()
+    *
+    * The query is applied once and the nevra forms with an exact name are resolved from an index
+    * of package names in its result instead of filtering the whole result again for every form.
+    * Repeated subjects are resolved only once. The query itself is not filtered.
+    *
+    * @param subjects subjects to match
+    * @param forms, icase, with_nevra, with_provides, with_filenames see filterSubject()
+    *
+    * @return std::vector<SubjectMatch> One item for every subject in the same order, equal to
+    *         the result of filterSubject() called on a copy of the query
+    */
+    std::vector<SubjectMatch> filterSubjects(const std::vector<std::string> & subjects,
+        HyForm * forms, bool icase, bool with_nevra, bool with_provides, bool with_filenames);
 private:
     class Impl;
     std::unique_ptr<Impl> pImpl;
 };
 
+/**
+* @brief Result of a subject resolved by Query::filterSubjects()
+*/
+struct SubjectMatch {
+    /// The query filtered to the packages that match the subject
+    Query query;
+    /// Whether there are matched packages
+    bool found;
+    /// Used pattern form, nullptr if the subject did not match by nevra form
+    std::unique_ptr<Nevra> nevra;
+};
+
 inline Query::ExcludeFlags operator|(Query::ExcludeFlags a, Query::ExcludeFlags b)
 {
     return static_cast<Query::ExcludeFlags>(static_cast<int>(a) | static_cast<int>(b));
@@ -0,0 +1,387 @@
+/*
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "textindex.hpp"
+#include "../dnf-sack.h"
+#include "../hy-iutil-private.hpp"
+#include "../hy-types.h"
+#include "../repo/Repo-private.hpp"
+#include "../utils/Instrumentation.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <unordered_map>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <solv/knownid.h>
+#include <solv/pool.h>
+#include <solv/solvable.h>
+#include <unistd.h>
+
+namespace libdnf {
+
+namespace {
+
+const Id INDEXED_KEYS[] = {SOLVABLE_SUMMARY, SOLVABLE_DESCRIPTION, SOLVABLE_URL};
+constexpr std::size_t INDEXED_KEYS_COUNT = sizeof(INDEXED_KEYS) / sizeof(*INDEXED_KEYS);
+
+const char FILE_MAGIC[4] = {'D', 'N', 'F', 'T'};
+constexpr uint32_t FILE_VERSION = 1;
+
+int
+keyIndex(Id keyname)
+{
+    for (std::size_t i = 0; i < INDEXED_KEYS_COUNT; ++i) {
+        if (INDEXED_KEYS[i] == keyname)
+            return static_cast<int>(i);
+    }
+    return -1;
+}
+
+/// Appends case folded trigrams of the first len characters of str, non-ASCII trigrams are skipped
+void
+addTrigrams(const char * str, std::size_t len, std::vector<uint32_t> & out)
+{
+    for (std::size_t i = 0; i + 2 < len; ++i) {
+        auto a = static_cast<unsigned char>(str[i]);
+        auto b = static_cast<unsigned char>(str[i + 1]);
+        auto c = static_cast<unsigned char>(str[i + 2]);
+        if ((a | b | c) & 0x80)
+            continue;
+        out.push_back(static_cast<uint32_t>(g_ascii_tolower(a)) << 16 |
+                      static_cast<uint32_t>(g_ascii_tolower(b)) << 8 |
+                      static_cast<uint32_t>(g_ascii_tolower(c)));
+    }
+}
+
+/// Appends trigrams of the literal parts of a fnmatch() pattern
+void
+addGlobTrigrams(const char * pattern, std::vector<uint32_t> & out)
+{
+    const char * literal = pattern;
+    const char * p = pattern;
+    while (*p) {
+        if (*p != '*' && *p != '?' && *p != '[' && *p != '\\') {
+            ++p;
+            continue;
+        }
+        addTrigrams(literal, p - literal, out);
+        if (*p == '[') {
+            // skip the bracket expression, "]" right after "[" or "[!" is a part of it
+            ++p;
+            if (*p == '!' || *p == '^')
+                ++p;
+            if (*p == ']')
+                ++p;
+            while (*p && *p != ']')
+                ++p;
+            if (*p)
+                ++p;
+        } else if (*p == '\\') {
+            p += p[1] ? 2 : 1;
+        } else {
+            ++p;
+        }
+        literal = p;
+    }
+    addTrigrams(literal, p - literal, out);
+}
+
+void
+encodeVarint(uint32_t value, std::vector<unsigned char> & out)
+{
+    while (value >= 0x80) {
+        out.push_back(static_cast<unsigned char>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<unsigned char>(value));
+}
+
+template<typename T>
+bool
+writeVector(const std::vector<T> & vec, FILE * fp)
+{
+    uint32_t size = vec.size();
+    return fwrite(&size, sizeof(size), 1, fp) == 1 &&
+        (vec.empty() || fwrite(vec.data(), sizeof(T), vec.size(), fp) == vec.size());
+}
+
+template<typename T>
+bool
+readVector(std::vector<T> & vec, FILE * fp, long maxBytes)
+{
+    uint32_t size;
+    if (fread(&size, sizeof(size), 1, fp) != 1 || static_cast<long>(size * sizeof(T)) > maxBytes)
+        return false;
+    vec.resize(size);
+    return vec.empty() || fread(vec.data(), sizeof(T), vec.size(), fp) == vec.size();
+}
+
+}
+
+TextIndex::TextIndex(::Repo * repo, Id end)
+: repo(repo)
+, count(end > repo->start ? end - repo->start : 0)
+{
+    struct Postings {
+        uint32_t last;
+        std::vector<unsigned char> bytes;
+    };
+
+    ScopedTimer timer("textindex.build");
+    Pool * pool = repo->pool;
+    std::vector<uint32_t> trigrams;
+    for (auto keyname : INDEXED_KEYS) {
+        std::unordered_map<uint32_t, Postings> lists;
+        for (uint32_t offset = 0; offset < count; ++offset) {
+            Solvable * s = pool_id2solvable(pool, repo->start + offset);
+            if (s->repo != repo)
+                continue;
+            const char * str = solvable_lookup_str(s, keyname);
+            if (!str)
+                continue;
+            trigrams.clear();
+            addTrigrams(str, strlen(str), trigrams);
+            std::sort(trigrams.begin(), trigrams.end());
+            trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+            for (auto trigram : trigrams) {
+                auto & postings = lists[trigram];
+                encodeVarint(postings.bytes.empty() ? offset : offset - postings.last, postings.bytes);
+                postings.last = offset;
+            }
+        }
+
+        Attribute attr;
+        attr.trigrams.reserve(lists.size());
+        for (const auto & item : lists)
+            attr.trigrams.push_back(item.first);
+        std::sort(attr.trigrams.begin(), attr.trigrams.end());
+        attr.offsets.reserve(attr.trigrams.size() + 1);
+        for (auto trigram : attr.trigrams) {
+            attr.offsets.push_back(attr.postings.size());
+            auto & bytes = lists[trigram].bytes;
+            attr.postings.insert(attr.postings.end(), bytes.begin(), bytes.end());
+            std::vector<unsigned char>().swap(bytes);
+        }
+        attr.offsets.push_back(attr.postings.size());
+        attributes.push_back(std::move(attr));
+    }
+}
+
+std::unique_ptr<TextIndex>
+TextIndex::load(const char * path, const unsigned char * checksum, ::Repo * repo, Id end)
+{
+    FILE * fp = fopen(path, "r");
+    if (!fp)
+        return nullptr;
+
+    std::unique_ptr<TextIndex> index(new TextIndex);
+    index->repo = repo;
+    bool valid = false;
+    char magic[sizeof(FILE_MAGIC)];
+    uint32_t version;
+    unsigned char cs[CHKSUM_BYTES];
+    uint32_t nattributes;
+    long fileSize;
+
+    if (fseek(fp, 0, SEEK_END) != 0 || (fileSize = ftell(fp)) < 0 || fseek(fp, 0, SEEK_SET) != 0)
+        goto out;
+    if (fread(magic, sizeof(magic), 1, fp) != 1 || memcmp(magic, FILE_MAGIC, sizeof(magic)) != 0 ||
+        fread(&version, sizeof(version), 1, fp) != 1 || version != FILE_VERSION ||
+        fread(cs, sizeof(cs), 1, fp) != 1 || checksum_cmp(cs, checksum) != 0 ||
+        fread(&index->count, sizeof(index->count), 1, fp) != 1 ||
+        index->count != static_cast<uint32_t>(end > repo->start ? end - repo->start : 0) ||
+        fread(&nattributes, sizeof(nattributes), 1, fp) != 1 || nattributes != INDEXED_KEYS_COUNT)
+        goto out;
+
+    index->attributes.resize(nattributes);
+    for (auto & attr : index->attributes) {
+        if (!readVector(attr.trigrams, fp, fileSize) || !readVector(attr.offsets, fp, fileSize) ||
+            !readVector(attr.postings, fp, fileSize))
+            goto out;
+        if (attr.offsets.size() != attr.trigrams.size() + 1 || attr.offsets.front() != 0 ||
+            attr.offsets.back() != attr.postings.size() ||
+            !std::is_sorted(attr.offsets.begin(), attr.offsets.end()) ||
+            !std::is_sorted(attr.trigrams.begin(), attr.trigrams.end()))
+            goto out;
+    }
+    valid = fgetc(fp) == EOF;
+
+out:
+    fclose(fp);
+    if (!valid)
+        return nullptr;
+    return index;
+}
+
+bool
+TextIndex::save(const char * path, const unsigned char * checksum) const
+{
+    g_autofree gchar * tmpPath = g_strconcat(path, ".XXXXXX", NULL);
+    int fd = g_mkstemp(tmpPath);
+    if (fd < 0)
+        return false;
+    FILE * fp = fdopen(fd, "w");
+    if (!fp) {
+        close(fd);
+        g_unlink(tmpPath);
+        return false;
+    }
+
+    uint32_t nattributes = attributes.size();
+    bool ok = fwrite(FILE_MAGIC, sizeof(FILE_MAGIC), 1, fp) == 1 &&
+        fwrite(&FILE_VERSION, sizeof(FILE_VERSION), 1, fp) == 1 &&
+        checksum_write(checksum, fp) == 0 &&
+        fwrite(&count, sizeof(count), 1, fp) == 1 &&
+        fwrite(&nattributes, sizeof(nattributes), 1, fp) == 1;
+    for (const auto & attr : attributes) {
+        ok = ok && writeVector(attr.trigrams, fp) && writeVector(attr.offsets, fp) &&
+            writeVector(attr.postings, fp);
+    }
+    ok = fclose(fp) == 0 && ok;
+    if (ok)
+        ok = g_rename(tmpPath, path) == 0;
+    if (!ok)
+        g_unlink(tmpPath);
+    return ok;
+}
+
+bool
+TextIndex::isIndexed(Id keyname)
+{
+    return keyIndex(keyname) >= 0;
+}
+
+const TextIndex *
+TextIndex::getForRepo(DnfSack * sack, ::Repo * repo)
+{
+    auto hrepo = static_cast<HyRepo>(repo->appdata);
+    if (!hrepo)
+        return nullptr;
+    auto repoImpl = repoGetImpl(hrepo);
+    if (!(repoImpl->load_flags & DNF_SACK_LOAD_FLAG_USE_TEXT_INDEX))
+        return nullptr;
+    if (repoImpl->textIndex)
+        return repoImpl->textIndex.get();
+
+    // solvables added later (e.g. advisories) are not indexed and remain candidates
+    Id end = repoImpl->main_end > 0 ? repoImpl->main_end : repo->end;
+    // only repositories loaded from repodata have the repomd checksum
+    g_autofree gchar * fn = NULL;
+    if (repo != repo->pool->installed && repoImpl->state_main != _HY_NEW &&
+        dnf_sack_get_cache_dir(sack))
+        fn = dnf_sack_give_cache_fn(sack, repo->name, HY_EXT_TEXTINDEX);
+
+    if (fn) {
+        repoImpl->textIndex = load(fn, repoImpl->checksum, repo, end);
+        if (repoImpl->textIndex) {
+            g_debug("using cached text index of %s", repo->name);
+            return repoImpl->textIndex.get();
+        }
+    }
+    repoImpl->textIndex.reset(new TextIndex(repo, end));
+    if (fn && !repoImpl->textIndex->save(fn, repoImpl->checksum))
+        g_debug("cannot write text index %s", fn);
+    return repoImpl->textIndex.get();
+}
+
+void
+TextIndex::decode(const Attribute & attr, std::size_t index, std::vector<uint32_t> & out) const
+{
+    out.clear();
+    uint32_t value = 0;
+    auto pos = attr.offsets[index];
+    auto end = attr.offsets[index + 1];
+    while (pos < end) {
+        uint32_t delta = 0;
+        int shift = 0;
+        unsigned char byte;
+        do {
+            byte = attr.postings[pos++];
+            delta |= static_cast<uint32_t>(byte & 0x7f) << shift;
+            shift += 7;
+        } while ((byte & 0x80) && pos < end && shift < 32);
+        value += delta;
+        if (value < count)
+            out.push_back(value);
+    }
+}
+
+bool
+TextIndex::addCandidates(Id keyname, int cmpType, const char * pattern, Map * m) const
+{
+    int idx = keyIndex(keyname);
+    if (idx < 0)
+        return false;
+
+    std::vector<uint32_t> trigrams;
+    if ((cmpType & ~HY_COMPARISON_FLAG_MASK) == HY_GLOB)
+        addGlobTrigrams(pattern, trigrams);
+    else
+        addTrigrams(pattern, strlen(pattern), trigrams);
+    if (trigrams.empty())
+        return false;
+    std::sort(trigrams.begin(), trigrams.end());
+    trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+
+    const auto & attr = attributes[idx];
+    std::vector<std::size_t> lists;
+    for (auto trigram : trigrams) {
+        auto it = std::lower_bound(attr.trigrams.begin(), attr.trigrams.end(), trigram);
+        if (it == attr.trigrams.end() || *it != trigram) {
+            // no indexed solvable contains this trigram
+            lists.clear();
+            break;
+        }
+        lists.push_back(it - attr.trigrams.begin());
+    }
+
+    if (!lists.empty()) {
+        // intersect starting with the shortest posting lists
+        std::sort(lists.begin(), lists.end(), [&attr](std::size_t a, std::size_t b) {
+            return attr.offsets[a + 1] - attr.offsets[a] < attr.offsets[b + 1] - attr.offsets[b];
+        });
+        std::vector<uint32_t> candidates;
+        std::vector<uint32_t> postings;
+        std::vector<uint32_t> intersection;
+        decode(attr, lists[0], candidates);
+        for (std::size_t i = 1; i < lists.size() && !candidates.empty(); ++i) {
+            decode(attr, lists[i], postings);
+            intersection.clear();
+            std::set_intersection(candidates.begin(), candidates.end(), postings.begin(),
+                                  postings.end(), std::back_inserter(intersection));
+            candidates.swap(intersection);
+        }
+        for (auto offset : candidates)
+            MAPSET(m, repo->start + offset);
+    }
+
+    Pool * pool = repo->pool;
+    for (Id id = repo->start + count; id < repo->end; ++id) {
+        if (pool->solvables[id].repo == repo)
+            MAPSET(m, id);
+    }
+    return true;
+}
+
+}
@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef __TEXT_INDEX_HPP
+#define __TEXT_INDEX_HPP
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <solv/bitmap.h>
+#include <solv/pooltypes.h>
+#include <solv/repo.h>
+#include "../dnf-types.h"
+
+namespace libdnf {
+
+/**
+* @brief Trigram index of the summary, description and url of the solvables of one repository
+*
+* The index returns candidates, a superset of the solvables whose attribute matches a HY_EQ,
+* HY_SUBSTR or HY_GLOB pattern with or without HY_ICASE. The candidates still have to be verified.
+* Trigrams are case folded and only trigrams of ASCII characters are indexed.
+*/
+class TextIndex {
+public:
+    /// Indexes solvables of the repo from repo->start up to end
+    TextIndex(::Repo * repo, Id end);
+
+    /**
+    * @brief Loads an index written by save()
+    *
+    * @return nullptr if the file is missing, damaged or does not belong to the checksum
+    * or to the solvables of the repo up to end
+    */
+    static std::unique_ptr<TextIndex> load(const char * path, const unsigned char * checksum,
+        ::Repo * repo, Id end);
+
+    /// Writes the index through a temporary file, returns false on failure
+    bool save(const char * path, const unsigned char * checksum) const;
+
+    /// Returns true if the attribute keyname is indexed
+    static bool isIndexed(Id keyname);
+
+    /**
+    * @brief Returns the index of the repo if it was loaded with DNF_SACK_LOAD_FLAG_USE_TEXT_INDEX
+    *
+    * The index is built on the first use and kept with the repo. For repositories loaded from
+    * repodata it is persisted next to the .solv cache and keyed by the repomd checksum.
+    */
+    static const TextIndex * getForRepo(DnfSack * sack, ::Repo * repo);
+
+    /**
+    * @brief Sets candidate solvables of the repo for the pattern in m
+    *
+    * @param keyname indexed attribute
+    * @param cmpType HY_EQ, HY_SUBSTR or HY_GLOB optionally combined with HY_ICASE
+    * @return false if the pattern has no usable trigram, m is not changed then
+    */
+    bool addCandidates(Id keyname, int cmpType, const char * pattern, Map * m) const;
+
+private:
+    struct Attribute {
+        std::vector<uint32_t> trigrams;
+        /// Positions of the postings of the trigrams, one item more than trigrams
+        std::vector<uint32_t> offsets;
+        /// Delta and varint encoded offsets of solvables from repo->start
+        std::vector<unsigned char> postings;
+    };
+
+    TextIndex() = default;
+    void decode(const Attribute & attr, std::size_t index, std::vector<uint32_t> & out) const;
+
+    ::Repo * repo{nullptr};
+    uint32_t count{0};
+    std::vector<Attribute> attributes;
+};
+
+}
+
+#endif /* __TEXT_INDEX_HPP */
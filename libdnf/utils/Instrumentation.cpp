@@ -0,0 +1,165 @@
+/*
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "Instrumentation.hpp"
+#include "../error.hpp"
+
+#include <json.h>
+
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <mutex>
+
+namespace libdnf {
+
+namespace {
+
+constexpr std::size_t HISTOGRAM_BUCKETS = 64;
+
+struct Histogram {
+    std::uint64_t count{0};
+    std::uint64_t sum{0};
+    std::uint64_t min{std::numeric_limits<std::uint64_t>::max()};
+    std::uint64_t max{0};
+    // buckets[i] counts the samples with value < 2^i (and >= 2^(i-1))
+    std::array<std::uint64_t, HISTOGRAM_BUCKETS> buckets{};
+
+    void add(std::uint64_t value)
+    {
+        ++count;
+        sum += value;
+        if (value < min)
+            min = value;
+        if (value > max)
+            max = value;
+        std::size_t bucket = 0;
+        while (bucket < HISTOGRAM_BUCKETS - 1 && value >> bucket)
+            ++bucket;
+        ++buckets[bucket];
+    }
+};
+
+struct Registry {
+    std::mutex mutex;
+    std::map<std::string, std::int64_t> counters;
+    std::map<std::string, Histogram> histograms;
+    std::map<std::string, Histogram> timers;
+};
+
+Registry & getRegistry()
+{
+    static Registry registry;
+    return registry;
+}
+
+json_object * histogramToJson(const Histogram & histogram)
+{
+    auto object = json_object_new_object();
+    json_object_object_add(object, "count", json_object_new_int64(histogram.count));
+    json_object_object_add(object, "sum", json_object_new_int64(histogram.sum));
+    json_object_object_add(object, "min", json_object_new_int64(histogram.count ? histogram.min : 0));
+    json_object_object_add(object, "max", json_object_new_int64(histogram.max));
+    // only the used buckets, keyed by their exclusive upper bound
+    auto buckets = json_object_new_object();
+    for (std::size_t i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+        if (histogram.buckets[i] == 0)
+            continue;
+        auto bound = i == HISTOGRAM_BUCKETS - 1 ? std::string("inf") : std::to_string(1ULL << i);
+        json_object_object_add(buckets, bound.c_str(), json_object_new_int64(histogram.buckets[i]));
+    }
+    json_object_object_add(object, "buckets", buckets);
+    return object;
+}
+
+json_object * histogramsToJson(const std::map<std::string, Histogram> & histograms)
+{
+    auto object = json_object_new_object();
+    for (const auto & item : histograms)
+        json_object_object_add(object, item.first.c_str(), histogramToJson(item.second));
+    return object;
+}
+
+}
+
+std::atomic<bool> Instrumentation::enabled{false};
+
+void Instrumentation::addCounter(const char * name, std::int64_t delta)
+{
+    auto & registry = getRegistry();
+    std::lock_guard<std::mutex> guard(registry.mutex);
+    registry.counters[name] += delta;
+}
+
+void Instrumentation::addSample(const char * name, std::uint64_t value)
+{
+    auto & registry = getRegistry();
+    std::lock_guard<std::mutex> guard(registry.mutex);
+    registry.histograms[name].add(value);
+}
+
+void Instrumentation::addTime(const char * name, std::uint64_t nanoseconds)
+{
+    auto & registry = getRegistry();
+    std::lock_guard<std::mutex> guard(registry.mutex);
+    registry.timers[name].add(nanoseconds);
+}
+
+void Instrumentation::reset()
+{
+    auto & registry = getRegistry();
+    std::lock_guard<std::mutex> guard(registry.mutex);
+    registry.counters.clear();
+    registry.histograms.clear();
+    registry.timers.clear();
+}
+
+std::string Instrumentation::toJson()
+{
+    auto & registry = getRegistry();
+    auto root = json_object_new_object();
+    {
+        std::lock_guard<std::mutex> guard(registry.mutex);
+        json_object_object_add(root, "version", json_object_new_string(PACKAGE_VERSION));
+        json_object_object_add(root, "timers", histogramsToJson(registry.timers));
+        json_object_object_add(root, "histograms", histogramsToJson(registry.histograms));
+        auto counters = json_object_new_object();
+        for (const auto & item : registry.counters)
+            json_object_object_add(counters, item.first.c_str(), json_object_new_int64(item.second));
+        json_object_object_add(root, "counters", counters);
+    }
+    std::string result = json_object_to_json_string_ext(root, JSON_C_TO_STRING_PRETTY);
+    json_object_put(root);
+    return result;
+}
+
+void Instrumentation::writeReport(const std::string & path)
+{
+    std::ofstream out(path, std::ios::out | std::ios::trunc);
+    if (out)
+        out << toJson() << std::endl;
+    if (!out)
+        throw Error("Cannot write instrumentation report \"" + path + "\": " + std::strerror(errno));
+}
+
+}
@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef LIBDNF_INSTRUMENTATION_HPP
+#define LIBDNF_INSTRUMENTATION_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace libdnf {
+
+/**
+* @brief Process wide registry of timers, counters and histograms of libdnf hot paths.
+*
+* Collection is disabled by default. While disabled every recording call returns
+* after a single relaxed atomic load, so the probes can stay compiled in.
+* The collected data are exported as a JSON document by toJson().
+*/
+class Instrumentation {
+public:
+    static bool isEnabled() noexcept { return enabled.load(std::memory_order_relaxed); }
+    static void setEnabled(bool enable) noexcept { enabled.store(enable, std::memory_order_relaxed); }
+
+    /// Adds delta to the counter name.
+    static void count(const char * name, std::int64_t delta = 1)
+    {
+        if (isEnabled())
+            addCounter(name, delta);
+    }
+
+    /// Records a sample of the histogram name.
+    static void observe(const char * name, std::uint64_t value)
+    {
+        if (isEnabled())
+            addSample(name, value);
+    }
+
+    /// Records a duration in nanoseconds of the timer name.
+    static void recordTime(const char * name, std::uint64_t nanoseconds)
+    {
+        if (isEnabled())
+            addTime(name, nanoseconds);
+    }
+
+    /// Drops all collected data.
+    static void reset();
+
+    /**
+    * @brief Returns collected data as JSON.
+    *
+    * {"version": "...", "timers": {name: histogram}, "histograms": {name: histogram},
+    *  "counters": {name: value}}, where histogram is an object with "count", "sum",
+    * "min", "max" and "buckets" - the number of samples by power of two upper bound.
+    * Timer values are in nanoseconds.
+    */
+    static std::string toJson();
+
+    /// Writes toJson() into the file path. Throws libdnf::Error on failure.
+    static void writeReport(const std::string & path);
+
+private:
+    static std::atomic<bool> enabled;
+
+    static void addCounter(const char * name, std::int64_t delta);
+    static void addSample(const char * name, std::uint64_t value);
+    static void addTime(const char * name, std::uint64_t nanoseconds);
+};
+
+/**
+* @brief Measures the time between its construction and destruction.
+*
+* Example:
+*
+*    {
+*        ScopedTimer timer("query.apply");
+*        ...
+*    }
+*/
+class ScopedTimer {
+public:
+    explicit ScopedTimer(const char * name) noexcept
+    : name(Instrumentation::isEnabled() ? name : nullptr)
+    {
+        if (this->name)
+            start = std::chrono::steady_clock::now();
+    }
+    ScopedTimer(const ScopedTimer &) = delete;
+    ScopedTimer & operator=(const ScopedTimer &) = delete;
+    ~ScopedTimer()
+    {
+        if (name) {
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            Instrumentation::recordTime(
+                name, std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+        }
+    }
+
+private:
+    const char * name;
+    std::chrono::steady_clock::time_point start;
+};
+
+}
+
+#endif // LIBDNF_INSTRUMENTATION_HPP
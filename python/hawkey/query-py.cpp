@@ -853,6 +853,29 @@ q_length(PyObject *self, PyObject *unused) try
     return PyLong_FromLong(query_len(self));
 } CATCH_TO_PYTHON
 
+static PyObject *
+q_exists(_QueryObject *self, PyObject *unused) try
+{
+    return PyBool_FromLong(self->query->exists());
+} CATCH_TO_PYTHON
+
+static PyObject *
+q_limit(_QueryObject *self, PyObject *args) try
+{
+    long limit;
+    if (!PyArg_ParseTuple(args, "l", &limit))
+        return NULL;
+    if (limit < 0) {
+        PyErr_SetString(PyExc_ValueError, "limit() requires a non-negative integer");
+        return NULL;
+    }
+
+    HyQuery query = new libdnf::Query(*self->query);
+    query->limit(limit);
+    PyObject *final_query = queryToPyObject(query, self->sack, Py_TYPE(self));
+    return final_query;
+} CATCH_TO_PYTHON
+
 static PyObject *
 query_get_item(PyObject *self, int index) try
 {
@@ -1064,6 +1087,8 @@ static struct PyMethodDef query_methods[] = {
     {"difference", (PyCFunction)q_difference, METH_VARARGS, NULL},
     {"count", (PyCFunction)q_length, METH_NOARGS,
         NULL},
+    {"exists", (PyCFunction)q_exists, METH_NOARGS, NULL},
+    {"limit", (PyCFunction)q_limit, METH_VARARGS, NULL},
     {"get_advisory_pkgs", (PyCFunction)get_advisory_pkgs, METH_VARARGS, NULL},
     {"userinstalled", (PyCFunction)filter_userinstalled, METH_KEYWORDS|METH_VARARGS, NULL},
     {"_na_dict", (PyCFunction)query_to_name_arch_dict, METH_NOARGS, NULL},
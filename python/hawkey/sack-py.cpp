@@ -733,14 +733,16 @@ static PyObject *
 load_repo(_SackObject *self, PyObject *args, PyObject *kwds) try
 {
     const char *kwlist[] = {"repo", "build_cache", "load_filelists", "load_presto",
-                      "load_updateinfo", "load_other", NULL};
+                      "load_updateinfo", "load_other", "load_text_index", NULL};
 
     PyObject * repoPyObj = NULL;
     int build_cache = 0, load_filelists = 0, load_presto = 0, load_updateinfo = 0, load_other = 0;
-    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|iiiii", (char**) kwlist,
+    int load_text_index = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|iiiiii", (char**) kwlist,
                                      &repoPyObj,
                                      &build_cache, &load_filelists,
-                                     &load_presto, &load_updateinfo, &load_other))
+                                     &load_presto, &load_updateinfo, &load_other,
+                                     &load_text_index))
         return 0;
 
     // Is it old deprecated _hawkey.Repo object?
@@ -775,6 +777,8 @@ load_repo(_SackObject *self, PyObject *args, PyObject *kwds) try
         flags |= DNF_SACK_LOAD_FLAG_USE_UPDATEINFO;
     if (load_other)
         flags |= DNF_SACK_LOAD_FLAG_USE_OTHER;
+    if (load_text_index)
+        flags |= DNF_SACK_LOAD_FLAG_USE_TEXT_INDEX;
     Py_BEGIN_ALLOW_THREADS;
     ret = dnf_sack_load_repo(self->sack, crepo, flags, &error);
     Py_END_ALLOW_THREADS;
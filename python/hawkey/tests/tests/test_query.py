@@ -63,6 +63,22 @@ class TestQuery(base.TestCase):
         self.assertFalse(q)
         self.assertEqual(len(q.run()), 0)
 
+    def test_exists_limit(self):
+        q = hawkey.Query(self.sack).filter(name=["flying", "penny"])
+        self.assertTrue(q.exists())
+        self.assertFalse(hawkey.Query(self.sack).filter(name="naturalE").exists())
+
+        limited = q.limit(1)
+        self.assertEqual(len(limited), 1)
+        self.assertIn(limited[0], q)
+        self.assertEqual(len(q.limit(5)), 2)
+        self.assertEqual(len(q.limit(0)), 0)
+        self.assertEqual(len(q), 2)
+
+        latest = hawkey.Query(self.sack).filter(name="penny").latest()
+        self.assertEqual(latest.limit(5).run(), latest.run())
+        self.assertRaises(ValueError, q.limit, -1)
+
     def test_kwargs_check(self):
         q = hawkey.Query(self.sack)
         self.assertRaises(hawkey.ValueException, q.filter, name="flying", upgrades="maracas")
@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "generate.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace bench {
+
+namespace {
+
+const char * const ARCHES[] = {"x86_64", "x86_64", "noarch", "i686"};
+const char * const ADVISORY_TYPES[] = {"bugfix", "security", "enhancement"};
+const char * const WORDS[] = {"library", "daemon", "utility", "plugin", "bindings", "fonts",
+                              "documentation", "development", "server", "client"};
+
+std::ofstream openFile(const std::string & path)
+{
+    std::ofstream out(path, std::ios::out | std::ios::trunc);
+    if (!out)
+        throw std::runtime_error("Cannot write " + path);
+    return out;
+}
+
+const char * archOf(std::size_t index)
+{
+    return ARCHES[index % (sizeof(ARCHES) / sizeof(*ARCHES))];
+}
+
+void writePackage(std::ostream & out, std::size_t index, const char * version, std::size_t size)
+{
+    auto name = packageName(index);
+    out << "=Pkg: " << name << " " << version << " 1 " << archOf(index) << "\n";
+    out << "=Prv: lib" << name << ".so." << index % 7 << "\n";
+    // a sparse dependency tree, every package except the roots requires its parent
+    if (index > 0)
+        out << "=Req: " << packageName(index / 2) << "\n";
+    if (index % 50 == 1 && index + 1 < size)
+        out << "=Obs: " << packageName(index + 1) << " < 1.0\n";
+    out << "=Sum: " << name << " " << WORDS[index % 10] << " " << WORDS[(index / 10) % 10] << "\n";
+    out << "=Fls: /usr/bin/" << name << "\n";
+    out << "=Fls: /usr/share/doc/" << name << "/README\n";
+}
+
+}
+
+std::string packageName(std::size_t index)
+{
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "pkg%06zu", index);
+    return buffer;
+}
+
+void writeRepos(const std::string & dir, std::size_t size)
+{
+    auto system = openFile(dir + "/@System.repo");
+    auto main = openFile(dir + "/main.repo");
+    auto updates = openFile(dir + "/updates.repo");
+    auto updateinfo = openFile(dir + "/updateinfo.xml");
+
+    system << "=Ver: 2.0\n";
+    main << "=Ver: 2.0\n";
+    updates << "=Ver: 2.0\n";
+    updateinfo << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<updates>\n";
+
+    for (std::size_t i = 0; i < size; ++i) {
+        if (i % 2 == 0)
+            writePackage(system, i, "1.0", size);
+        writePackage(main, i, "1.0", size);
+    }
+
+    std::size_t advisory = 0;
+    for (std::size_t i = 0; i < size; i += 4) {
+        writePackage(updates, i, "2.0", size);
+        if ((i / 4) % 10 == 0) {
+            if (advisory > 0)
+                updateinfo << "  </collection></pkglist></update>\n";
+            updateinfo << "  <update from=\"bench\" status=\"stable\" type=\""
+                       << ADVISORY_TYPES[advisory % 3] << "\" version=\"1\">\n"
+                       << "    <id>BENCH-" << advisory << "</id>\n"
+                       << "    <title>Update " << advisory << "</title>\n"
+                       << "    <issued date=\"2020-01-01 00:00:00\"/>\n"
+                       << "    <severity>" << (advisory % 2 ? "Important" : "Low") << "</severity>\n"
+                       << "    <pkglist><collection short=\"bench\">\n";
+            ++advisory;
+        }
+        auto name = packageName(i);
+        updateinfo << "      <package name=\"" << name << "\" version=\"2.0\" release=\"1\" epoch=\"0\""
+                   << " arch=\"" << archOf(i) << "\"><filename>" << name << "-2.0-1."
+                   << archOf(i) << ".rpm</filename></package>\n";
+    }
+    if (advisory > 0)
+        updateinfo << "  </collection></pkglist></update>\n";
+    updateinfo << "</updates>\n";
+}
+
+std::string modulesYaml(std::size_t count)
+{
+    std::ostringstream out;
+    for (std::size_t i = 0; i < count; ++i) {
+        for (int stream = 1; stream <= 2; ++stream) {
+            out << "---\n"
+                << "document: modulemd\n"
+                << "version: 2\n"
+                << "data:\n"
+                << "  name: module" << i << "\n"
+                << "  stream: \"" << stream << "\"\n"
+                << "  version: 1\n"
+                << "  context: c0ffee" << stream << "\n"
+                << "  arch: x86_64\n"
+                << "  summary: Benchmark module\n"
+                << "  description: Benchmark module\n"
+                << "  license:\n"
+                << "    module: [MIT]\n";
+            // every module but the first requires the same stream of its parent
+            if (i > 0) {
+                out << "  dependencies:\n"
+                    << "  - requires:\n"
+                    << "      module" << i / 2 << ": [\"" << stream << "\"]\n";
+            }
+            out << "  artifacts:\n"
+                << "    rpms:\n"
+                << "    - " << packageName(i) << "-0:" << stream << ".0-1.x86_64\n"
+                << "...\n";
+        }
+    }
+    return out.str();
+}
+
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef LIBDNF_BENCH_GENERATE_HPP
+#define LIBDNF_BENCH_GENERATE_HPP
+
+#include <cstddef>
+#include <string>
+
+namespace bench {
+
+/**
+* @brief Writes a synthetic system in the testcase format used by the hawkey fixtures.
+*
+* The directory receives "@System.repo" (size / 2 installed packages), "main.repo"
+* (size packages), "updates.repo" (an update of every fourth package) and
+* "updateinfo.xml" (an advisory per ten updates). The output depends only on size.
+*/
+void writeRepos(const std::string & dir, std::size_t size);
+
+/// Returns modulemd v2 documents of count modules, each with two streams.
+std::string modulesYaml(std::size_t count);
+
+/// Returns the name of the package number index, as used by writeRepos().
+std::string packageName(std::size_t index);
+
+}
+
+#endif // LIBDNF_BENCH_GENERATE_HPP
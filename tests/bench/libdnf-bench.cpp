@@ -0,0 +1,401 @@
+/*
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * libdnf-bench - repeatable performance measurements of libdnf hot paths
+ *
+ * Every run generates synthetic repositories of the requested sizes, so the
+ * numbers depend only on the libdnf build and the machine. Results are printed
+ * to stdout as one JSON object per line to be easily compared between builds:
+ *
+ *   libdnf-bench [--sizes=10000,100000] [--iterations=5] [--filter=query.]
+ */
+
+#include "generate.hpp"
+#include "../hawkey/testshared.h"
+
+#include "libdnf/dnf-sack.h"
+#include "libdnf/goal/Goal.hpp"
+#include "libdnf/hy-iutil-private.hpp"
+#include "libdnf/hy-types.h"
+#include "libdnf/module/ModulePackageContainer.hpp"
+#include "libdnf/sack/packageset.hpp"
+#include "libdnf/sack/query.hpp"
+#include "libdnf/transaction/RPMItem.hpp"
+#include "libdnf/transaction/Swdb.hpp"
+
+extern "C" {
+#include <solv/pool.h>
+#include <solv/repo.h>
+#include <solv/repo_updateinfoxml.h>
+}
+
+#include <glib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Options {
+    std::vector<std::size_t> sizes{10000, 100000};
+    unsigned iterations{5};
+    std::string filter;
+};
+
+/// Runs the benchmarks and prints their results
+class Runner {
+public:
+    explicit Runner(const Options & options) : options(options) {}
+
+    /**
+    * @brief Measures body options.iterations times and prints a result line.
+    *
+    * @param name benchmark identifier, matched against --filter
+    * @param size number of generated packages, the same for all benchmarks of a run
+    * @param body measured code, returns a count used to sanity check the results
+    * @param prepare optional unmeasured code run before every iteration
+    */
+    void measure(const std::string & name, std::size_t size,
+                 const std::function<std::size_t()> & body,
+                 const std::function<void()> & prepare = nullptr);
+
+    bool selected(const std::string & name) const
+    {
+        return options.filter.empty() || name.find(options.filter) != std::string::npos;
+    }
+
+private:
+    const Options & options;
+};
+
+void
+Runner::measure(const std::string & name, std::size_t size,
+                const std::function<std::size_t()> & body,
+                const std::function<void()> & prepare)
+{
+    if (!selected(name))
+        return;
+
+    std::vector<long long> samples;
+    std::size_t result = 0;
+    for (unsigned i = 0; i < options.iterations; ++i) {
+        if (prepare)
+            prepare();
+        auto start = std::chrono::steady_clock::now();
+        result = body();
+        auto end = std::chrono::steady_clock::now();
+        samples.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+    }
+    std::sort(samples.begin(), samples.end());
+    auto sum = std::accumulate(samples.begin(), samples.end(), 0LL);
+
+    std::cout << "{\"benchmark\": \"" << name << "\""
+              << ", \"size\": " << size
+              << ", \"iterations\": " << samples.size()
+              << ", \"result\": " << result
+              << ", \"min_ns\": " << samples.front()
+              << ", \"median_ns\": " << samples[samples.size() / 2]
+              << ", \"mean_ns\": " << sum / static_cast<long long>(samples.size())
+              << ", \"max_ns\": " << samples.back()
+              << "}" << std::endl;
+}
+
+DnfSack *
+loadSack(const std::string & dir)
+{
+    DnfSack *sack = dnf_sack_new();
+    dnf_sack_set_cachedir(sack, dir.c_str());
+    dnf_sack_set_arch(sack, "x86_64", NULL);
+    dnf_sack_setup(sack, DNF_SACK_SETUP_FLAG_MAKE_CACHE_DIR, NULL);
+
+    Pool *pool = dnf_sack_get_pool(sack);
+    if (load_repo(pool, HY_SYSTEM_REPO_NAME, (dir + "/@System.repo").c_str(), 1) ||
+        load_repo(pool, "main", (dir + "/main.repo").c_str(), 0) ||
+        load_repo(pool, "updates", (dir + "/updates.repo").c_str(), 0)) {
+        g_object_unref(sack);
+        throw std::runtime_error("Cannot load repositories from " + dir);
+    }
+
+    Repo *repo;
+    int repoId;
+    FOR_REPOS(repoId, repo) {
+        if (strcmp(repo->name, "updates") != 0)
+            continue;
+        FILE *fp = fopen((dir + "/updateinfo.xml").c_str(), "r");
+        if (!fp) {
+            g_object_unref(sack);
+            throw std::runtime_error("Cannot open updateinfo in " + dir);
+        }
+        repo_add_updateinfoxml(repo, fp, 0);
+        fclose(fp);
+        repo_internalize(repo);
+    }
+    return sack;
+}
+
+std::size_t
+querySize(DnfSack *sack, const std::function<void(libdnf::Query &)> & filters)
+{
+    libdnf::Query query(sack);
+    filters(query);
+    return query.size();
+}
+
+void
+benchSack(Runner & runner, const std::string & dir, std::size_t size)
+{
+    runner.measure("sack.load", size, [&]() {
+        DnfSack *sack = loadSack(dir);
+        std::size_t count = dnf_sack_count(sack);
+        g_object_unref(sack);
+        return count;
+    });
+}
+
+void
+benchQueries(Runner & runner, DnfSack *sack, std::size_t size)
+{
+    auto name = bench::packageName(size / 3);
+    auto provide = "lib" + bench::packageName(size / 5) + ".so." + std::to_string(size / 5 % 7);
+    auto file = "/usr/bin/" + bench::packageName(size / 7);
+
+    runner.measure("query.name_eq", size, [&]() {
+        return querySize(sack, [&](libdnf::Query & q) { q.addFilter(HY_PKG_NAME, HY_EQ, name.c_str()); });
+    });
+    runner.measure("query.small_result_copy", size, [&]() {
+        // small results copied and combined the way Goal and Query callers do
+        libdnf::Query query(sack);
+        query.addFilter(HY_PKG_NAME, HY_EQ, name.c_str());
+        std::size_t count = 0;
+        for (int i = 0; i < 100; ++i) {
+            libdnf::PackageSet pset(*query.runSet());
+            pset += *query.runSet();
+            for (Id id = pset.next(-1); id != -1; id = pset.next(id))
+                ++count;
+        }
+        return count;
+    });
+    runner.measure("query.name_glob", size, [&]() {
+        return querySize(sack, [](libdnf::Query & q) { q.addFilter(HY_PKG_NAME, HY_GLOB, "pkg0001*"); });
+    });
+    runner.measure("query.provides", size, [&]() {
+        return querySize(sack, [&](libdnf::Query & q) { q.addFilter(HY_PKG_PROVIDES, HY_EQ, provide.c_str()); });
+    });
+    runner.measure("query.file", size, [&]() {
+        return querySize(sack, [&](libdnf::Query & q) { q.addFilter(HY_PKG_FILE, HY_EQ, file.c_str()); });
+    });
+    runner.measure("query.summary_substr", size, [&]() {
+        return querySize(sack, [](libdnf::Query & q) {
+            q.addFilter(HY_PKG_SUMMARY, HY_SUBSTR | HY_ICASE, "DAEMON");
+        });
+    });
+    runner.measure("query.chain", size, [&]() {
+        return querySize(sack, [](libdnf::Query & q) {
+            q.available();
+            q.addFilter(HY_PKG_ARCH, HY_EQ, "x86_64");
+            q.addFilter(HY_PKG_NAME, HY_GLOB, "pkg*1");
+            q.addFilter(HY_PKG_SUMMARY, HY_SUBSTR, "library");
+        });
+    });
+    runner.measure("query.latest_per_arch", size, [&]() {
+        return querySize(sack, [](libdnf::Query & q) { q.addFilter(HY_PKG_LATEST_PER_ARCH, HY_EQ, 1); });
+    });
+    runner.measure("query.upgrades", size, [&]() {
+        return querySize(sack, [](libdnf::Query & q) { q.addFilter(HY_PKG_UPGRADES, HY_EQ, 1); });
+    });
+    runner.measure("query.advisory_type", size, [&]() {
+        return querySize(sack, [](libdnf::Query & q) {
+            q.addFilter(HY_PKG_ADVISORY_TYPE, HY_EQ, "security");
+        });
+    });
+    runner.measure("query.advisory_upgrade", size, [&]() {
+        return querySize(sack, [](libdnf::Query & q) {
+            q.addFilter(HY_PKG_ADVISORY_TYPE, HY_EQ | HY_UPGRADE, "bugfix");
+        });
+    });
+}
+
+void
+benchGoal(Runner & runner, DnfSack *sack, std::size_t size)
+{
+    runner.measure("goal.upgrade_all", size, [&]() {
+        libdnf::Goal goal(sack);
+        goal.upgrade();
+        if (goal.run(DNF_NONE))
+            return std::size_t(0);
+        return goal.listUpgrades().size();
+    });
+}
+
+void
+benchModules(Runner & runner, const std::string & dir, std::size_t size)
+{
+    auto count = size / 100;
+    auto yaml = bench::modulesYaml(count);
+    std::unique_ptr<libdnf::ModulePackageContainer> container;
+
+    runner.measure("module.resolve", size, [&]() {
+        for (std::size_t i = 0; i < count; ++i)
+            container->enable("module" + std::to_string(i), i % 2 ? "2" : "1");
+        auto result = container->resolveActiveModulePackages(false);
+        return result.first.size();
+    }, [&]() {
+        container.reset(new libdnf::ModulePackageContainer(true, dir, "x86_64", nullptr));
+        container->add(yaml, "bench");
+    });
+}
+
+void
+writeHistory(libdnf::Swdb & swdb, std::size_t transactions, std::size_t items)
+{
+    for (std::size_t t = 0; t < transactions; ++t) {
+        swdb.initTransaction();
+        std::vector<std::string> nevras;
+        for (std::size_t i = 0; i < items; ++i) {
+            auto rpm = swdb.createRPMItem();
+            rpm->setName(bench::packageName(t * items + i));
+            rpm->setEpoch(0);
+            rpm->setVersion("1.0");
+            rpm->setRelease("1");
+            rpm->setArch("x86_64");
+            nevras.push_back(rpm->getNEVRA());
+            swdb.addItem(rpm, "main", libdnf::TransactionItemAction::INSTALL,
+                         i % 3 ? libdnf::TransactionItemReason::DEPENDENCY
+                               : libdnf::TransactionItemReason::USER);
+        }
+        swdb.beginTransaction(t, "begin", "bench", 0);
+        for (const auto & nevra : nevras)
+            swdb.setItemDone(nevra);
+        swdb.endTransaction(t + 1, "end", libdnf::TransactionState::DONE);
+        swdb.closeTransaction();
+    }
+}
+
+void
+benchHistory(Runner & runner, const std::string & dir, std::size_t size)
+{
+    const std::size_t items = 100;
+    auto transactions = std::max<std::size_t>(size / items / 10, 1);
+    auto path = dir + "/history.sqlite";
+
+    runner.measure("swdb.write", size, [&]() {
+        libdnf::Swdb swdb(path);
+        writeHistory(swdb, transactions, items);
+        return transactions;
+    }, [&]() {
+        std::remove(path.c_str());
+    });
+
+    if (!runner.selected("swdb.read"))
+        return;
+    {
+        std::remove(path.c_str());
+        libdnf::Swdb swdb(path);
+        writeHistory(swdb, transactions, items);
+    }
+    runner.measure("swdb.read", size, [&]() {
+        libdnf::Swdb swdb(path);
+        std::size_t count = swdb.listTransactions().size();
+        count += swdb.searchTransactionsByRPM({"pkg0000*"}).size();
+        for (std::size_t i = 0; i < transactions * items; i += items / 10) {
+            auto reason = swdb.resolveRPMTransactionItemReason(bench::packageName(i), "x86_64", -1);
+            count += reason == libdnf::TransactionItemReason::USER;
+        }
+        return count;
+    });
+}
+
+void
+runAll(Runner & runner, std::size_t size)
+{
+    char tmpl[] = "/tmp/libdnf-bench-XXXXXX";
+    if (!mkdtemp(tmpl))
+        throw std::runtime_error("Cannot create a temporary directory");
+    std::string dir = tmpl;
+    bench::writeRepos(dir, size);
+
+    benchSack(runner, dir, size);
+    DnfSack *sack = loadSack(dir);
+    benchQueries(runner, sack, size);
+    benchGoal(runner, sack, size);
+    g_object_unref(sack);
+    benchModules(runner, dir, size);
+    benchHistory(runner, dir, size);
+
+    g_autoptr(GError) error = NULL;
+    if (!dnf_remove_recursive_v2(dir.c_str(), &error))
+        std::cerr << "Cannot remove " << dir << ": " << error->message << std::endl;
+}
+
+bool
+parseArgs(int argc, char *argv[], Options & options)
+{
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.compare(0, 8, "--sizes=") == 0) {
+            options.sizes.clear();
+            std::istringstream list(arg.substr(8));
+            std::string size;
+            while (std::getline(list, size, ','))
+                options.sizes.push_back(std::stoul(size));
+        } else if (arg.compare(0, 13, "--iterations=") == 0) {
+            options.iterations = std::stoul(arg.substr(13));
+        } else if (arg.compare(0, 9, "--filter=") == 0) {
+            options.filter = arg.substr(9);
+        } else {
+            return false;
+        }
+    }
+    return !options.sizes.empty() && options.iterations > 0;
+}
+
+}
+
+int
+main(int argc, char *argv[])
+{
+    Options options;
+    try {
+        if (!parseArgs(argc, argv, options)) {
+            std::cerr << "Usage: " << argv[0]
+                      << " [--sizes=N[,N...]] [--iterations=N] [--filter=SUBSTRING]" << std::endl;
+            return EXIT_FAILURE;
+        }
+        Runner runner(options);
+        for (auto size : options.sizes)
+            runAll(runner, size);
+    } catch (const std::exception & e) {
+        std::cerr << "libdnf-bench: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
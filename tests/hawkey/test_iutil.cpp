@@ -19,11 +19,13 @@
  */
 
 #include <stdlib.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #include <glib.h>
 
 
 #include <solv/pool.h>
+#include <solv/solv_xfopen.h>
 
 
 #include "libdnf/hy-util.h"
@@ -124,6 +126,66 @@ START_TEST(test_checksum_write_read)
 }
 END_TEST
 
+START_TEST(test_checksum_strv)
+{
+    unsigned char cs1[CHKSUM_BYTES];
+    unsigned char cs2[CHKSUM_BYTES];
+    const char *strv1[] = {"ab", "c", NULL};
+    const char *strv2[] = {"a", "bc", NULL};
+
+    fail_if(checksum_strv(cs1, strv1));
+    fail_if(checksum_strv(cs2, strv1));
+    fail_if(checksum_cmp(cs1, cs2));
+    fail_if(checksum_strv(cs2, strv2));
+    fail_unless(checksum_cmp(cs1, cs2));
+}
+END_TEST
+
+START_TEST(test_xfopen_pipelined)
+{
+    char *fn = solv_dupjoin(test_globals.tmpdir, "/test_xfopen_pipelined.gz", NULL);
+    FILE *fp = solv_xfopen(fn, "w");
+    fail_if(fp == NULL);
+    for (int i = 0; i < 100000; ++i)
+        fail_unless(fprintf(fp, "line %d\n", i) > 0);
+    fail_if(fclose(fp));
+
+    fp = solv_xfopen_pipelined(fn);
+    fail_if(fp == NULL);
+    char line[32];
+    int i = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        char expected[32];
+        snprintf(expected, sizeof(expected), "line %d\n", i++);
+        ck_assert_str_eq(line, expected);
+    }
+    ck_assert_int_eq(i, 100000);
+    fail_if(ferror(fp));
+    fail_if(fclose(fp));
+
+    /* closing before the end stops the decompression */
+    fp = solv_xfopen_pipelined(fn);
+    fail_if(fp == NULL);
+    fail_if(fgets(line, sizeof(line), fp) == NULL);
+    fail_if(fclose(fp));
+
+    /* a truncated file is a read error, not a shorter file */
+    struct stat st;
+    fail_if(stat(fn, &st));
+    fail_if(truncate(fn, st.st_size / 2));
+    fp = solv_xfopen_pipelined(fn);
+    fail_if(fp == NULL);
+    i = 0;
+    while (fgets(line, sizeof(line), fp))
+        i++;
+    fail_unless(i < 100000);
+    fail_unless(ferror(fp));
+    fail_unless(fclose(fp) == EOF);
+
+    g_free(fn);
+}
+END_TEST
+
 START_TEST(test_mkcachedir)
 {
     const char *workdir = test_globals.tmpdir;
@@ -184,6 +246,8 @@ iutil_suite(void)
     tcase_add_test(tc, test_abspath);
     tcase_add_test(tc, test_checksum);
     tcase_add_test(tc, test_checksum_write_read);
+    tcase_add_test(tc, test_checksum_strv);
+    tcase_add_test(tc, test_xfopen_pipelined);
     tcase_add_test(tc, test_mkcachedir);
     tcase_add_test(tc, test_version_split);
     suite_add_tcase(s, tc);
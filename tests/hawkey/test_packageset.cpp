@@ -169,6 +169,54 @@ START_TEST(test_get_pkgid)
 }
 END_TEST
 
+START_TEST(test_sparse_dense)
+{
+    DnfSack *sack = test_globals.sack;
+    int max = dnf_sack_last_solvable(sack);
+
+    // grows past the size kept as an array of ids
+    libdnf::PackageSet all(sack);
+    for (Id id = max; id >= 0; --id)
+        all.set(id);
+    fail_unless(all.size() == static_cast<size_t>(max + 1));
+
+    libdnf::PackageSet rest(all);
+    rest -= *pset;
+    fail_unless(rest.size() == static_cast<size_t>(max - 2));
+    fail_if(rest.has(9));
+    fail_unless(rest.has(8));
+
+    libdnf::PackageSet common(*pset);
+    common /= rest;
+    fail_unless(common.empty());
+    common += *pset;
+    fail_unless(common.size() == 3);
+
+    // converting to the bitmap and back keeps the content
+    Map *map = common.getMutableMap();
+    fail_unless(MAPTST(map, 9));
+    fail_unless(map_count(map) == 3);
+    common.compact();
+    fail_unless(common.size() == 3);
+    fail_unless(common.next(0) == 9);
+    fail_unless(common.next(9) == max);
+    fail_unless(common.next(max) == -1);
+
+    // a bitmap handed out by the const getter is never compacted away
+    const libdnf::PackageSet & constCommon = common;
+    const Map *handedOut = constCommon.getMap();
+    common.compact();
+    fail_unless(MAPTST(handedOut, 9));
+    fail_unless(map_count(handedOut) == 3);
+    fail_unless(common.next(9) == max);
+
+    all /= *pset;
+    all.compact();
+    fail_unless(all.size() == 3);
+    fail_unless(all[1] == 9);
+}
+END_TEST
+
 Suite *
 packageset_suite(void)
 {
@@ -180,6 +228,7 @@ packageset_suite(void)
     tcase_add_test(tc, test_has);
     tcase_add_test(tc, test_get_clone);
     tcase_add_test(tc, test_get_pkgid);
+    tcase_add_test(tc, test_sparse_dense);
     suite_add_tcase(s, tc);
 
     return s;
@@ -790,6 +790,32 @@ START_TEST(test_filter_obsoletes)
 }
 END_TEST
 
+START_TEST(test_obsoletes_index)
+{
+    DnfSack *sack = test_globals.sack;
+    Pool *pool = dnf_sack_get_pool(sack);
+    auto index = dnf_sack_get_obsoletes_index(sack);
+    int obsoleted = 0;
+
+    // the index agrees with expanding obsoletes of every package
+    for (Id id = 2; id < pool->nsolvables; ++id) {
+        libdnf::PackageSet target(sack);
+        target.set(id);
+        libdnf::Query query(sack, libdnf::Query::ExcludeFlags::IGNORE_EXCLUDES);
+        query.addFilter(HY_PKG_OBSOLETES, HY_EQ, &target);
+        auto result = query.runSet();
+
+        auto obsoleters = index->obsoleters(id);
+        ck_assert_int_eq(obsoleters.second - obsoleters.first, result->size());
+        for (auto obsoleter = obsoleters.first; obsoleter != obsoleters.second; ++obsoleter)
+            fail_unless(result->has(*obsoleter));
+        if (obsoleters.first != obsoleters.second)
+            ++obsoleted;
+    }
+    fail_unless(obsoleted > 0);
+}
+END_TEST
+
 START_TEST(test_filter_reponames)
 {
     HyQuery q;
@@ -1099,6 +1125,7 @@ query_suite(void)
     tcase_add_test(tc, test_filter_latest2);
     tcase_add_test(tc, test_filter_latest_archs);
     tcase_add_test(tc, test_filter_obsoletes);
+    tcase_add_test(tc, test_obsoletes_index);
     tcase_add_test(tc, test_filter_reponames);
     suite_add_tcase(s, tc);
 
@@ -0,0 +1,189 @@
+#include "RepoCheckTest.hpp"
+
+#include "libdnf/dnf-repo-loader.h"
+#include "libdnf/hy-iutil-private.hpp"
+
+#include <glib/gstdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+
+CPPUNIT_TEST_SUITE_REGISTRATION(RepoCheckTest);
+
+#define UNITTEST_DIR "/tmp/libdnfXXXXXX"
+
+static const char * const REPODATA_FILES[] = {
+    "repomd.xml",
+    "02517771d46f54572e172605d193e70f158fc88db676cd7d02158736a8f8c7f8-modules.yaml.gz",
+    "7b20d2285e9d41d2f96f67029a28d11249485ad787606017bd855a3263d2209b-primary.xml.gz",
+    "fca8343fe9e52b62cbf4b64a0730ffb546bda5542286a884da54c1db5e522943-filelists.xml.gz",
+};
+
+static ino_t
+inode(const std::string & path)
+{
+    struct stat st;
+    CPPUNIT_ASSERT_EQUAL(0, stat(path.c_str(), &st));
+    return st.st_ino;
+}
+
+static std::string
+contents(const std::string & path)
+{
+    g_autofree gchar * data = nullptr;
+    CPPUNIT_ASSERT(g_file_get_contents(path.c_str(), &data, nullptr, nullptr));
+    return data;
+}
+
+void
+RepoCheckTest::setUp()
+{
+    g_autoptr(GError) error = nullptr;
+
+    tmpdir = g_strdup(UNITTEST_DIR);
+    CPPUNIT_ASSERT(mkdtemp(tmpdir));
+
+    dnf_context_set_config_file_path("");
+    context = dnf_context_new();
+    dnf_context_set_release_ver(context, "26");
+    dnf_context_set_arch(context, "x86_64");
+    dnf_context_set_install_root(context, TESTDATADIR "/modules/");
+    dnf_context_set_repo_dir(context, TESTDATADIR "/modules/yum.repos.d/");
+    dnf_context_set_solv_dir(context, tmpdir);
+    dnf_context_set_cache_dir(context, tmpdir);
+    dnf_context_set_write_history(context, FALSE);
+    CPPUNIT_ASSERT(dnf_context_setup(context, nullptr, &error));
+
+    /* copy the metadata into a cache directory of a remote repo, only the
+     * metadata of those is verified by the metadata-verified file */
+    location = std::string(tmpdir) + "/test";
+    std::string repodata = location + "/repodata";
+    CPPUNIT_ASSERT_EQUAL(0, g_mkdir_with_parents(repodata.c_str(), 0755));
+    for (auto name : REPODATA_FILES) {
+        std::string source = std::string(TESTDATADIR "/modules/modules/_all/x86_64/repodata/") + name;
+        g_autofree gchar * data = nullptr;
+        gsize length;
+        CPPUNIT_ASSERT(g_file_get_contents(source.c_str(), &data, &length, &error));
+        CPPUNIT_ASSERT(g_file_set_contents((repodata + "/" + name).c_str(), data, length, &error));
+    }
+
+    repo = dnf_repo_loader_get_repo_by_id(dnf_context_get_repo_loader(context), "test", &error);
+    CPPUNIT_ASSERT(repo != nullptr);
+    dnf_repo_set_location(repo, location.c_str());
+    dnf_repo_set_kind(repo, DNF_REPO_KIND_REMOTE);
+
+    CPPUNIT_ASSERT(check());
+    CPPUNIT_ASSERT(g_file_test(verifiedPath().c_str(), G_FILE_TEST_EXISTS));
+}
+
+void
+RepoCheckTest::tearDown()
+{
+    g_object_unref(context);
+    dnf_remove_recursive_v2(tmpdir, NULL);
+    g_free(tmpdir);
+}
+
+bool
+RepoCheckTest::check()
+{
+    g_autoptr(GError) error = nullptr;
+    g_autoptr(DnfState) state = dnf_state_new();
+    return dnf_repo_check(repo, G_MAXUINT, state, &error);
+}
+
+std::string
+RepoCheckTest::verifiedPath() const
+{
+    return location + "/metadata-verified";
+}
+
+std::string
+RepoCheckTest::primaryPath() const
+{
+    return location + "/repodata/" + REPODATA_FILES[2];
+}
+
+void
+RepoCheckTest::testVerifiedUnchanged()
+{
+    auto before = contents(verifiedPath());
+    auto ino = inode(verifiedPath());
+
+    // the checksums are not verified again, so the file is not rewritten
+    CPPUNIT_ASSERT(check());
+    CPPUNIT_ASSERT_EQUAL(ino, inode(verifiedPath()));
+    CPPUNIT_ASSERT_EQUAL(before, contents(verifiedPath()));
+}
+
+void
+RepoCheckTest::testVerifiedFileTouched()
+{
+    auto before = contents(verifiedPath());
+    auto ino = inode(verifiedPath());
+
+    // a new mtime makes the metadata be verified and recorded again
+    struct utimbuf times = {1000000000, 1000000000};
+    CPPUNIT_ASSERT_EQUAL(0, g_utime(primaryPath().c_str(), &times));
+    CPPUNIT_ASSERT(check());
+    CPPUNIT_ASSERT(inode(verifiedPath()) != ino);
+    CPPUNIT_ASSERT(before != contents(verifiedPath()));
+
+    ino = inode(verifiedPath());
+    CPPUNIT_ASSERT(check());
+    CPPUNIT_ASSERT_EQUAL(ino, inode(verifiedPath()));
+}
+
+void
+RepoCheckTest::testVerifiedFileCorrupted()
+{
+    auto before = contents(verifiedPath());
+
+    // a changed file is hashed and rejected, and it is not recorded as verified
+    g_autofree gchar * data = nullptr;
+    gsize length;
+    CPPUNIT_ASSERT(g_file_get_contents(primaryPath().c_str(), &data, &length, nullptr));
+    data[length / 2] ^= 0xff;
+    CPPUNIT_ASSERT(g_file_set_contents(primaryPath().c_str(), data, length, nullptr));
+    CPPUNIT_ASSERT(!check());
+    CPPUNIT_ASSERT_EQUAL(before, contents(verifiedPath()));
+    CPPUNIT_ASSERT(!check());
+}
+
+void
+RepoCheckTest::testVerifiedTypesChanged()
+{
+    auto before = contents(verifiedPath());
+    auto ino = inode(verifiedPath());
+    bool filelists = dnf_context_get_enable_filelists(context);
+
+    // the requested metadata types are part of the recorded description
+    dnf_context_set_enable_filelists(context, !filelists);
+    CPPUNIT_ASSERT(check());
+    CPPUNIT_ASSERT(inode(verifiedPath()) != ino);
+    auto after = contents(verifiedPath());
+    CPPUNIT_ASSERT(before != after);
+    CPPUNIT_ASSERT_EQUAL(!filelists, after.substr(0, after.find('\n')).find(" filelists") !=
+                         std::string::npos);
+
+    dnf_context_set_enable_filelists(context, filelists);
+    CPPUNIT_ASSERT(check());
+    CPPUNIT_ASSERT_EQUAL(before.substr(0, before.find('\n')),
+                         contents(verifiedPath()).substr(0, before.find('\n')));
+}
+
+void
+RepoCheckTest::testVerifiedNotRegular()
+{
+    // a record that is not a regular file we own is neither trusted nor replaced
+    std::string target = std::string(tmpdir) + "/elsewhere";
+    CPPUNIT_ASSERT(g_file_set_contents(target.c_str(), "stale", -1, nullptr));
+    CPPUNIT_ASSERT_EQUAL(0, g_unlink(verifiedPath().c_str()));
+    CPPUNIT_ASSERT_EQUAL(0, symlink(target.c_str(), verifiedPath().c_str()));
+
+    CPPUNIT_ASSERT(check());
+    struct stat st;
+    CPPUNIT_ASSERT_EQUAL(0, lstat(verifiedPath().c_str(), &st));
+    CPPUNIT_ASSERT(S_ISLNK(st.st_mode));
+    CPPUNIT_ASSERT_EQUAL(std::string("stale"), contents(target));
+}
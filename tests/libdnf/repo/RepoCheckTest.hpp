@@ -0,0 +1,42 @@
+#ifndef LIBDNF_REPO_CHECK_TEST_HPP
+#define LIBDNF_REPO_CHECK_TEST_HPP
+
+#include <cppunit/TestCase.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "libdnf/dnf-context.h"
+#include "libdnf/dnf-repo.h"
+
+#include <string>
+
+class RepoCheckTest : public CppUnit::TestCase {
+    CPPUNIT_TEST_SUITE(RepoCheckTest);
+    CPPUNIT_TEST(testVerifiedUnchanged);
+    CPPUNIT_TEST(testVerifiedFileTouched);
+    CPPUNIT_TEST(testVerifiedFileCorrupted);
+    CPPUNIT_TEST(testVerifiedTypesChanged);
+    CPPUNIT_TEST(testVerifiedNotRegular);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void setUp() override;
+    void tearDown() override;
+
+    void testVerifiedUnchanged();
+    void testVerifiedFileTouched();
+    void testVerifiedFileCorrupted();
+    void testVerifiedTypesChanged();
+    void testVerifiedNotRegular();
+
+private:
+    bool check();
+    std::string verifiedPath() const;
+    std::string primaryPath() const;
+
+    char * tmpdir;
+    std::string location;
+    DnfContext * context;
+    DnfRepo * repo;
+};
+
+#endif // LIBDNF_REPO_CHECK_TEST_HPP
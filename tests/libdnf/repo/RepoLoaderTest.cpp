@@ -0,0 +1,111 @@
+#include "RepoLoaderTest.hpp"
+
+#include "libdnf/dnf-repo-loader-private.hpp"
+#include "libdnf/dnf-repo.h"
+#include "libdnf/hy-iutil-private.hpp"
+
+#include <glib/gstdio.h>
+#include <string.h>
+
+CPPUNIT_TEST_SUITE_REGISTRATION(RepoLoaderTest);
+
+#define UNITTEST_DIR "/tmp/libdnfXXXXXX"
+
+void
+RepoLoaderTest::setUp()
+{
+    g_autoptr(GError) error = nullptr;
+
+    tmpdir = g_strdup(UNITTEST_DIR);
+    CPPUNIT_ASSERT(mkdtemp(tmpdir));
+
+    std::string repoDir = std::string(tmpdir) + "/yum.repos.d";
+    CPPUNIT_ASSERT_EQUAL(0, g_mkdir_with_parents(repoDir.c_str(), 0755));
+    repoFile = repoDir + "/test.repo";
+    writeRepoFile("Repo A");
+
+    dnf_context_set_config_file_path("");
+    context = dnf_context_new();
+    dnf_context_set_release_ver(context, "26");
+    dnf_context_set_arch(context, "x86_64");
+    dnf_context_set_install_root(context, TESTDATADIR "/modules/");
+    dnf_context_set_repo_dir(context, repoDir.c_str());
+    dnf_context_set_solv_dir(context, tmpdir);
+    dnf_context_set_cache_dir(context, tmpdir);
+    dnf_context_set_write_history(context, FALSE);
+    CPPUNIT_ASSERT(dnf_context_setup(context, nullptr, &error));
+
+    loader = dnf_context_get_repo_loader(context);
+}
+
+void
+RepoLoaderTest::tearDown()
+{
+    g_object_unref(context);
+    dnf_remove_recursive_v2(tmpdir, NULL);
+    g_free(tmpdir);
+}
+
+void
+RepoLoaderTest::writeRepoFile(const char * nameA)
+{
+    g_autoptr(GError) error = nullptr;
+    std::string data = std::string("[a]\nname=") + nameA + "\nbaseurl=file://" + tmpdir + "/a\nenabled=0\n"
+                       "\n[b]\nname=Repo B\nbaseurl=file://" + tmpdir + "/b\nenabled=0\n";
+    CPPUNIT_ASSERT(g_file_set_contents(repoFile.c_str(), data.c_str(), -1, &error));
+}
+
+std::string
+RepoLoaderTest::description(const char * id)
+{
+    g_autoptr(GError) error = nullptr;
+    auto repo = dnf_repo_loader_get_repo_by_id(loader, id, &error);
+    CPPUNIT_ASSERT(repo != nullptr);
+    g_autofree gchar * name = dnf_repo_get_description(repo);
+    CPPUNIT_ASSERT(name != nullptr);
+    return name;
+}
+
+void
+RepoLoaderTest::testReloadUnchanged()
+{
+    CPPUNIT_ASSERT_EQUAL(std::string("Repo A"), description("a"));
+    dnf_repo_loader_invalidate(loader);
+    CPPUNIT_ASSERT_EQUAL(std::string("Repo A"), description("a"));
+    CPPUNIT_ASSERT_EQUAL(std::string("Repo B"), description("b"));
+}
+
+void
+RepoLoaderTest::testReloadChanged()
+{
+    CPPUNIT_ASSERT_EQUAL(std::string("Repo A"), description("a"));
+    writeRepoFile("Renamed repo A");
+    dnf_repo_loader_invalidate(loader);
+    CPPUNIT_ASSERT_EQUAL(std::string("Renamed repo A"), description("a"));
+    CPPUNIT_ASSERT_EQUAL(std::string("Repo B"), description("b"));
+}
+
+void
+RepoLoaderTest::testReloadOldRepoAlive()
+{
+    g_autoptr(GError) error = nullptr;
+
+    /* a repo of the previous load is still referenced, its keyfile must
+     * not be handed to the repos of the next load */
+    auto old = static_cast<DnfRepo *>(g_object_ref(dnf_repo_loader_get_repo_by_id(loader, "a", &error)));
+    CPPUNIT_ASSERT(old != nullptr);
+    dnf_repo_loader_invalidate(loader);
+    auto repo = dnf_repo_loader_get_repo_by_id(loader, "a", &error);
+    CPPUNIT_ASSERT(repo != nullptr);
+    CPPUNIT_ASSERT(repo != old);
+
+    CPPUNIT_ASSERT(dnf_repo_set_data(old, "name", "Changed by old repo", &error));
+    g_object_unref(old);
+    g_autofree gchar * name = dnf_repo_get_description(repo);
+    CPPUNIT_ASSERT_EQUAL(std::string("Repo A"), std::string(name));
+
+    CPPUNIT_ASSERT(dnf_repo_commit(repo, &error));
+    g_autofree gchar * data = nullptr;
+    CPPUNIT_ASSERT(g_file_get_contents(repoFile.c_str(), &data, nullptr, &error));
+    CPPUNIT_ASSERT(strstr(data, "Changed by old repo") == nullptr);
+}
@@ -0,0 +1,37 @@
+#ifndef LIBDNF_REPO_LOADER_TEST_HPP
+#define LIBDNF_REPO_LOADER_TEST_HPP
+
+#include <cppunit/TestCase.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "libdnf/dnf-context.h"
+#include "libdnf/dnf-repo-loader.h"
+
+#include <string>
+
+class RepoLoaderTest : public CppUnit::TestCase {
+    CPPUNIT_TEST_SUITE(RepoLoaderTest);
+    CPPUNIT_TEST(testReloadUnchanged);
+    CPPUNIT_TEST(testReloadChanged);
+    CPPUNIT_TEST(testReloadOldRepoAlive);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void setUp() override;
+    void tearDown() override;
+
+    void testReloadUnchanged();
+    void testReloadChanged();
+    void testReloadOldRepoAlive();
+
+private:
+    void writeRepoFile(const char * nameA);
+    std::string description(const char * id);
+
+    char * tmpdir;
+    std::string repoFile;
+    DnfContext * context;
+    DnfRepoLoader * loader;
+};
+
+#endif // LIBDNF_REPO_LOADER_TEST_HPP
@@ -0,0 +1,406 @@
+#include "RepoRefreshTest.hpp"
+
+#include "libdnf/hy-iutil-private.hpp"
+#include "libdnf/repo/Repo-private.hpp"
+
+#include <arpa/inet.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <librepo/librepo.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <thread>
+
+CPPUNIT_TEST_SUITE_REGISTRATION(RepoRefreshTest);
+
+#define UNITTEST_DIR "/tmp/libdnfXXXXXX"
+
+#define PRIMARY_X86_64 "7b20d2285e9d41d2f96f67029a28d11249485ad787606017bd855a3263d2209b-primary.xml.gz"
+#define PRIMARY_I686 "27c16fcce1e460811fc9c9edc21d54f52aa75dd49365d66d010ac3fb506803f2-primary.xml.gz"
+
+static void
+writeFile(const std::string & path, const char * data)
+{
+    CPPUNIT_ASSERT(g_file_set_contents(path.c_str(), data, -1, nullptr));
+}
+
+static bool
+exists(const std::string & path)
+{
+    return g_file_test(path.c_str(), G_FILE_TEST_EXISTS);
+}
+
+namespace {
+
+/* Serves the files of a directory over HTTP on localhost, one request per connection. A request
+ * with If-Modified-Since is answered by "304 Not Modified" like by a server whose files did not
+ * change, the others get the file with its mtime as Last-Modified. /mirrorlist lists the server
+ * itself. */
+class HttpServer {
+public:
+    explicit HttpServer(const std::string & root);
+    ~HttpServer();
+
+    std::string url() const { return "http://127.0.0.1:" + std::to_string(port); }
+    int conditionalRequests() const { return conditional; }
+
+private:
+    void serve();
+    void handle(int fd);
+
+    std::string root;
+    int listenFd;
+    int port;
+    std::atomic<bool> stop{false};
+    std::atomic<int> conditional{0};
+    std::thread thread;
+};
+
+HttpServer::HttpServer(const std::string & root)
+: root(root)
+{
+    listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    CPPUNIT_ASSERT(listenFd >= 0);
+    struct sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    CPPUNIT_ASSERT_EQUAL(0, bind(listenFd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)));
+    CPPUNIT_ASSERT_EQUAL(0, listen(listenFd, 16));
+    socklen_t len = sizeof(addr);
+    CPPUNIT_ASSERT_EQUAL(0, getsockname(listenFd, reinterpret_cast<struct sockaddr *>(&addr), &len));
+    port = ntohs(addr.sin_port);
+    thread = std::thread(&HttpServer::serve, this);
+}
+
+HttpServer::~HttpServer()
+{
+    stop = true;
+    thread.join();
+    close(listenFd);
+}
+
+void
+HttpServer::serve()
+{
+    while (!stop) {
+        struct pollfd pfd = {listenFd, POLLIN, 0};
+        if (poll(&pfd, 1, 100) <= 0)
+            continue;
+        int fd = accept(listenFd, nullptr, nullptr);
+        if (fd < 0)
+            continue;
+        handle(fd);
+        close(fd);
+    }
+}
+
+void
+HttpServer::handle(int fd)
+{
+    std::string request;
+    char buf[4096];
+    while (request.find("\r\n\r\n") == std::string::npos) {
+        auto got = recv(fd, buf, sizeof(buf), 0);
+        if (got <= 0)
+            return;
+        request.append(buf, got);
+    }
+    auto lower = request;
+    std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+    auto pathStart = request.find(' ') + 1;
+    auto path = request.substr(pathStart, request.find(' ', pathStart) - pathStart);
+
+    std::string response;
+    g_autofree gchar * data = nullptr;
+    gsize length;
+    struct stat st;
+    auto fn = root + path;
+    if (lower.find("\r\nif-modified-since:") != std::string::npos) {
+        ++conditional;
+        response = "HTTP/1.1 304 Not Modified\r\nConnection: close\r\n\r\n";
+    } else if (path == "/mirrorlist") {
+        auto body = url() + "/\n";
+        response = "HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string(body.size()) +
+                   "\r\nConnection: close\r\n\r\n" + body;
+    } else if (stat(fn.c_str(), &st) == 0 && g_file_get_contents(fn.c_str(), &data, &length, nullptr)) {
+        response = "HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string(length) +
+                   "\r\nLast-Modified: " + libdnf::httpDate(st.st_mtime) +
+                   "\r\nConnection: close\r\n\r\n" + std::string(data, length);
+    } else {
+        response = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+    }
+    for (size_t sent = 0; sent < response.size(); ) {
+        auto done = send(fd, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+        if (done <= 0)
+            return;
+        sent += done;
+    }
+}
+
+}
+
+void
+RepoRefreshTest::setUp()
+{
+    tmpdir = g_strdup(UNITTEST_DIR);
+    CPPUNIT_ASSERT(mkdtemp(tmpdir));
+    origin = std::string(tmpdir) + "/origin";
+    publish("x86_64");
+
+    config.reset(new libdnf::ConfigMain);
+    config->cachedir().set(libdnf::Option::Priority::RUNTIME, std::string(tmpdir) + "/cache");
+
+    // the first load downloads the metadata into the cache
+    auto repo = makeRepo(libdnf::Repo::SyncStrategy::TRY_CACHE);
+    CPPUNIT_ASSERT(repo->load());
+    ageCache(*repo);
+}
+
+void
+RepoRefreshTest::tearDown()
+{
+    config.reset();
+    dnf_remove_recursive_v2(tmpdir, NULL);
+    g_free(tmpdir);
+}
+
+std::unique_ptr<libdnf::Repo>
+RepoRefreshTest::makeRepo(libdnf::Repo::SyncStrategy strategy)
+{
+    std::unique_ptr<libdnf::ConfigRepo> conf(new libdnf::ConfigRepo(*config));
+    conf->baseurl().set(libdnf::Option::Priority::RUNTIME, std::vector<std::string>{"file://" + origin});
+    std::unique_ptr<libdnf::Repo> repo(new libdnf::Repo("test", std::move(conf)));
+    repo->setSyncStrategy(strategy);
+    return repo;
+}
+
+/* replaces the metadata the origin serves by those of an architecture of the test repo */
+void
+RepoRefreshTest::publish(const char * arch)
+{
+    auto source = std::string(TESTDATADIR "/modules/modules/_all/") + arch + "/repodata";
+    auto repodata = origin + "/repodata";
+    CPPUNIT_ASSERT_EQUAL(0, g_mkdir_with_parents(origin.c_str(), 0755));
+    CPPUNIT_ASSERT(!exists(repodata) || dnf_remove_recursive_v2(repodata.c_str(), NULL));
+    CPPUNIT_ASSERT(dnf_copy_recursive(source, repodata, NULL));
+}
+
+/* makes the cached metadata expired */
+void
+RepoRefreshTest::ageCache(libdnf::Repo & repo)
+{
+    struct utimbuf times = {1000000000, 1000000000};
+    CPPUNIT_ASSERT_EQUAL(0, g_utime(repo.getMetadataPath("primary").c_str(), &times));
+}
+
+bool
+RepoRefreshTest::hasRefreshDirs(const std::string & cachedir)
+{
+    GDir * dir = g_dir_open(cachedir.c_str(), 0, nullptr);
+    CPPUNIT_ASSERT(dir != nullptr);
+    bool found = false;
+    while (auto name = g_dir_read_name(dir))
+        found = found || g_str_has_prefix(name, "refresh.");
+    g_dir_close(dir);
+    return found;
+}
+
+void
+RepoRefreshTest::testRefreshUnchanged()
+{
+    auto repo = makeRepo(libdnf::Repo::SyncStrategy::BACKGROUND);
+    CPPUNIT_ASSERT(!repo->load());
+    repo->waitForRefresh();
+    CPPUNIT_ASSERT(!repo->isRefreshReady());
+
+    // the same repomd.xml makes the cache current again
+    CPPUNIT_ASSERT(!repo->load());
+    CPPUNIT_ASSERT(!repo->isExpired());
+    CPPUNIT_ASSERT(!hasRefreshDirs(repo->getCachedir()));
+}
+
+void
+RepoRefreshTest::testRefreshSwap()
+{
+    publish("i686");
+    auto repo = makeRepo(libdnf::Repo::SyncStrategy::BACKGROUND);
+    CPPUNIT_ASSERT(!repo->load());
+    auto oldPrimary = repo->getMetadataPath("primary");
+    CPPUNIT_ASSERT(g_str_has_suffix(oldPrimary.c_str(), PRIMARY_X86_64));
+
+    // the new metadata wait in a staging directory until the next load()
+    repo->waitForRefresh();
+    CPPUNIT_ASSERT(repo->isRefreshReady());
+    CPPUNIT_ASSERT(exists(oldPrimary));
+    CPPUNIT_ASSERT(hasRefreshDirs(repo->getCachedir()));
+
+    CPPUNIT_ASSERT(repo->load());
+    auto newPrimary = repo->getMetadataPath("primary");
+    CPPUNIT_ASSERT(g_str_has_suffix(newPrimary.c_str(), PRIMARY_I686));
+    CPPUNIT_ASSERT(exists(newPrimary));
+    CPPUNIT_ASSERT(!exists(oldPrimary));
+    CPPUNIT_ASSERT(!repo->isRefreshReady());
+    CPPUNIT_ASSERT(!hasRefreshDirs(repo->getCachedir()));
+}
+
+void
+RepoRefreshTest::testSwapFallback()
+{
+    auto cachedir = std::string(tmpdir) + "/swap";
+    auto stagingdir = cachedir + "/staging";
+    auto olddir = cachedir + "/old";
+    auto targetdir = cachedir + "/target";
+    for (const auto & dir : {stagingdir + "/repodata", stagingdir + "/added", olddir,
+                             targetdir + "/repodata"})
+        CPPUNIT_ASSERT_EQUAL(0, g_mkdir_with_parents(dir.c_str(), 0755));
+    writeFile(stagingdir + "/repodata/new", "new");
+    writeFile(targetdir + "/repodata/old", "old");
+
+    // without RENAME_EXCHANGE the replaced directory is moved aside first
+    libdnf::swapStagedMetadata(stagingdir, targetdir, olddir, false);
+    CPPUNIT_ASSERT(exists(targetdir + "/repodata/new"));
+    CPPUNIT_ASSERT(!exists(targetdir + "/repodata/old"));
+    CPPUNIT_ASSERT(exists(targetdir + "/added"));
+    CPPUNIT_ASSERT(exists(olddir + "/old.repodata/old"));
+    CPPUNIT_ASSERT(!exists(stagingdir + "/repodata"));
+
+    // a missing staging directory leaves the cache alone
+    libdnf::swapStagedMetadata(cachedir + "/missing", targetdir, olddir);
+    CPPUNIT_ASSERT(exists(targetdir + "/repodata/new"));
+}
+
+void
+RepoRefreshTest::testCancelInDestructor()
+{
+    publish("i686");
+    std::string cachedir;
+    {
+        // the refresh is cancelled or finished, its files are removed in both cases
+        auto repo = makeRepo(libdnf::Repo::SyncStrategy::BACKGROUND);
+        CPPUNIT_ASSERT(!repo->load());
+        cachedir = repo->getCachedir();
+    }
+    CPPUNIT_ASSERT(!hasRefreshDirs(cachedir));
+
+    auto repo = makeRepo(libdnf::Repo::SyncStrategy::ONLY_CACHE);
+    CPPUNIT_ASSERT(!repo->load());
+    CPPUNIT_ASSERT(g_str_has_suffix(repo->getMetadataPath("primary").c_str(), PRIMARY_X86_64));
+}
+
+void
+RepoRefreshTest::testHttpDate()
+{
+    CPPUNIT_ASSERT_EQUAL(std::string("Thu, 01 Jan 1970 00:00:00 GMT"), libdnf::httpDate(0));
+    CPPUNIT_ASSERT_EQUAL(std::string("Sun, 09 Sep 2001 01:46:40 GMT"), libdnf::httpDate(1000000000));
+    CPPUNIT_ASSERT_EQUAL(std::string("Tue, 29 Feb 2000 23:59:59 GMT"), libdnf::httpDate(951868799));
+}
+
+namespace {
+
+class CountingCB : public libdnf::RepoCB {
+public:
+    int progress(double totalToDownload, double downloaded) override { ++progressCalls; return 0; }
+    int handleMirrorFailure(const char * msg, const char * url, const char * metadata) override
+    {
+        ++mirrorFailures;
+        return 0;
+    }
+
+    int progressCalls{0};
+    int mirrorFailures{0};
+};
+
+}
+
+void
+RepoRefreshTest::testRevalidationCallbacks()
+{
+    const char * url = "http://example.com/repodata/repomd.xml";
+    CPPUNIT_ASSERT(libdnf::isNotModifiedFailure("Status code: 304 for http://example.com/repodata/repomd.xml"));
+    CPPUNIT_ASSERT(!libdnf::isNotModifiedFailure("Status code: 404 for http://example.com/repodata/repomd.xml"));
+    CPPUNIT_ASSERT(!libdnf::isNotModifiedFailure("Status code: 3040 for http://example.com/"));
+    CPPUNIT_ASSERT(!libdnf::isNotModifiedFailure("Curl error (7): Couldn't connect to server"));
+
+    // a 304 stops trying other mirrors, other failures and the progress reach the user callbacks
+    CountingCB callbacks;
+    libdnf::RevalidationData data{nullptr, false, &callbacks, true};
+    CPPUNIT_ASSERT_EQUAL(static_cast<int>(LR_CB_OK), libdnf::revalidationMirrorFailureCB(&data,
+        "Status code: 404 for http://example.com/repodata/repomd.xml", url, "repomd.xml"));
+    CPPUNIT_ASSERT(!data.notModified);
+    CPPUNIT_ASSERT_EQUAL(1, callbacks.mirrorFailures);
+    CPPUNIT_ASSERT_EQUAL(static_cast<int>(LR_CB_ERROR), libdnf::revalidationMirrorFailureCB(&data,
+        "Status code: 304 for http://example.com/repodata/repomd.xml", url, "repomd.xml"));
+    CPPUNIT_ASSERT(data.notModified);
+    CPPUNIT_ASSERT_EQUAL(1, callbacks.mirrorFailures);
+    CPPUNIT_ASSERT_EQUAL(static_cast<int>(LR_CB_OK), libdnf::revalidationProgressCB(&data, 10, 5));
+    CPPUNIT_ASSERT_EQUAL(1, callbacks.progressCalls);
+
+    // only the interruption by the callback means the repomd.xml was not modified
+    CPPUNIT_ASSERT(libdnf::isNotModified(data, libdnf::LrException(LRE_CBINTERRUPTED, "interrupted")));
+    CPPUNIT_ASSERT(!libdnf::isNotModified(data, libdnf::LrException(LRE_BADSTATUS, "bad status")));
+
+    // a 304 to a request that was not conditional is a failure like any other
+    libdnf::RevalidationData unconditional{nullptr, false, &callbacks, false};
+    CPPUNIT_ASSERT_EQUAL(static_cast<int>(LR_CB_OK), libdnf::revalidationMirrorFailureCB(&unconditional,
+        "Status code: 304 for http://example.com/repodata/repomd.xml", url, "repomd.xml"));
+    CPPUNIT_ASSERT(!unconditional.notModified);
+    CPPUNIT_ASSERT_EQUAL(2, callbacks.mirrorFailures);
+    CPPUNIT_ASSERT(!libdnf::isNotModified(unconditional, libdnf::LrException(LRE_CBINTERRUPTED, "interrupted")));
+
+    // the background refresh has no user callbacks, only a cancel flag
+    std::atomic<bool> cancel{false};
+    libdnf::RevalidationData background{&cancel, false, nullptr, true};
+    CPPUNIT_ASSERT_EQUAL(static_cast<int>(LR_CB_OK), libdnf::revalidationProgressCB(&background, 10, 5));
+    cancel = true;
+    CPPUNIT_ASSERT_EQUAL(static_cast<int>(LR_CB_ABORT), libdnf::revalidationProgressCB(&background, 10, 5));
+    CPPUNIT_ASSERT_EQUAL(static_cast<int>(LR_CB_OK), libdnf::revalidationMirrorFailureCB(&background,
+        "Curl error (7): Couldn't connect to server", url, "repomd.xml"));
+}
+
+void
+RepoRefreshTest::testRevalidationNotModified()
+{
+    // the server reports the date of the origin's repomd.xml as Last-Modified
+    struct utimbuf times = {1000000000, 1000000000};
+    CPPUNIT_ASSERT_EQUAL(0, g_utime((origin + "/repodata/repomd.xml").c_str(), &times));
+    HttpServer server(origin);
+
+    // each load starts with an expired cache: the first one downloads the metadata, the second
+    // one revalidates them unconditionally and stores the date, the third one sends it
+    auto load = [this](const char * id, bool mirrorlist, const std::string & url) {
+        std::unique_ptr<libdnf::ConfigRepo> conf(new libdnf::ConfigRepo(*config));
+        if (mirrorlist)
+            conf->mirrorlist().set(libdnf::Option::Priority::RUNTIME, url + "/mirrorlist");
+        else
+            conf->baseurl().set(libdnf::Option::Priority::RUNTIME, std::vector<std::string>{url});
+        libdnf::Repo repo(id, std::move(conf));
+        repo.setSyncStrategy(libdnf::Repo::SyncStrategy::TRY_CACHE);
+        CPPUNIT_ASSERT(repo.load());
+        CPPUNIT_ASSERT(!repo.isExpired());
+        auto lastModified = repo.getCachedir() + "/repodata/repomd.xml.last-modified";
+        ageCache(repo);
+        return exists(lastModified);
+    };
+
+    CPPUNIT_ASSERT(!load("http", false, server.url()));
+    CPPUNIT_ASSERT(load("http", false, server.url()));
+    CPPUNIT_ASSERT_EQUAL(0, server.conditionalRequests());
+    CPPUNIT_ASSERT(load("http", false, server.url()));
+    CPPUNIT_ASSERT_EQUAL(1, server.conditionalRequests());
+
+    // the mirrorlist is fetched on the same handle, so its requests are never conditional and
+    // cannot be answered by a 304 meant for a repomd.xml
+    CPPUNIT_ASSERT(!load("mirrored", true, server.url()));
+    CPPUNIT_ASSERT(load("mirrored", true, server.url()));
+    CPPUNIT_ASSERT(load("mirrored", true, server.url()));
+    CPPUNIT_ASSERT_EQUAL(1, server.conditionalRequests());
+}
@@ -0,0 +1,47 @@
+#ifndef LIBDNF_REPO_REFRESH_TEST_HPP
+#define LIBDNF_REPO_REFRESH_TEST_HPP
+
+#include <cppunit/TestCase.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "libdnf/conf/ConfigMain.hpp"
+#include "libdnf/repo/Repo.hpp"
+
+#include <memory>
+#include <string>
+
+class RepoRefreshTest : public CppUnit::TestCase {
+    CPPUNIT_TEST_SUITE(RepoRefreshTest);
+    CPPUNIT_TEST(testRefreshUnchanged);
+    CPPUNIT_TEST(testRefreshSwap);
+    CPPUNIT_TEST(testSwapFallback);
+    CPPUNIT_TEST(testCancelInDestructor);
+    CPPUNIT_TEST(testHttpDate);
+    CPPUNIT_TEST(testRevalidationCallbacks);
+    CPPUNIT_TEST(testRevalidationNotModified);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void setUp() override;
+    void tearDown() override;
+
+    void testRefreshUnchanged();
+    void testRefreshSwap();
+    void testSwapFallback();
+    void testCancelInDestructor();
+    void testHttpDate();
+    void testRevalidationCallbacks();
+    void testRevalidationNotModified();
+
+private:
+    std::unique_ptr<libdnf::Repo> makeRepo(libdnf::Repo::SyncStrategy strategy);
+    void publish(const char * arch);
+    void ageCache(libdnf::Repo & repo);
+    bool hasRefreshDirs(const std::string & cachedir);
+
+    char * tmpdir;
+    std::string origin;
+    std::unique_ptr<libdnf::ConfigMain> config;
+};
+
+#endif // LIBDNF_REPO_REFRESH_TEST_HPP
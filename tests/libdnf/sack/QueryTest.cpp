@@ -1,12 +1,93 @@
 #include "QueryTest.hpp"
 
+#include "libdnf/dnf-context.hpp"
+#include "libdnf/dnf-package.h"
 #include "libdnf/dnf-sack-private.hpp"
+#include "libdnf/goal/Goal.hpp"
 #include "libdnf/hy-iutil-private.hpp"
+#include "libdnf/nevra.hpp"
+#include "libdnf/sack/packageset.hpp"
+#include "libdnf/sack/selector.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <solv/dataiterator.h>
+#include <solv/evr.h>
 
 CPPUNIT_TEST_SUITE_REGISTRATION(QueryTest);
 
 #define UNITTEST_DIR "/tmp/libdnfXXXXXX"
 
+static DnfSack *
+loadAdvisoryRepo(const char * cachedir, int flags)
+{
+    g_autoptr(GError) error = nullptr;
+    DnfSack * sack = dnf_sack_new();
+    dnf_sack_set_cachedir(sack, cachedir);
+    dnf_sack_set_arch(sack, "x86_64", NULL);
+    dnf_sack_setup(sack, 0, NULL);
+    HyRepo repo = hy_repo_create("test_text_index_repo");
+    std::string repodata = std::string(TESTDATADIR "/advisories/repodata/");
+    hy_repo_set_string(repo, HY_REPO_MD_FN, (repodata + "repomd.xml").c_str());
+    hy_repo_set_string(repo, HY_REPO_PRIMARY_FN, (repodata + "primary.xml.gz").c_str());
+    CPPUNIT_ASSERT(dnf_sack_load_repo(sack, repo, flags, &error));
+    hy_repo_free(repo);
+    return sack;
+}
+
+static void
+loadAdvisoryRepoWithPriority(DnfSack * sack, const char * name, int priority)
+{
+    g_autoptr(GError) error = nullptr;
+    HyRepo repo = hy_repo_create(name);
+    std::string repodata = std::string(TESTDATADIR "/advisories/repodata/");
+    hy_repo_set_string(repo, HY_REPO_MD_FN, (repodata + "repomd.xml").c_str());
+    hy_repo_set_string(repo, HY_REPO_PRIMARY_FN, (repodata + "primary.xml.gz").c_str());
+    hy_repo_set_string(repo, HY_REPO_UPDATEINFO_FN, (repodata + "updateinfo.xml.gz").c_str());
+    hy_repo_set_priority(repo, priority);
+    CPPUNIT_ASSERT(dnf_sack_load_repo(sack, repo, DNF_SACK_LOAD_FLAG_USE_UPDATEINFO, &error));
+    hy_repo_free(repo);
+}
+
+static void
+loadFilesRepo(DnfSack * sack, const char * name, const std::string & repodata,
+              const char * primary, const char * filelists)
+{
+    g_autoptr(GError) error = nullptr;
+    HyRepo repo = hy_repo_create(name);
+    hy_repo_set_string(repo, HY_REPO_MD_FN, (repodata + "repomd.xml").c_str());
+    hy_repo_set_string(repo, HY_REPO_PRIMARY_FN, (repodata + primary).c_str());
+    hy_repo_set_string(repo, HY_REPO_FILELISTS_FN, (repodata + filelists).c_str());
+    CPPUNIT_ASSERT(dnf_sack_load_repo(sack, repo, DNF_SACK_LOAD_FLAG_USE_FILELISTS, &error));
+    hy_repo_free(repo);
+}
+
+static size_t
+textQuerySize(DnfSack * sack, int keyname, int cmpType, const char * match)
+{
+    libdnf::Query query(sack, libdnf::Query::ExcludeFlags::IGNORE_EXCLUDES);
+    query.addFilter(keyname, cmpType, match);
+    return query.size();
+}
+
+static size_t
+dataiteratorFileMatches(Pool * pool, int cmpType, const char * match, Map * m)
+{
+    int flags = SEARCH_FILES | SEARCH_COMPLETE_FILELIST;
+    flags |= (cmpType & HY_GLOB) ? SEARCH_GLOB : SEARCH_STRING;
+    if (cmpType & HY_ICASE)
+        flags |= SEARCH_NOCASE;
+    Dataiterator di;
+    dataiterator_init(&di, pool, 0, 0, SOLVABLE_FILELIST, match, flags);
+    while (dataiterator_step(&di))
+        MAPSET(m, di.solvid);
+    dataiterator_free(&di);
+    size_t count = 0;
+    for (Id id = 0; id < pool->nsolvables; ++id)
+        count += MAPTST(m, id) ? 1 : 0;
+    return count;
+}
+
 void QueryTest::setUp()
 {
     g_autoptr(GError) error = nullptr;
@@ -149,3 +230,572 @@ void QueryTest::testQueryFilterAdvisory()
     g_object_unref(pkg);
     delete query;
 }
+
+void QueryTest::testQueryCopyOnWrite()
+{
+    libdnf::Query base(sack);
+    auto baseSize = base.size();
+    CPPUNIT_ASSERT(baseSize > 0);
+
+    // an applied result is shared by the copies until one of them is modified
+    libdnf::Query copy(base);
+    CPPUNIT_ASSERT(copy.runSet() == base.runSet());
+
+    copy.addFilter(HY_PKG_EMPTY, HY_EQ, 1);
+    CPPUNIT_ASSERT(copy.size() == 0);
+    CPPUNIT_ASSERT(copy.runSet() != base.runSet());
+    CPPUNIT_ASSERT(base.size() == baseSize);
+
+    libdnf::Query assigned(sack);
+    assigned = base;
+    assigned.queryDifference(base);
+    CPPUNIT_ASSERT(assigned.empty());
+    CPPUNIT_ASSERT(base.size() == baseSize);
+
+    libdnf::Query installed(base);
+    installed.installed();
+    installed.queryUnion(copy);
+    CPPUNIT_ASSERT(installed.size() == 0);
+    CPPUNIT_ASSERT(base.size() == baseSize);
+
+    // a handed out result is never shared, neither with earlier nor with later copies
+    libdnf::Query exposed(base);
+    auto exposedSet = exposed.getResultPset();
+    CPPUNIT_ASSERT(exposedSet != base.runSet());
+    libdnf::Query later(exposed);
+    CPPUNIT_ASSERT(later.runSet() != exposed.runSet());
+    exposedSet->clear();
+    CPPUNIT_ASSERT(exposed.size() == 0);
+    CPPUNIT_ASSERT(later.size() == baseSize);
+    CPPUNIT_ASSERT(base.size() == baseSize);
+
+    libdnf::Query exposedMap(base);
+    map_empty(exposedMap.getResult());
+    CPPUNIT_ASSERT(exposedMap.size() == 0);
+    CPPUNIT_ASSERT(base.size() == baseSize);
+
+    // a handed out bitmap is not compacted away when the query is filtered further
+    libdnf::Query filtered(sack, libdnf::Query::ExcludeFlags::IGNORE_EXCLUDES);
+    filtered.addFilter(HY_PKG_NAME, HY_EQ, "test-perl-DBI");
+    filtered.apply();
+    Map * filteredMap = filtered.getResult();
+    filtered.addFilter(HY_PKG_RELEASE, HY_EQ, "2.module_el8+6587+9879afr5");
+    CPPUNIT_ASSERT(filtered.size() == 1);
+    CPPUNIT_ASSERT(filtered.getResult() == filteredMap);
+    CPPUNIT_ASSERT(MAPTST(filteredMap, (*filtered.runSet())[0]));
+    CPPUNIT_ASSERT(map_count(filteredMap) == 1);
+
+    // the const getter hands out the shared result without copying it
+    libdnf::Query named(sack, libdnf::Query::ExcludeFlags::IGNORE_EXCLUDES);
+    named.addFilter(HY_PKG_NAME, HY_EQ, "test-perl-DBI");
+    auto namedSize = named.size();
+    const libdnf::Query namedCopy(named);
+    const Map * constMap = namedCopy.getResult();
+    CPPUNIT_ASSERT(map_count(constMap) == namedSize);
+    named.addFilter(HY_PKG_RELEASE, HY_EQ, "2.module_el8+6587+9879afr5");
+    CPPUNIT_ASSERT(named.size() == 1);
+    CPPUNIT_ASSERT(map_count(constMap) == namedSize);
+}
+
+void QueryTest::testQueryMove()
+{
+    libdnf::Query base(sack);
+    auto baseSize = base.size();
+    auto baseResult = base.runSet();
+
+    libdnf::Query moved(std::move(base));
+    CPPUNIT_ASSERT(moved.runSet() == baseResult);
+    CPPUNIT_ASSERT(moved.size() == baseSize);
+
+    // a moved-from query can be assigned to again
+    base = moved;
+    CPPUNIT_ASSERT(base.size() == baseSize);
+
+    libdnf::Query assigned(sack);
+    assigned.addFilter(HY_PKG_EMPTY, HY_EQ, 1);
+    assigned = std::move(moved);
+    CPPUNIT_ASSERT(assigned.size() == baseSize);
+}
+
+void QueryTest::testQueryFilterTextIndex()
+{
+    DnfSack * plain = loadAdvisoryRepo(tmpdir, 0);
+    DnfSack * indexed = loadAdvisoryRepo(tmpdir, DNF_SACK_LOAD_FLAG_USE_TEXT_INDEX);
+
+    struct {
+        int keyname;
+        int cmpType;
+        const char * match;
+    } searches[] = {
+        {HY_PKG_SUMMARY, HY_SUBSTR, "Package"},
+        {HY_PKG_SUMMARY, HY_SUBSTR, "package"},
+        {HY_PKG_SUMMARY, HY_SUBSTR | HY_ICASE, "PACKAGE"},
+        {HY_PKG_SUMMARY, HY_EQ, "testpkg Package"},
+        {HY_PKG_SUMMARY, HY_GLOB, "test*Pack[a-z]ge"},
+        {HY_PKG_SUMMARY, HY_SUBSTR, "no such summary"},
+        {HY_PKG_SUMMARY, HY_SUBSTR, "pk"},
+        {HY_PKG_DESCRIPTION, HY_SUBSTR, "perl-DBI test"},
+        {HY_PKG_DESCRIPTION, HY_SUBSTR | HY_NOT, "perl-DBI test"},
+        {HY_PKG_URL, HY_GLOB, "*example*"},
+    };
+    for (const auto & search : searches) {
+        CPPUNIT_ASSERT_EQUAL(textQuerySize(plain, search.keyname, search.cmpType, search.match),
+                             textQuerySize(indexed, search.keyname, search.cmpType, search.match));
+    }
+    CPPUNIT_ASSERT(textQuerySize(indexed, HY_PKG_SUMMARY, HY_SUBSTR | HY_ICASE, "PACKAGE") > 0);
+    CPPUNIT_ASSERT(textQuerySize(indexed, HY_PKG_SUMMARY, HY_SUBSTR, "package") == 0);
+
+    // the index was persisted next to the solv cache and is used by another sack
+    g_autofree gchar * fn = dnf_sack_give_cache_fn(indexed, "test_text_index_repo", HY_EXT_TEXTINDEX);
+    CPPUNIT_ASSERT(g_file_test(fn, G_FILE_TEST_EXISTS));
+    DnfSack * cached = loadAdvisoryRepo(tmpdir, DNF_SACK_LOAD_FLAG_USE_TEXT_INDEX);
+    for (const auto & search : searches) {
+        CPPUNIT_ASSERT_EQUAL(textQuerySize(plain, search.keyname, search.cmpType, search.match),
+                             textQuerySize(cached, search.keyname, search.cmpType, search.match));
+    }
+
+    g_object_unref(cached);
+    g_object_unref(indexed);
+    g_object_unref(plain);
+}
+
+void QueryTest::testQueryFilterOrder()
+{
+    const char * older = "2.module_el8+6587+9879afr5";
+    const char * newer = "2.module_el8+6745+9879ate3";
+
+    // cheaper filters are evaluated first, the result is the same
+    libdnf::Query reordered(sack, libdnf::Query::ExcludeFlags::IGNORE_EXCLUDES);
+    reordered.addFilter(HY_PKG_DESCRIPTION, HY_SUBSTR | HY_NOT, "no such description");
+    reordered.addFilter(HY_PKG_RELEASE, HY_EQ, older);
+    reordered.addFilter(HY_PKG_NAME, HY_EQ, "test-perl-DBI");
+    CPPUNIT_ASSERT(reordered.size() == 1);
+
+    // latest only sees packages kept by the filters added before it
+    libdnf::Query latestAfter(sack, libdnf::Query::ExcludeFlags::IGNORE_EXCLUDES);
+    latestAfter.addFilter(HY_PKG_DESCRIPTION, HY_SUBSTR | HY_NOT, "no such description");
+    latestAfter.addFilter(HY_PKG_RELEASE, HY_NEQ, newer);
+    latestAfter.addFilter(HY_PKG_LATEST, HY_EQ, 1);
+    CPPUNIT_ASSERT(latestAfter.size() == 1);
+
+    libdnf::Query latestBefore(sack, libdnf::Query::ExcludeFlags::IGNORE_EXCLUDES);
+    latestBefore.addFilter(HY_PKG_DESCRIPTION, HY_SUBSTR | HY_NOT, "no such description");
+    latestBefore.addFilter(HY_PKG_LATEST, HY_EQ, 1);
+    latestBefore.addFilter(HY_PKG_RELEASE, HY_NEQ, newer);
+    CPPUNIT_ASSERT(latestBefore.size() == 0);
+
+    // filters following an empty result are skipped
+    libdnf::Query empty(sack, libdnf::Query::ExcludeFlags::IGNORE_EXCLUDES);
+    empty.addFilter(HY_PKG_NAME, HY_EQ, "no-such-package");
+    empty.addFilter(HY_PKG_LATEST, HY_EQ, 1);
+    empty.addFilter(HY_PKG_ADVISORY_TYPE, HY_EQ, "bugfix");
+    CPPUNIT_ASSERT(empty.empty());
+
+    // advisory filters with HY_UPGRADE pick the highest repo priority among the kept packages,
+    // the cheaper repo filter must not be moved before them
+    loadAdvisoryRepoWithPriority(sack, "test_advisory_low", 100);
+    for (int cmpType : {HY_EQG | HY_UPGRADE, HY_EQG, HY_EQG | HY_GT}) {
+        libdnf::Query planned(sack, libdnf::Query::ExcludeFlags::IGNORE_EXCLUDES);
+        planned.addFilter(HY_PKG_ADVISORY_TYPE, cmpType, "enhancement");
+        planned.addFilter(HY_PKG_REPONAME, HY_EQ, "test_advisory_low");
+        planned.addFilter(HY_PKG_RELEASE, HY_NEQ, newer);
+
+        // one filter at a time, in the order they were added
+        libdnf::Query unplanned(sack, libdnf::Query::ExcludeFlags::IGNORE_EXCLUDES);
+        unplanned.addFilter(HY_PKG_ADVISORY_TYPE, cmpType, "enhancement");
+        unplanned.apply();
+        unplanned.addFilter(HY_PKG_REPONAME, HY_EQ, "test_advisory_low");
+        unplanned.apply();
+        unplanned.addFilter(HY_PKG_RELEASE, HY_NEQ, newer);
+        unplanned.apply();
+
+        CPPUNIT_ASSERT_EQUAL(unplanned.size(), planned.size());
+        libdnf::PackageSet difference(*planned.runSet());
+        difference -= *unplanned.runSet();
+        CPPUNIT_ASSERT(difference.empty());
+    }
+    libdnf::Query upgrades(sack, libdnf::Query::ExcludeFlags::IGNORE_EXCLUDES);
+    upgrades.addFilter(HY_PKG_ADVISORY_TYPE, HY_EQG | HY_UPGRADE, "enhancement");
+    CPPUNIT_ASSERT(!upgrades.empty());
+    upgrades.addFilter(HY_PKG_REPONAME, HY_EQ, "test_advisory_low");
+    CPPUNIT_ASSERT(upgrades.empty());
+}
+
+void QueryTest::testQueryFilterSubjects()
+{
+    std::vector<std::string> subjects{
+        "test-perl-DBI",
+        "test-perl-DBI-1-2.module_el8+6587+9879afr5.x86_64",
+        "test-perl-DBI-0:1-2.module_el8+6745+9879ate3.x86_64",
+        "test-perl-DBI.x86_64",
+        "test-perl-DBI-1",
+        "test-perl-*",
+        "test-perl",
+        "TEST-perl-DBI",
+        "no-such-package",
+        "test-perl-DBI",
+    };
+
+    for (bool icase : {false, true}) {
+        libdnf::Query base(sack, libdnf::Query::ExcludeFlags::IGNORE_EXCLUDES);
+        auto matches = base.filterSubjects(subjects, nullptr, icase, true, true, true);
+        CPPUNIT_ASSERT(matches.size() == subjects.size());
+
+        // every subject is resolved the same as by filterSubject()
+        for (std::size_t i = 0; i < subjects.size(); ++i) {
+            libdnf::Query query(sack, libdnf::Query::ExcludeFlags::IGNORE_EXCLUDES);
+            auto ret = query.filterSubject(subjects[i].c_str(), nullptr, icase, true, true, true);
+            auto & match = matches[i];
+            CPPUNIT_ASSERT(match.found == ret.first);
+            CPPUNIT_ASSERT(!match.nevra == !ret.second);
+            if (ret.second)
+                CPPUNIT_ASSERT(match.nevra->getName() == ret.second->getName());
+            CPPUNIT_ASSERT(match.query.size() == query.size());
+            libdnf::PackageSet difference(*match.query.runSet());
+            difference -= *query.runSet();
+            CPPUNIT_ASSERT(difference.empty());
+        }
+    }
+    libdnf::Query base(sack, libdnf::Query::ExcludeFlags::IGNORE_EXCLUDES);
+    auto matches = base.filterSubjects(subjects, nullptr, false, true, false, false);
+    CPPUNIT_ASSERT(matches[0].found && matches[0].query.size() == 2);
+    CPPUNIT_ASSERT(matches[1].found && matches[1].query.size() == 1);
+    CPPUNIT_ASSERT(!matches[6].found && matches[6].query.empty());
+    CPPUNIT_ASSERT(!matches[7].found);
+    CPPUNIT_ASSERT(matches[9].found && matches[9].query.size() == 2);
+}
+
+void QueryTest::testQueryFilterAttribute()
+{
+    using Column = libdnf::AttributeCache::Column;
+    // more repos make one repo a small part of the pool
+    for (auto name : {"test_attribute_1", "test_attribute_2", "test_attribute_3"})
+        loadAdvisoryRepoWithPriority(sack, name, 99);
+    auto cache = dnf_sack_get_attribute_cache(sack);
+    CPPUNIT_ASSERT(!cache->hasColumn(Column::BUILDTIME));
+
+    libdnf::Query all(sack, libdnf::Query::ExcludeFlags::IGNORE_EXCLUDES);
+    g_autoptr(GPtrArray) packages = all.run();
+    CPPUNIT_ASSERT(packages->len > 0);
+
+    // a few packages are looked up one by one without reading the whole column
+    g_autoptr(GPtrArray) one = g_ptr_array_new();
+    g_ptr_array_add(one, g_ptr_array_index(packages, 0));
+    auto first = static_cast<DnfPackage *>(g_ptr_array_index(packages, 0));
+    CPPUNIT_ASSERT(dnf_package_array_get_download_size(one) == dnf_package_get_downloadsize(first));
+    CPPUNIT_ASSERT(!cache->hasColumn(Column::DOWNLOADSIZE));
+    libdnf::Query inRepo(sack, libdnf::Query::ExcludeFlags::IGNORE_EXCLUDES);
+    inRepo.addFilter(HY_PKG_REPONAME, HY_EQ, dnf_package_get_reponame(first));
+    inRepo.filterRecent(0);
+    CPPUNIT_ASSERT(!inRepo.empty());
+    CPPUNIT_ASSERT(!cache->hasColumn(Column::BUILDTIME));
+
+    // cached values are the values of the packages
+    guint64 buildtime = 0;
+    guint64 downloadSize = 0;
+    for (guint i = 0; i < packages->len; ++i) {
+        auto pkg = static_cast<DnfPackage *>(g_ptr_array_index(packages, i));
+        auto id = dnf_package_get_id(pkg);
+        CPPUNIT_ASSERT(cache->column(Column::BUILDTIME)[id] == dnf_package_get_buildtime(pkg));
+        CPPUNIT_ASSERT(cache->column(Column::INSTALLSIZE)[id] == dnf_package_get_installsize(pkg));
+        buildtime = std::max(buildtime, dnf_package_get_buildtime(pkg));
+        downloadSize += dnf_package_get_downloadsize(pkg);
+    }
+    CPPUNIT_ASSERT(cache->hasColumn(Column::BUILDTIME));
+    CPPUNIT_ASSERT(dnf_package_array_get_download_size(packages) == downloadSize);
+
+    libdnf::Query recent(sack, libdnf::Query::ExcludeFlags::IGNORE_EXCLUDES);
+    recent.filterRecent(buildtime - 1);
+    CPPUNIT_ASSERT(!recent.empty());
+    recent.filterRecent(buildtime);
+    CPPUNIT_ASSERT(recent.empty());
+
+    libdnf::Query newest(sack, libdnf::Query::ExcludeFlags::IGNORE_EXCLUDES);
+    newest.filterAttribute(Column::BUILDTIME, HY_EQ, buildtime);
+    libdnf::Query older(sack, libdnf::Query::ExcludeFlags::IGNORE_EXCLUDES);
+    older.filterAttribute(Column::BUILDTIME, HY_EQ | HY_NOT, buildtime);
+    CPPUNIT_ASSERT(newest.size() + older.size() == packages->len);
+    older.filterAttribute(Column::BUILDTIME, HY_GT | HY_EQ, buildtime);
+    CPPUNIT_ASSERT(older.empty());
+}
+
+void QueryTest::testNameArchIndex()
+{
+    Pool * pool = dnf_sack_get_pool(sack);
+    auto index = dnf_sack_get_name_arch_index(sack);
+    CPPUNIT_ASSERT(index == dnf_sack_get_name_arch_index(sack));
+
+    std::vector<Id> ids;
+    for (Id id = 2; id < pool->nsolvables; ++id)
+        ids.push_back(id);
+
+    index->sortByNameArch(ids.data(), ids.data() + ids.size());
+    for (std::size_t i = 1; i < ids.size(); ++i) {
+        Solvable * previous = pool_id2solvable(pool, ids[i - 1]);
+        Solvable * s = pool_id2solvable(pool, ids[i]);
+        CPPUNIT_ASSERT(previous->name <= s->name);
+        if (previous->name != s->name)
+            continue;
+        CPPUNIT_ASSERT(previous->arch <= s->arch);
+        bool sameGroup = previous->arch == s->arch;
+        CPPUNIT_ASSERT(sameGroup == (index->nameArchGroup(ids[i - 1]) == index->nameArchGroup(ids[i])));
+        if (sameGroup)
+            CPPUNIT_ASSERT(pool_evrcmp(pool, previous->evr, s->evr, EVRCMP_COMPARE) >= 0);
+    }
+
+    index->sortByName(ids.data(), ids.data() + ids.size());
+    for (std::size_t i = 1; i < ids.size(); ++i) {
+        Solvable * previous = pool_id2solvable(pool, ids[i - 1]);
+        Solvable * s = pool_id2solvable(pool, ids[i]);
+        CPPUNIT_ASSERT(previous->name <= s->name);
+        if (previous->name == s->name)
+            CPPUNIT_ASSERT(pool_evrcmp(pool, previous->evr, s->evr, EVRCMP_COMPARE) >= 0);
+    }
+
+    libdnf::Query latest(sack, libdnf::Query::ExcludeFlags::IGNORE_EXCLUDES);
+    latest.addFilter(HY_PKG_NAME, HY_EQ, "test-perl-DBI");
+    latest.addFilter(HY_PKG_LATEST_PER_ARCH, HY_EQ, 1);
+    CPPUNIT_ASSERT(latest.size() == 1);
+    DnfPackage * pkg = dnf_package_new(sack, (*latest.runSet())[0]);
+    CPPUNIT_ASSERT(!g_strcmp0(dnf_package_get_release(pkg), "2.module_el8+6745+9879ate3"));
+    g_object_unref(pkg);
+}
+
+void QueryTest::testQueryStream()
+{
+    libdnf::Query query(sack, libdnf::Query::ExcludeFlags::IGNORE_EXCLUDES);
+    query.addFilter(HY_PKG_NAME, HY_EQ, "test-perl-DBI");
+    CPPUNIT_ASSERT(query.exists());
+    CPPUNIT_ASSERT(query.count(1) == 1);
+    CPPUNIT_ASSERT(query.count(0) == 2);
+
+    // ids come in ascending order and the query stays unapplied
+    std::vector<Id> ids;
+    CPPUNIT_ASSERT(query.forEach([&ids](Id id) { ids.push_back(id); return true; }));
+    CPPUNIT_ASSERT(ids.size() == 2 && ids[0] < ids[1]);
+    CPPUNIT_ASSERT(!query.getApplied());
+
+    libdnf::Query limited(query);
+    limited.limit(1);
+    CPPUNIT_ASSERT(limited.getApplied());
+    CPPUNIT_ASSERT(limited.size() == 1);
+    CPPUNIT_ASSERT((*limited.runSet())[0] == ids[0]);
+
+    libdnf::Query none(sack, libdnf::Query::ExcludeFlags::IGNORE_EXCLUDES);
+    none.addFilter(HY_PKG_NAME, HY_EQ, "no-such-package");
+    CPPUNIT_ASSERT(!none.exists());
+    CPPUNIT_ASSERT(none.count(10) == 0);
+
+    // latest needs the whole result and is applied first
+    libdnf::Query latest(query);
+    latest.addFilter(HY_PKG_LATEST_PER_ARCH, HY_EQ, 1);
+    latest.limit(2);
+    CPPUNIT_ASSERT(latest.size() == 1);
+}
+
+void QueryTest::testQueryStreamAdvisory()
+{
+    g_autoptr(GError) error = nullptr;
+    // more solvables than the first streamed range, the second copy of the advisory packages
+    // lands in a later range than the first one
+    std::string repodata = std::string(TESTDATADIR "/modules/modules/_all/x86_64/repodata/");
+    for (int i = 0; i < 25; ++i) {
+        HyRepo repo = hy_repo_create(("test_stream_" + std::to_string(i)).c_str());
+        hy_repo_set_string(repo, HY_REPO_MD_FN, (repodata + "repomd.xml").c_str());
+        hy_repo_set_string(repo, HY_REPO_PRIMARY_FN, (repodata +
+            "7b20d2285e9d41d2f96f67029a28d11249485ad787606017bd855a3263d2209b-primary.xml.gz").c_str());
+        CPPUNIT_ASSERT(dnf_sack_load_repo(sack, repo, DNF_SACK_LOAD_FLAG_NONE, &error));
+        hy_repo_free(repo);
+    }
+    loadAdvisoryRepoWithPriority(sack, "test_advisory_late", 99);
+    CPPUNIT_ASSERT(dnf_sack_get_pool(sack)->nsolvables > 1024);
+
+    // the closest evr is looked up among all kept packages, not within a range of ids
+    for (int cmpType : {HY_EQ, HY_EQG, HY_EQG | HY_GT}) {
+        libdnf::Query streamed(sack, libdnf::Query::ExcludeFlags::IGNORE_EXCLUDES);
+        streamed.addFilter(HY_PKG_ADVISORY_TYPE, cmpType, "enhancement");
+        std::vector<Id> ids;
+        CPPUNIT_ASSERT(streamed.forEach([&ids](Id id) { ids.push_back(id); return true; }));
+
+        libdnf::Query applied(sack, libdnf::Query::ExcludeFlags::IGNORE_EXCLUDES);
+        applied.addFilter(HY_PKG_ADVISORY_TYPE, cmpType, "enhancement");
+        auto pset = applied.runSet();
+        std::vector<Id> expected;
+        for (Id id = pset->next(-1); id != -1; id = pset->next(id))
+            expected.push_back(id);
+
+        CPPUNIT_ASSERT(!expected.empty());
+        CPPUNIT_ASSERT(ids == expected);
+        CPPUNIT_ASSERT_EQUAL(expected.size(), streamed.count(0));
+    }
+}
+
+void QueryTest::testFileIndex()
+{
+    g_autoptr(GError) error = nullptr;
+    DnfSack * filesSack = dnf_sack_new();
+    dnf_sack_set_cachedir(filesSack, tmpdir);
+    dnf_sack_set_arch(filesSack, "x86_64", NULL);
+    dnf_sack_setup(filesSack, 0, NULL);
+    HyRepo filesRepo = hy_repo_create("test_file_index_repo");
+    std::string repodata = std::string(TESTDATADIR "/hawkey/yum/repodata/");
+    hy_repo_set_string(filesRepo, HY_REPO_MD_FN, (repodata + "repomd.xml").c_str());
+    hy_repo_set_string(filesRepo, HY_REPO_PRIMARY_FN, (repodata +
+        "f1ab2aa6c0e5881b9365f83a951e6696812ebfaaf56fee310c3f080c8849a1b4-primary.xml.gz").c_str());
+    hy_repo_set_string(filesRepo, HY_REPO_FILELISTS_FN, (repodata +
+        "4d4b903662ace0b08bda1d53f89c333614b7f658172bc9f0c87b0eef276ff5a1-filelists.xml.gz").c_str());
+    CPPUNIT_ASSERT(dnf_sack_load_repo(filesSack, filesRepo, DNF_SACK_LOAD_FLAG_USE_FILELISTS, &error));
+    hy_repo_free(filesRepo);
+
+    Pool * pool = dnf_sack_get_pool(filesSack);
+    auto fileIndex = dnf_sack_get_file_index(filesSack);
+    CPPUNIT_ASSERT(dnf_sack_get_file_index(filesSack) == fileIndex);
+
+    struct {
+        int cmpType;
+        const char * match;
+        size_t expected;
+    } searches[] = {
+        {HY_EQ, "/usr/bin/away", 1},
+        {HY_EQ, "/usr/bin/aWay", 0},
+        {HY_EQ | HY_ICASE, "/USR/bin/AWAY", 1},
+        {HY_EQ, "/usr/bin", 0},
+        {HY_EQ, "away", 0},
+        {HY_GLOB, "/usr/bin/*", 2},
+        {HY_GLOB, "/usr/lib/*/today.py?", 1},
+        {HY_GLOB, "*/today.py", 1},
+        {HY_GLOB, "*ry", 1},
+        {HY_GLOB, "/etc/[rt]*", 1},
+        {HY_GLOB | HY_ICASE, "/ETC/*UP", 1},
+        {HY_GLOB, "/usr/bin/s?e", 1},
+        {HY_GLOB, "*", 2},
+        {HY_GLOB, "/nothing/*", 0},
+    };
+    for (const auto & search : searches) {
+        Map indexed;
+        Map scanned;
+        map_init(&indexed, pool->nsolvables);
+        map_init(&scanned, pool->nsolvables);
+        fileIndex->match(search.match, search.cmpType, &indexed);
+        CPPUNIT_ASSERT_EQUAL(search.expected,
+                             dataiteratorFileMatches(pool, search.cmpType, search.match, &scanned));
+        CPPUNIT_ASSERT(memcmp(indexed.map, scanned.map, indexed.size) == 0);
+        map_free(&scanned);
+        map_free(&indexed);
+    }
+
+    g_object_unref(filesSack);
+}
+
+void QueryTest::testFileIndexInvalidation()
+{
+    DnfSack * filesSack = dnf_sack_new();
+    dnf_sack_set_cachedir(filesSack, tmpdir);
+    dnf_sack_set_arch(filesSack, "x86_64", NULL);
+    dnf_sack_setup(filesSack, 0, NULL);
+    // enough packages for queries to go through the file index
+    loadFilesRepo(filesSack, "test_all_x86_64", TESTDATADIR "/modules/modules/_all/x86_64/repodata/",
+        "7b20d2285e9d41d2f96f67029a28d11249485ad787606017bd855a3263d2209b-primary.xml.gz",
+        "fca8343fe9e52b62cbf4b64a0730ffb546bda5542286a884da54c1db5e522943-filelists.xml.gz");
+    loadFilesRepo(filesSack, "test_all_i686", TESTDATADIR "/modules/modules/_all/i686/repodata/",
+        "27c16fcce1e460811fc9c9edc21d54f52aa75dd49365d66d010ac3fb506803f2-primary.xml.gz",
+        "2b48025c07f5cfd5170fe7326855d09d65914fc7c14d74998b6226a72451d903-filelists.xml.gz");
+
+    libdnf::Query before(filesSack);
+    CPPUNIT_ASSERT(before.size() > 64);
+    before.addFilter(HY_PKG_FILE, HY_EQ, "/usr/bin/away");
+    CPPUNIT_ASSERT(before.empty());
+
+    // the index built above must not hide the files of a repo loaded later
+    loadFilesRepo(filesSack, "test_file_index_repo", TESTDATADIR "/hawkey/yum/repodata/",
+        "f1ab2aa6c0e5881b9365f83a951e6696812ebfaaf56fee310c3f080c8849a1b4-primary.xml.gz",
+        "4d4b903662ace0b08bda1d53f89c333614b7f658172bc9f0c87b0eef276ff5a1-filelists.xml.gz");
+
+    libdnf::Query after(filesSack);
+    after.addFilter(HY_PKG_FILE, HY_EQ, "/usr/bin/away");
+    CPPUNIT_ASSERT_EQUAL(size_t(1), after.size());
+    auto pkg = dnf_package_new(filesSack, (*after.runSet())[0]);
+    CPPUNIT_ASSERT_EQUAL(std::string("tour"), std::string(dnf_package_get_name(pkg)));
+    g_object_unref(pkg);
+
+    {
+        libdnf::Goal goal(filesSack);
+        libdnf::Selector sltr(filesSack);
+        CPPUNIT_ASSERT_EQUAL(0, sltr.set(HY_PKG_FILE, HY_EQ, "/etc/takeyouaway"));
+        goal.install(&sltr, false);
+        CPPUNIT_ASSERT(!goal.run(DNF_NONE));
+        auto installs = goal.listInstalls();
+        CPPUNIT_ASSERT_EQUAL(size_t(1), installs.size());
+        pkg = dnf_package_new(filesSack, installs[0]);
+        CPPUNIT_ASSERT_EQUAL(std::string("tour"), std::string(dnf_package_get_name(pkg)));
+        g_object_unref(pkg);
+    }
+
+    g_object_unref(filesSack);
+}
+
+static std::vector<Id>
+parallelFilterIds(DnfSack * sack, unsigned threads, int keyname, int cmpType, const char * match)
+{
+    libdnf::getGlobalMainConfig().query_threads().set(libdnf::Option::Priority::RUNTIME, threads);
+    libdnf::Query query(sack, libdnf::Query::ExcludeFlags::IGNORE_EXCLUDES);
+    query.addFilter(keyname, cmpType, match);
+    std::vector<Id> ids;
+    auto pset = query.runSet();
+    for (Id id = pset->next(-1); id != -1; id = pset->next(id))
+        ids.push_back(id);
+    return ids;
+}
+
+void QueryTest::testParallelFilter()
+{
+    g_autoptr(GError) error = nullptr;
+    DnfSack * bigSack = dnf_sack_new();
+    dnf_sack_set_cachedir(bigSack, tmpdir);
+    dnf_sack_set_arch(bigSack, "x86_64", NULL);
+    dnf_sack_setup(bigSack, 0, NULL);
+    // enough packages for the filters to be split across threads
+    std::string repodata = std::string(TESTDATADIR "/modules/modules/_all/x86_64/repodata/");
+    for (int i = 0; i < 100; ++i) {
+        HyRepo repo = hy_repo_create(("test_parallel_" + std::to_string(i)).c_str());
+        hy_repo_set_string(repo, HY_REPO_MD_FN, (repodata + "repomd.xml").c_str());
+        hy_repo_set_string(repo, HY_REPO_PRIMARY_FN, (repodata +
+            "7b20d2285e9d41d2f96f67029a28d11249485ad787606017bd855a3263d2209b-primary.xml.gz").c_str());
+        CPPUNIT_ASSERT(dnf_sack_load_repo(bigSack, repo, DNF_SACK_LOAD_FLAG_NONE, &error));
+        hy_repo_free(repo);
+    }
+    auto total = libdnf::Query(bigSack).size();
+    CPPUNIT_ASSERT(total > 4096);
+
+    struct {
+        int keyname;
+        int cmpType;
+        const char * match;
+        size_t expected;
+    } filters[] = {
+        {HY_PKG_SUMMARY, HY_SUBSTR, "Fake", total},
+        {HY_PKG_SUMMARY, HY_EQ | HY_ICASE, "fake PACKAGE", total},
+        {HY_PKG_DESCRIPTION, HY_GLOB, "*missing*", 0},
+    };
+    for (auto & filter : filters) {
+        auto serial = parallelFilterIds(bigSack, 1, filter.keyname, filter.cmpType, filter.match);
+        auto parallel = parallelFilterIds(bigSack, 4, filter.keyname, filter.cmpType,
+                                          filter.match);
+        CPPUNIT_ASSERT_EQUAL(filter.expected, serial.size());
+        CPPUNIT_ASSERT(serial == parallel);
+    }
+
+    // a small part of the pool is matched package by package
+    libdnf::Query oneRepo(bigSack, libdnf::Query::ExcludeFlags::IGNORE_EXCLUDES);
+    oneRepo.addFilter(HY_PKG_REPONAME, HY_EQ, "test_parallel_0");
+    auto oneRepoSize = oneRepo.size();
+    CPPUNIT_ASSERT(oneRepoSize > 0 && oneRepoSize * 4 < total);
+    libdnf::Query oneRepoFake(oneRepo);
+    oneRepoFake.addFilter(HY_PKG_SUMMARY, HY_SUBSTR, "Fake");
+    CPPUNIT_ASSERT_EQUAL(oneRepoSize, oneRepoFake.size());
+    oneRepo.addFilter(HY_PKG_DESCRIPTION, HY_GLOB, "*missing*");
+    CPPUNIT_ASSERT_EQUAL(size_t(0), oneRepo.size());
+
+    libdnf::getGlobalMainConfig().query_threads().set(libdnf::Option::Priority::RUNTIME, 0);
+    g_object_unref(bigSack);
+}
@@ -13,6 +13,18 @@ class QueryTest : public CppUnit::TestCase
     CPPUNIT_TEST_SUITE(QueryTest);
         CPPUNIT_TEST(testQueryGetAdvisoryPkgs);
         CPPUNIT_TEST(testQueryFilterAdvisory);
+        CPPUNIT_TEST(testQueryCopyOnWrite);
+        CPPUNIT_TEST(testQueryMove);
+        CPPUNIT_TEST(testQueryFilterTextIndex);
+        CPPUNIT_TEST(testFileIndex);
+        CPPUNIT_TEST(testFileIndexInvalidation);
+        CPPUNIT_TEST(testQueryFilterOrder);
+        CPPUNIT_TEST(testQueryFilterSubjects);
+        CPPUNIT_TEST(testQueryFilterAttribute);
+        CPPUNIT_TEST(testNameArchIndex);
+        CPPUNIT_TEST(testQueryStream);
+        CPPUNIT_TEST(testQueryStreamAdvisory);
+        CPPUNIT_TEST(testParallelFilter);
     CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -21,6 +33,18 @@ public:
 
     void testQueryGetAdvisoryPkgs();
     void testQueryFilterAdvisory();
+    void testQueryCopyOnWrite();
+    void testQueryMove();
+    void testQueryFilterTextIndex();
+    void testFileIndex();
+    void testFileIndexInvalidation();
+    void testQueryFilterOrder();
+    void testQueryFilterSubjects();
+    void testQueryFilterAttribute();
+    void testNameArchIndex();
+    void testQueryStream();
+    void testQueryStreamAdvisory();
+    void testParallelFilter();
 
 private:
     DnfSack *sack = nullptr;
@@ -0,0 +1,134 @@
+#include "RepoMetadataTest.hpp"
+
+#include "libdnf/dnf-types.h"
+#include "libdnf/hy-iutil-private.hpp"
+#include "libdnf/repo/Repo-private.hpp"
+#include "libdnf/sack/query.hpp"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(RepoMetadataTest);
+
+#define UNITTEST_DIR "/tmp/libdnfXXXXXX"
+
+#define REPODATA TESTDATADIR "/modules/modules/_all/x86_64/repodata/"
+#define PRIMARY "7b20d2285e9d41d2f96f67029a28d11249485ad787606017bd855a3263d2209b-primary.xml.gz"
+#define FILELISTS "fca8343fe9e52b62cbf4b64a0730ffb546bda5542286a884da54c1db5e522943-filelists.xml.gz"
+
+void RepoMetadataTest::setUp()
+{
+    g_autoptr(GError) error = nullptr;
+    tmpdir = g_strdup(UNITTEST_DIR);
+    CPPUNIT_ASSERT(mkdtemp(tmpdir));
+    sack = dnf_sack_new();
+    dnf_sack_set_cachedir(sack, tmpdir);
+    dnf_sack_set_arch(sack, "x86_64", nullptr);
+    CPPUNIT_ASSERT(dnf_sack_setup(sack, 0, &error));
+}
+
+void RepoMetadataTest::tearDown()
+{
+    g_object_unref(sack);
+    dnf_remove_recursive_v2(tmpdir, NULL);
+    g_free(tmpdir);
+}
+
+/* a repo whose zchunk metadata are missing, like downloaded by a librepo without zchunk
+ * support, and whose plain metadata are in plainDir */
+HyRepo RepoMetadataTest::createRepo(const std::string & plainDir)
+{
+    HyRepo repo = hy_repo_create("test");
+    auto repoImpl = libdnf::repoGetImpl(repo);
+    repoImpl->conf->getMainConfig().zchunk().set(libdnf::Option::Priority::RUNTIME, true);
+    hy_repo_set_string(repo, HY_REPO_MD_FN, REPODATA "repomd.xml");
+    hy_repo_set_string(repo, HY_REPO_PRIMARY_FN, (plainDir + PRIMARY).c_str());
+    hy_repo_set_string(repo, HY_REPO_FILELISTS_FN, (plainDir + FILELISTS).c_str());
+    std::string zckDir = std::string(tmpdir) + "/zck/";
+    repoImpl->metadataPaths["primary_zck"] = zckDir + "primary.xml.zck";
+    repoImpl->metadataPaths["filelists_zck"] = zckDir + "filelists.xml.zck";
+    return repo;
+}
+
+void RepoMetadataTest::testPlainOnly()
+{
+    g_autoptr(GError) error = nullptr;
+    HyRepo repo = createRepo(REPODATA);
+    auto repoImpl = libdnf::repoGetImpl(repo);
+    CPPUNIT_ASSERT(g_str_has_suffix(repo->getMetadataPath("primary").c_str(), ".zck"));
+
+    // primary and the filelists extension fall back to the plain files
+    CPPUNIT_ASSERT(dnf_sack_load_repo(sack, repo, DNF_SACK_LOAD_FLAG_USE_FILELISTS, &error));
+    CPPUNIT_ASSERT(error == nullptr);
+    CPPUNIT_ASSERT_EQUAL(_HY_LOADED_FETCH, repoImpl->state_main);
+    CPPUNIT_ASSERT_EQUAL(_HY_LOADED_FETCH, repoImpl->state_filelists);
+    libdnf::Query packages(sack, libdnf::Query::ExcludeFlags::IGNORE_EXCLUDES);
+    CPPUNIT_ASSERT(!packages.empty());
+    hy_repo_free(repo);
+}
+
+void RepoMetadataTest::testNoMetadata()
+{
+    g_autoptr(GError) error = nullptr;
+    HyRepo repo = createRepo(std::string(tmpdir) + "/missing/");
+
+    // neither variant can be opened, the load fails with an error instead of an assert
+    CPPUNIT_ASSERT(!dnf_sack_load_repo(sack, repo, DNF_SACK_LOAD_FLAG_NONE, &error));
+    CPPUNIT_ASSERT(g_error_matches(error, DNF_ERROR, DNF_ERROR_FILE_INVALID));
+    hy_repo_free(repo);
+}
+
+/* loads the advisories repo with its filelists and updateinfo into a new sack using the same
+ * cache, as if repomd.xml listed the given checksums of primary and of both extensions */
+HyRepo RepoMetadataTest::loadAdvisoryRepo(const char * primary, const char * ext)
+{
+    g_autoptr(GError) error = nullptr;
+    g_object_unref(sack);
+    sack = dnf_sack_new();
+    dnf_sack_set_cachedir(sack, tmpdir);
+    dnf_sack_set_arch(sack, "x86_64", nullptr);
+    CPPUNIT_ASSERT(dnf_sack_setup(sack, 0, &error));
+
+    std::string repodata = TESTDATADIR "/advisories/repodata/";
+    HyRepo repo = hy_repo_create("advisories");
+    hy_repo_set_string(repo, HY_REPO_MD_FN, (repodata + "repomd.xml").c_str());
+    hy_repo_set_string(repo, HY_REPO_PRIMARY_FN, (repodata + "primary.xml.gz").c_str());
+    hy_repo_set_string(repo, HY_REPO_FILELISTS_FN, (repodata + "filelists.xml.gz").c_str());
+    hy_repo_set_string(repo, HY_REPO_UPDATEINFO_FN, (repodata + "updateinfo.xml.gz").c_str());
+    auto & checksums = libdnf::repoGetImpl(repo)->metadataChecksums;
+    checksums["primary"] = primary;
+    checksums["filelists"] = ext;
+    checksums["updateinfo"] = ext;
+    CPPUNIT_ASSERT(dnf_sack_load_repo(sack, repo,
+                                      DNF_SACK_LOAD_FLAG_BUILD_CACHE |
+                                      DNF_SACK_LOAD_FLAG_USE_FILELISTS |
+                                      DNF_SACK_LOAD_FLAG_USE_UPDATEINFO,
+                                      &error));
+    return repo;
+}
+
+void RepoMetadataTest::testExtCacheKeys()
+{
+    HyRepo repo = loadAdvisoryRepo("primary-1", "ext-1");
+    auto repoImpl = libdnf::repoGetImpl(repo);
+    CPPUNIT_ASSERT_EQUAL(_HY_LOADED_FETCH, repoImpl->state_filelists);
+    CPPUNIT_ASSERT_EQUAL(_HY_LOADED_FETCH, repoImpl->state_updateinfo);
+    hy_repo_free(repo);
+
+    // the filelists extend the solvables of primary by position, the updateinfo does not
+    repo = loadAdvisoryRepo("primary-2", "ext-1");
+    repoImpl = libdnf::repoGetImpl(repo);
+    CPPUNIT_ASSERT_EQUAL(_HY_LOADED_FETCH, repoImpl->state_filelists);
+    CPPUNIT_ASSERT_EQUAL(_HY_LOADED_CACHE, repoImpl->state_updateinfo);
+    hy_repo_free(repo);
+
+    repo = loadAdvisoryRepo("primary-2", "ext-2");
+    repoImpl = libdnf::repoGetImpl(repo);
+    CPPUNIT_ASSERT_EQUAL(_HY_LOADED_FETCH, repoImpl->state_filelists);
+    CPPUNIT_ASSERT_EQUAL(_HY_LOADED_FETCH, repoImpl->state_updateinfo);
+    hy_repo_free(repo);
+
+    // unchanged checksums reuse both
+    repo = loadAdvisoryRepo("primary-2", "ext-2");
+    repoImpl = libdnf::repoGetImpl(repo);
+    CPPUNIT_ASSERT_EQUAL(_HY_LOADED_CACHE, repoImpl->state_filelists);
+    CPPUNIT_ASSERT_EQUAL(_HY_LOADED_CACHE, repoImpl->state_updateinfo);
+    hy_repo_free(repo);
+}
@@ -0,0 +1,36 @@
+#ifndef LIBDNF_REPOMETADATATEST_HPP
+#define LIBDNF_REPOMETADATATEST_HPP
+
+#include <cppunit/TestCase.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "libdnf/dnf-sack.h"
+#include "libdnf/hy-repo.h"
+
+#include <string>
+
+class RepoMetadataTest : public CppUnit::TestCase
+{
+    CPPUNIT_TEST_SUITE(RepoMetadataTest);
+        CPPUNIT_TEST(testPlainOnly);
+        CPPUNIT_TEST(testNoMetadata);
+        CPPUNIT_TEST(testExtCacheKeys);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void setUp() override;
+    void tearDown() override;
+
+    void testPlainOnly();
+    void testNoMetadata();
+    void testExtCacheKeys();
+
+private:
+    HyRepo createRepo(const std::string & plainDir);
+    HyRepo loadAdvisoryRepo(const char * primary, const char * ext);
+
+    char * tmpdir = nullptr;
+    DnfSack * sack = nullptr;
+};
+
+#endif // LIBDNF_REPOMETADATATEST_HPP
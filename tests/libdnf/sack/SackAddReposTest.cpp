@@ -0,0 +1,157 @@
+#include "SackAddReposTest.hpp"
+
+#include "libdnf/hy-iutil-private.hpp"
+#include "libdnf/sack/query.hpp"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+CPPUNIT_TEST_SUITE_REGISTRATION(SackAddReposTest);
+
+#define UNITTEST_DIR "/tmp/libdnfXXXXXX"
+
+/* $testdatadir keeps the repos remote, their metadata is downloaded into the cache */
+#define REPO_X86_64(id) \
+    "[" id "]\n" \
+    "name=" id "\n" \
+    "baseurl=file://$testdatadir/modules/modules/_all/x86_64/\n" \
+    "gpgcheck=0\n"
+
+#define REPO_I686(id) \
+    "[" id "]\n" \
+    "name=" id "\n" \
+    "baseurl=file://$testdatadir/modules/modules/_all/i686/\n" \
+    "gpgcheck=0\n"
+
+#define REPO_MISSING(id, skip) \
+    "[" id "]\n" \
+    "name=" id "\n" \
+    "baseurl=file://$testdatadir/no-such-repo/\n" \
+    "gpgcheck=0\n" \
+    "skip_if_unavailable=" skip "\n"
+
+static void
+recordPercentage(DnfState * state, guint percentage, gpointer data)
+{
+    static_cast<std::vector<guint> *>(data)->push_back(percentage);
+}
+
+void SackAddReposTest::setUp()
+{
+    tmpdir = g_strdup(UNITTEST_DIR);
+    CPPUNIT_ASSERT(mkdtemp(tmpdir));
+    lock = dnf_lock_new();
+    dnf_lock_set_lock_dir(lock, tmpdir);
+}
+
+void SackAddReposTest::tearDown()
+{
+    if (sack)
+        g_object_unref(sack);
+    if (context)
+        g_object_unref(context);
+    g_object_unref(lock);
+    dnf_remove_recursive_v2(tmpdir, NULL);
+    g_free(tmpdir);
+}
+
+void SackAddReposTest::setupContext(const char * repos)
+{
+    g_autoptr(GError) error = nullptr;
+    std::string reposDir = std::string(tmpdir) + "/yum.repos.d";
+    std::string cacheDir = std::string(tmpdir) + "/cache";
+    CPPUNIT_ASSERT_EQUAL(0, g_mkdir_with_parents(reposDir.c_str(), 0755));
+    CPPUNIT_ASSERT(g_file_set_contents((reposDir + "/test.repo").c_str(), repos, -1, &error));
+
+    dnf_context_set_config_file_path("");
+    context = dnf_context_new();
+    dnf_context_set_release_ver(context, "26");
+    dnf_context_set_arch(context, "x86_64");
+    dnf_context_set_install_root(context, TESTDATADIR "/modules/");
+    dnf_context_set_repo_dir(context, reposDir.c_str());
+    dnf_context_set_solv_dir(context, cacheDir.c_str());
+    dnf_context_set_cache_dir(context, cacheDir.c_str());
+    CPPUNIT_ASSERT(dnf_context_setup(context, nullptr, &error));
+
+    sack = dnf_sack_new();
+    dnf_sack_set_cachedir(sack, cacheDir.c_str());
+    dnf_sack_set_arch(sack, "x86_64", nullptr);
+    CPPUNIT_ASSERT(dnf_sack_setup(sack, DNF_SACK_SETUP_FLAG_MAKE_CACHE_DIR, &error));
+}
+
+gboolean SackAddReposTest::addRepos(DnfState * state, GError ** error)
+{
+    return dnf_sack_add_repos(sack, dnf_context_get_repos(context), G_MAXUINT,
+                              DNF_SACK_ADD_FLAG_NONE, state, error);
+}
+
+size_t SackAddReposTest::repoSize(const char * repoId)
+{
+    libdnf::Query query(sack, libdnf::Query::ExcludeFlags::IGNORE_EXCLUDES);
+    query.addFilter(HY_PKG_REPONAME, HY_EQ, repoId);
+    return query.size();
+}
+
+void SackAddReposTest::testAddReposParallel()
+{
+    // more than one repo without metadata, they are downloaded by worker threads
+    setupContext(REPO_X86_64("first") REPO_I686("second") REPO_X86_64("third"));
+    g_autoptr(GError) error = nullptr;
+    g_autoptr(DnfState) state = dnf_state_new();
+    std::vector<guint> percentages;
+    g_signal_connect(state, "percentage-changed", G_CALLBACK(recordPercentage), &percentages);
+    CPPUNIT_ASSERT(addRepos(state, &error));
+    CPPUNIT_ASSERT(repoSize("first") > 0);
+    CPPUNIT_ASSERT(repoSize("second") > 0);
+    CPPUNIT_ASSERT_EQUAL(repoSize("first"), repoSize("third"));
+
+    // the checks of all repos come first and report progress to the caller's state
+    CPPUNIT_ASSERT(std::any_of(percentages.begin(), percentages.end(),
+                               [](guint percentage) { return percentage > 0 && percentage <= 5; }));
+    CPPUNIT_ASSERT_EQUAL(100u, percentages.back());
+
+    // the cache is current now, nothing is downloaded again
+    g_object_unref(sack);
+    sack = dnf_sack_new();
+    dnf_sack_set_cachedir(sack, (std::string(tmpdir) + "/cache").c_str());
+    dnf_sack_set_arch(sack, "x86_64", nullptr);
+    CPPUNIT_ASSERT(dnf_sack_setup(sack, 0, &error));
+    g_autoptr(DnfState) stateCached = dnf_state_new();
+    CPPUNIT_ASSERT(addRepos(stateCached, &error));
+    CPPUNIT_ASSERT_EQUAL(repoSize("first"), repoSize("third"));
+}
+
+void SackAddReposTest::testAddReposSkipNotRequired()
+{
+    setupContext(REPO_X86_64("first") REPO_MISSING("missing", "1") REPO_I686("second"));
+    g_autoptr(GError) error = nullptr;
+    g_autoptr(DnfState) state = dnf_state_new();
+    CPPUNIT_ASSERT(addRepos(state, &error));
+    CPPUNIT_ASSERT(repoSize("first") > 0);
+    CPPUNIT_ASSERT(repoSize("second") > 0);
+    CPPUNIT_ASSERT_EQUAL(size_t(0), repoSize("missing"));
+}
+
+void SackAddReposTest::testAddReposFailRequired()
+{
+    setupContext(REPO_X86_64("first") REPO_MISSING("missing", "0") REPO_I686("second"));
+    g_autoptr(GError) error = nullptr;
+    g_autoptr(DnfState) state = dnf_state_new();
+    CPPUNIT_ASSERT(!addRepos(state, &error));
+    CPPUNIT_ASSERT(error != nullptr);
+}
+
+void SackAddReposTest::testAddReposCancelled()
+{
+    // the worker threads use the cancellable of the caller's state
+    setupContext(REPO_X86_64("first") REPO_I686("second"));
+    g_autoptr(GError) error = nullptr;
+    g_autoptr(DnfState) state = dnf_state_new();
+    g_autoptr(GCancellable) cancellable = g_cancellable_new();
+    dnf_state_set_cancellable(state, cancellable);
+    g_cancellable_cancel(cancellable);
+    CPPUNIT_ASSERT(!addRepos(state, &error));
+    CPPUNIT_ASSERT(g_error_matches(error, DNF_ERROR, DNF_ERROR_CANCELLED));
+    CPPUNIT_ASSERT_EQUAL(size_t(0), repoSize("first"));
+}
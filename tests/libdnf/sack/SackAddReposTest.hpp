@@ -0,0 +1,40 @@
+#ifndef LIBDNF_SACKADDREPOSTEST_HPP
+#define LIBDNF_SACKADDREPOSTEST_HPP
+
+#include <cppunit/TestCase.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "libdnf/dnf-context.h"
+#include "libdnf/dnf-lock.h"
+#include "libdnf/dnf-sack.h"
+
+class SackAddReposTest : public CppUnit::TestCase
+{
+    CPPUNIT_TEST_SUITE(SackAddReposTest);
+        CPPUNIT_TEST(testAddReposParallel);
+        CPPUNIT_TEST(testAddReposSkipNotRequired);
+        CPPUNIT_TEST(testAddReposFailRequired);
+        CPPUNIT_TEST(testAddReposCancelled);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void setUp() override;
+    void tearDown() override;
+
+    void testAddReposParallel();
+    void testAddReposSkipNotRequired();
+    void testAddReposFailRequired();
+    void testAddReposCancelled();
+
+private:
+    void setupContext(const char * repos);
+    gboolean addRepos(DnfState * state, GError ** error);
+    size_t repoSize(const char * repoId);
+
+    char * tmpdir = nullptr;
+    DnfLock * lock = nullptr;
+    DnfContext * context = nullptr;
+    DnfSack * sack = nullptr;
+};
+
+#endif // LIBDNF_SACKADDREPOSTEST_HPP
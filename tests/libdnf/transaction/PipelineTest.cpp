@@ -0,0 +1,128 @@
+#include "PipelineTest.hpp"
+
+#include "libdnf/dnf-goal.h"
+#include "libdnf/dnf-package.h"
+#include "libdnf/dnf-repo-loader.h"
+#include "libdnf/dnf-repo.h"
+#include "libdnf/hy-goal.h"
+#include "libdnf/hy-iutil-private.hpp"
+#include "libdnf/sack/packageset.hpp"
+#include "libdnf/sack/query.hpp"
+
+#include <string>
+
+CPPUNIT_TEST_SUITE_REGISTRATION(PipelineTest);
+
+#define UNITTEST_DIR "/tmp/libdnfXXXXXX"
+
+void
+PipelineTest::setUp()
+{
+    g_autoptr(GError) error = nullptr;
+
+    tmpdir = g_strdup(UNITTEST_DIR);
+    CPPUNIT_ASSERT(mkdtemp(tmpdir));
+
+    dnf_context_set_config_file_path("");
+    context = dnf_context_new();
+    // set releasever to avoid crashing on missing /etc/os-release in the test data
+    dnf_context_set_release_ver(context, "26");
+    dnf_context_set_arch(context, "x86_64");
+    dnf_context_set_install_root(context, TESTDATADIR "/modules/");
+    dnf_context_set_repo_dir(context, TESTDATADIR "/modules/yum.repos.d/");
+    dnf_context_set_solv_dir(context, tmpdir);
+    dnf_context_set_cache_dir(context, tmpdir);
+    dnf_context_set_write_history(context, FALSE);
+    dnf_context_set_platform_module(context, "platform:26");
+    CPPUNIT_ASSERT(dnf_context_setup(context, nullptr, &error));
+
+    DnfRepo * repo = dnf_repo_loader_get_repo_by_id(dnf_context_get_repo_loader(context), "test", &error);
+    CPPUNIT_ASSERT(repo != nullptr);
+    g_autoptr(DnfState) state_check = dnf_state_new();
+    CPPUNIT_ASSERT(dnf_repo_check(repo, G_MAXUINT, state_check, &error));
+    g_autoptr(DnfState) state = dnf_state_new();
+    CPPUNIT_ASSERT(dnf_context_setup_sack(context, state, &error));
+
+    /* the repo is a file:// one, make its packages go through librepo
+     * into the cache like those of a remote repo */
+    dnf_repo_set_kind(repo, DNF_REPO_KIND_REMOTE);
+    g_autofree gchar * packages = g_build_filename(tmpdir, "packages", NULL);
+    dnf_repo_set_packages(repo, packages);
+}
+
+void
+PipelineTest::tearDown()
+{
+    g_object_unref(context);
+    dnf_remove_recursive_v2(tmpdir, NULL);
+    g_free(tmpdir);
+}
+
+void
+PipelineTest::depsolve(DnfTransaction * transaction)
+{
+    g_autoptr(GError) error = nullptr;
+    DnfSack * sack = dnf_context_get_sack(context);
+
+    libdnf::Query query(sack);
+    query.addFilter(HY_PKG_NEVRA_STRICT, HY_EQ, "grub2-2.02-0.40.x86_64");
+    auto pset = query.runSet();
+    CPPUNIT_ASSERT_EQUAL(size_t(1), pset->size());
+    g_autoptr(DnfPackage) pkg = dnf_package_new(sack, (*pset)[0]);
+
+    HyGoal goal = hy_goal_create(sack);
+    hy_goal_install(goal, pkg);
+    dnf_transaction_set_repos(transaction, dnf_context_get_repos(context));
+    g_autoptr(DnfState) state = dnf_state_new();
+    CPPUNIT_ASSERT(dnf_transaction_depsolve(transaction, goal, state, &error));
+    hy_goal_free(goal);
+}
+
+void
+PipelineTest::testDownloadVerifies()
+{
+    g_autoptr(GError) error = nullptr;
+    g_autoptr(DnfTransaction) transaction = dnf_transaction_new(context);
+    dnf_transaction_set_flags(transaction, DNF_TRANSACTION_FLAG_PIPELINE);
+    depsolve(transaction);
+
+    /* grub2 and the filesystem it requires */
+    GPtrArray * remote = dnf_transaction_get_remote_pkgs(transaction);
+    CPPUNIT_ASSERT_EQUAL(2u, remote->len);
+
+    g_autoptr(DnfState) state = dnf_state_new();
+    CPPUNIT_ASSERT(dnf_transaction_download(transaction, state, &error));
+    CPPUNIT_ASSERT(error == nullptr);
+    for (guint i = 0; i < remote->len; i++) {
+        auto pkg = static_cast<DnfPackage *>(g_ptr_array_index(remote, i));
+        CPPUNIT_ASSERT(g_file_test(dnf_package_get_filename(pkg), G_FILE_TEST_EXISTS));
+    }
+
+    /* everything is in the cache now */
+    depsolve(transaction);
+    CPPUNIT_ASSERT_EQUAL(0u, dnf_transaction_get_remote_pkgs(transaction)->len);
+}
+
+void
+PipelineTest::testDownloadFailsUntrusted()
+{
+    g_autoptr(GError) error = nullptr;
+    g_autoptr(DnfTransaction) transaction = dnf_transaction_new(context);
+    dnf_transaction_set_flags(transaction,
+                              DNF_TRANSACTION_FLAG_PIPELINE | DNF_TRANSACTION_FLAG_ONLY_TRUSTED);
+    depsolve(transaction);
+
+    /* the test packages are not signed, the verifier must fail the
+     * download instead of leaving it to the commit */
+    g_autoptr(DnfState) state = dnf_state_new();
+    CPPUNIT_ASSERT(!dnf_transaction_download(transaction, state, &error));
+    CPPUNIT_ASSERT(error != nullptr);
+}
+
+void
+PipelineTest::testContextTransactionPipelined()
+{
+    /* dnf_context_run() downloads through the pipeline */
+    DnfTransaction * transaction = dnf_context_get_transaction(context);
+    CPPUNIT_ASSERT(dnf_transaction_get_flags(transaction) & DNF_TRANSACTION_FLAG_PIPELINE);
+}
@@ -0,0 +1,32 @@
+#ifndef LIBDNF_PIPELINE_TEST_HPP
+#define LIBDNF_PIPELINE_TEST_HPP
+
+#include <cppunit/TestCase.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "libdnf/dnf-context.h"
+#include "libdnf/dnf-transaction.h"
+
+class PipelineTest : public CppUnit::TestCase {
+    CPPUNIT_TEST_SUITE(PipelineTest);
+    CPPUNIT_TEST(testDownloadVerifies);
+    CPPUNIT_TEST(testDownloadFailsUntrusted);
+    CPPUNIT_TEST(testContextTransactionPipelined);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void setUp() override;
+    void tearDown() override;
+
+    void testDownloadVerifies();
+    void testDownloadFailsUntrusted();
+    void testContextTransactionPipelined();
+
+private:
+    void depsolve(DnfTransaction * transaction);
+
+    char * tmpdir;
+    DnfContext * context;
+};
+
+#endif // LIBDNF_PIPELINE_TEST_HPP
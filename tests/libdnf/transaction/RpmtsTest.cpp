@@ -0,0 +1,124 @@
+#include "RpmtsTest.hpp"
+
+#include "libdnf/dnf-package.h"
+#include "libdnf/dnf-rpmts-private.hpp"
+#include "libdnf/hy-iutil-private.hpp"
+#include "libdnf/hy-repo.h"
+#include "libdnf/sack/query.hpp"
+
+#include <string>
+
+extern "C" {
+#include <solv/pool.h>
+#include <solv/repo.h>
+}
+
+#include <rpm/rpmlib.h>
+
+CPPUNIT_TEST_SUITE_REGISTRATION(RpmtsTest);
+
+#define UNITTEST_DIR "/tmp/libdnfXXXXXX"
+
+void
+RpmtsTest::setUp()
+{
+    g_autoptr(GError) error = nullptr;
+
+    tmpdir = g_strdup(UNITTEST_DIR);
+    CPPUNIT_ASSERT(mkdtemp(tmpdir));
+
+    sack = dnf_sack_new();
+    dnf_sack_set_cachedir(sack, tmpdir);
+    dnf_sack_set_arch(sack, "x86_64", NULL);
+    dnf_sack_setup(sack, 0, NULL);
+    HyRepo repo = hy_repo_create("test_rpmts_repo");
+    std::string repodata = std::string(TESTDATADIR "/advisories/repodata/");
+    hy_repo_set_string(repo, HY_REPO_MD_FN, (repodata + "repomd.xml").c_str());
+    hy_repo_set_string(repo, HY_REPO_PRIMARY_FN, (repodata + "primary.xml.gz").c_str());
+    CPPUNIT_ASSERT(dnf_sack_load_repo(sack, repo, DNF_SACK_LOAD_FLAG_NONE, &error));
+    hy_repo_free(repo);
+
+    /* an empty root, nothing can be found in its rpmdb */
+    ts = rpmtsCreate();
+    rpmtsSetRootDir(ts, tmpdir);
+}
+
+void
+RpmtsTest::tearDown()
+{
+    rpmtsFree(ts);
+    g_object_unref(sack);
+    dnf_remove_recursive_v2(tmpdir, NULL);
+    g_free(tmpdir);
+}
+
+void
+RpmtsTest::testFindPackagesWithoutRpmdbid()
+{
+    g_autoptr(GError) error = nullptr;
+    libdnf::Query query(sack, libdnf::Query::ExcludeFlags::IGNORE_EXCLUDES);
+    g_autoptr(GPtrArray) pkgs = query.run();
+    CPPUNIT_ASSERT(pkgs->len > 0);
+
+    // packages of an available repo have no rpmdbid, the rpmdb is not even opened
+    g_autoptr(GHashTable) headers = dnf_rpmts_find_packages(ts, pkgs, &error);
+    CPPUNIT_ASSERT(headers != nullptr);
+    CPPUNIT_ASSERT(error == nullptr);
+    CPPUNIT_ASSERT_EQUAL(0u, g_hash_table_size(headers));
+}
+
+void
+RpmtsTest::testAddRemovePkgFallback()
+{
+    libdnf::Query query(sack, libdnf::Query::ExcludeFlags::IGNORE_EXCLUDES);
+    g_autoptr(GPtrArray) pkgs = query.run();
+    CPPUNIT_ASSERT(pkgs->len > 0);
+    auto pkg = static_cast<DnfPackage *>(g_ptr_array_index(pkgs, 0));
+
+    // a package missing from the batch is looked up on its own and is not in the empty rpmdb
+    g_autoptr(GHashTable) headers = g_hash_table_new(g_direct_hash, g_direct_equal);
+    g_autoptr(GError) error = nullptr;
+    CPPUNIT_ASSERT(!dnf_rpmts_add_remove_pkg2(ts, pkg, headers, &error));
+    CPPUNIT_ASSERT(error != nullptr);
+
+    // the same without any batch
+    g_autoptr(GError) error_single = nullptr;
+    CPPUNIT_ASSERT(!dnf_rpmts_add_remove_pkg2(ts, pkg, nullptr, &error_single));
+    CPPUNIT_ASSERT(error_single != nullptr);
+}
+
+void
+RpmtsTest::testFindPackagesBatch()
+{
+    g_autoptr(GError) error = nullptr;
+    libdnf::Query query(sack, libdnf::Query::ExcludeFlags::IGNORE_EXCLUDES);
+    g_autoptr(GPtrArray) pkgs = query.run();
+    CPPUNIT_ASSERT(pkgs->len >= 4);
+
+    // give the packages rpmdbids in reverse order and one duplicate, as an
+    // installed repo would, so that the lookup goes through the batch
+    Pool * pool = dnf_sack_get_pool(sack);
+    for (guint i = 0; i < 4; i++) {
+        auto pkg = static_cast<DnfPackage *>(g_ptr_array_index(pkgs, i));
+        Id id = dnf_package_get_id(pkg);
+        repo_set_num(pool->solvables[id].repo, id, RPM_RPMDBID, i < 3 ? 1000 - i : 1000);
+    }
+    for (guint i = 0; i < 4; i++)
+        CPPUNIT_ASSERT(dnf_package_get_rpmdbid(static_cast<DnfPackage *>(g_ptr_array_index(pkgs, i))) != 0);
+
+    // an existing but empty rpmdb, the batch is iterated and finds nothing
+    CPPUNIT_ASSERT_EQUAL(0, rpmReadConfigFiles(nullptr, nullptr));
+    CPPUNIT_ASSERT_EQUAL(0, rpmtsInitDB(ts, 0644));
+    g_autoptr(GHashTable) headers = dnf_rpmts_find_packages(ts, pkgs, &error);
+    CPPUNIT_ASSERT(headers != nullptr);
+    CPPUNIT_ASSERT(error == nullptr);
+    CPPUNIT_ASSERT_EQUAL(0u, g_hash_table_size(headers));
+
+    // every package missing from the batch falls back to its own lookup
+    for (guint i = 0; i < 4; i++) {
+        auto pkg = static_cast<DnfPackage *>(g_ptr_array_index(pkgs, i));
+        g_autoptr(GError) error_pkg = nullptr;
+        CPPUNIT_ASSERT(!dnf_rpmts_add_remove_pkg2(ts, pkg, headers, &error_pkg));
+        CPPUNIT_ASSERT(error_pkg != nullptr);
+    }
+}
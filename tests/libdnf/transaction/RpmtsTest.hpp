@@ -0,0 +1,32 @@
+#ifndef LIBDNF_RPMTS_TEST_HPP
+#define LIBDNF_RPMTS_TEST_HPP
+
+#include <cppunit/TestCase.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <rpm/rpmts.h>
+
+#include "libdnf/dnf-sack.h"
+
+class RpmtsTest : public CppUnit::TestCase {
+    CPPUNIT_TEST_SUITE(RpmtsTest);
+    CPPUNIT_TEST(testFindPackagesWithoutRpmdbid);
+    CPPUNIT_TEST(testAddRemovePkgFallback);
+    CPPUNIT_TEST(testFindPackagesBatch);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void setUp() override;
+    void tearDown() override;
+
+    void testFindPackagesWithoutRpmdbid();
+    void testAddRemovePkgFallback();
+    void testFindPackagesBatch();
+
+private:
+    char * tmpdir;
+    DnfSack * sack;
+    rpmts ts;
+};
+
+#endif // LIBDNF_RPMTS_TEST_HPP
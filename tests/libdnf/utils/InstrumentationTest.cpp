@@ -0,0 +1,116 @@
+#include "InstrumentationTest.hpp"
+
+#include "libdnf/dnf-context.h"
+#include "libdnf/utils/Instrumentation.hpp"
+
+#include <glib/gstdio.h>
+
+#include <json.h>
+
+CPPUNIT_TEST_SUITE_REGISTRATION(InstrumentationTest);
+
+void InstrumentationTest::setUp()
+{
+    libdnf::Instrumentation::reset();
+}
+
+void InstrumentationTest::tearDown()
+{
+    libdnf::Instrumentation::setEnabled(false);
+    libdnf::Instrumentation::reset();
+}
+
+void InstrumentationTest::testDisabled()
+{
+    libdnf::Instrumentation::setEnabled(false);
+    libdnf::Instrumentation::count("test.counter");
+    {
+        libdnf::ScopedTimer timer("test.timer");
+    }
+
+    auto root = json_tokener_parse(libdnf::Instrumentation::toJson().c_str());
+    CPPUNIT_ASSERT(root);
+    json_object * section;
+    CPPUNIT_ASSERT(json_object_object_get_ex(root, "counters", &section));
+    CPPUNIT_ASSERT_EQUAL(0, json_object_object_length(section));
+    CPPUNIT_ASSERT(json_object_object_get_ex(root, "timers", &section));
+    CPPUNIT_ASSERT_EQUAL(0, json_object_object_length(section));
+    json_object_put(root);
+}
+
+void InstrumentationTest::testCounters()
+{
+    libdnf::Instrumentation::setEnabled(true);
+    libdnf::Instrumentation::count("test.counter");
+    libdnf::Instrumentation::count("test.counter", 4);
+    libdnf::Instrumentation::observe("test.histogram", 3);
+    libdnf::Instrumentation::observe("test.histogram", 100);
+
+    auto root = json_tokener_parse(libdnf::Instrumentation::toJson().c_str());
+    CPPUNIT_ASSERT(root);
+    json_object * section;
+    json_object * value;
+    CPPUNIT_ASSERT(json_object_object_get_ex(root, "counters", &section));
+    CPPUNIT_ASSERT(json_object_object_get_ex(section, "test.counter", &value));
+    CPPUNIT_ASSERT_EQUAL(static_cast<int64_t>(5), json_object_get_int64(value));
+
+    json_object * histogram;
+    CPPUNIT_ASSERT(json_object_object_get_ex(root, "histograms", &section));
+    CPPUNIT_ASSERT(json_object_object_get_ex(section, "test.histogram", &histogram));
+    CPPUNIT_ASSERT(json_object_object_get_ex(histogram, "count", &value));
+    CPPUNIT_ASSERT_EQUAL(static_cast<int64_t>(2), json_object_get_int64(value));
+    CPPUNIT_ASSERT(json_object_object_get_ex(histogram, "min", &value));
+    CPPUNIT_ASSERT_EQUAL(static_cast<int64_t>(3), json_object_get_int64(value));
+    CPPUNIT_ASSERT(json_object_object_get_ex(histogram, "max", &value));
+    CPPUNIT_ASSERT_EQUAL(static_cast<int64_t>(100), json_object_get_int64(value));
+    CPPUNIT_ASSERT(json_object_object_get_ex(histogram, "buckets", &section));
+    CPPUNIT_ASSERT(json_object_object_get_ex(section, "4", &value));
+    CPPUNIT_ASSERT(json_object_object_get_ex(section, "128", &value));
+    json_object_put(root);
+}
+
+void InstrumentationTest::testTimers()
+{
+    libdnf::Instrumentation::setEnabled(true);
+    for (int i = 0; i < 3; ++i) {
+        libdnf::ScopedTimer timer("test.timer");
+    }
+
+    auto root = json_tokener_parse(libdnf::Instrumentation::toJson().c_str());
+    CPPUNIT_ASSERT(root);
+    json_object * section;
+    json_object * timer;
+    json_object * value;
+    CPPUNIT_ASSERT(json_object_object_get_ex(root, "timers", &section));
+    CPPUNIT_ASSERT(json_object_object_get_ex(section, "test.timer", &timer));
+    CPPUNIT_ASSERT(json_object_object_get_ex(timer, "count", &value));
+    CPPUNIT_ASSERT_EQUAL(static_cast<int64_t>(3), json_object_get_int64(value));
+    json_object_put(root);
+}
+
+void InstrumentationTest::testContextReport()
+{
+    g_autofree gchar * tmpdir = g_dir_make_tmp("libdnf-instrumentation-XXXXXX", nullptr);
+    CPPUNIT_ASSERT(tmpdir);
+    g_autofree gchar * report = g_build_filename(tmpdir, "report.json", NULL);
+
+    dnf_context_set_config_file_path("");
+    DnfContext * context = dnf_context_new();
+    dnf_context_set_instrumentation_report(context, report);
+    CPPUNIT_ASSERT(libdnf::Instrumentation::isEnabled());
+    libdnf::Instrumentation::count("test.counter");
+    g_object_unref(context);
+
+    // the report is written and the collection stops with the context
+    CPPUNIT_ASSERT(g_file_test(report, G_FILE_TEST_EXISTS));
+    CPPUNIT_ASSERT(!libdnf::Instrumentation::isEnabled());
+    auto root = json_tokener_parse(libdnf::Instrumentation::toJson().c_str());
+    CPPUNIT_ASSERT(root);
+    json_object * section;
+    CPPUNIT_ASSERT(json_object_object_get_ex(root, "counters", &section));
+    CPPUNIT_ASSERT_EQUAL(0, json_object_object_length(section));
+    json_object_put(root);
+
+    g_unlink(report);
+    g_rmdir(tmpdir);
+}
@@ -0,0 +1,26 @@
+#ifndef LIBDNF_INSTRUMENTATIONTEST_HPP
+#define LIBDNF_INSTRUMENTATIONTEST_HPP
+
+#include <cppunit/TestCase.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+class InstrumentationTest : public CppUnit::TestCase
+{
+    CPPUNIT_TEST_SUITE(InstrumentationTest);
+        CPPUNIT_TEST(testDisabled);
+        CPPUNIT_TEST(testCounters);
+        CPPUNIT_TEST(testTimers);
+        CPPUNIT_TEST(testContextReport);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void setUp() override;
+    void tearDown() override;
+
+    void testDisabled();
+    void testCounters();
+    void testTimers();
+    void testContextReport();
+};
+
+#endif // LIBDNF_INSTRUMENTATIONTEST_HPP